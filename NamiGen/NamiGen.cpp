@@ -1,9 +1,14 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstdio>
 
 #include "NamiGenOptions.h"
-#include "NamiGenFunctions.h"
+#include "NamiGenJob.h"
+#include "NamiGenBatch.h"
+#include "NamiGenBench.h"
+#include "NamiGenFuzz.h"
+#include "NamiGenArch.h"
 
 static void PrintHelp()
 {
@@ -27,9 +32,11 @@ static void PrintHelp()
     std::cout << std::endl;
     std::cout << "-o <type>\t\t: Output type (default \"grd\")" << std::endl;
     std::cout << "\tgrd\t\t: ASCII grd file" << std::endl;
-    std::cout << "\tgrdbin\t\t: Binary grd file" << std::endl;
+    std::cout << "\tgrdbin\t\t: Binary grd file (max size 32767 32767)" << std::endl;
+    std::cout << "\tgrd7\t\t: Surfer 7 binary grd file" << std::endl;
+    std::cout << "\ttiff\t\t: Tiled float GeoTIFF file" << std::endl;
     std::cout << std::endl;
-    std::cout << "-n <name>\t\t: Output file name type (default \"output(_bin).grd\")" << std::endl;
+    std::cout << "-n <name>\t\t: Output file name type (default \"output(_bin|_7).grd\" or \"output.tif\")" << std::endl;
     std::cout << "-lat <X> <Y>\t\t: Latitude values (default 0.0 1.0f)" << std::endl;
     std::cout << "-lon <X> <Y>\t\t: Longitude values (default 0.0 1.0f)" << std::endl;
     std::cout << "-size <X> <Y>\t\t: Grid size (default 256 256)" << std::endl;
@@ -38,6 +45,83 @@ static void PrintHelp()
     std::cout << "-wall\t\t\t: Puts walls on the borders (default off)" << std::endl;
     std::cout << "-w <width>\t\t: Wall width in terms of grids (default 3pt)" << std::endl;
     std::cout << "-tana <width>\t\t: tangent of the linear slope (default 1, tan(pi/4))" << std::endl;
+    std::cout << "-threads <count>\t: Generation thread count (default 0, all hardware threads)" << std::endl;
+    std::cout << "-simd <type>\t\t: Vectorized row kernels (default \"off\")" << std::endl;
+    std::cout << "\toff\t\t: Scalar samplers, exact output" << std::endl;
+    std::cout << "\tauto\t\t: Widest instruction set that CPU supports" << std::endl;
+    std::cout << "\tsse\t\t: SSE2 kernels" << std::endl;
+    std::cout << "\tavx2\t\t: AVX2 kernels" << std::endl;
+    std::cout << "\tavx512\t\t: AVX-512 kernels" << std::endl;
+    std::cout << "-verify\t\t\t: Compares output against the reference samplers" << std::endl;
+    std::cout << "-mmap\t\t\t: Generates binary grd directly into the mapped file" << std::endl;
+    std::cout << "-stream\t\t\t: Generates and writes in row bands with bounded memory (grd, grdbin)" << std::endl;
+    std::cout << "-compress <type>\t: Tiff tile compression (default \"none\")" << std::endl;
+    std::cout << "\tnone\t\t: Uncompressed tiles" << std::endl;
+    std::cout << "\tpackbits\t: PackBits compressed tiles" << std::endl;
+    std::cout << "-lut <error>\t\t: Radial profile tables for circsin and wavecirc with the given" << std::endl;
+    std::cout << "\t\t\t  max absolute error (default 0, exact samplers)" << std::endl;
+    std::cout << "-profile\t\t: Prints stage timings and peak memory" << std::endl;
+    std::cout << "-bench <maxSize>\t: Times every type with grd and grdbin writers on" << std::endl;
+    std::cout << "\t\t\t  square grids from 256 doubling up to maxSize" << std::endl;
+    std::cout << "-batch <file>\t\t: Runs every job of the file, one job per line as switches" << std::endl;
+    std::cout << "\t\t\t  values can be swept with \"a,b,c\" or \"start:end:step\"" << std::endl;
+    std::cout << "-window <X> <Y> <W> <H>\t: Generates only the given cell region, lat/lon" << std::endl;
+    std::cout << "\t\t\t  of the output is narrowed to the region (default whole grid)" << std::endl;
+    std::cout << "-tiles <N> <M>\t\t: Splits the grid (or window) into NxM files named" << std::endl;
+    std::cout << "\t\t\t  \"<name>_<column>_<row>\", generated in parallel (default 1 1)" << std::endl;
+    std::cout << "-nest <R> <X> <Y> <W> <H>: Child grid over the parent nodes [X, X+W) x [Y, Y+H)" << std::endl;
+    std::cout << "\t\t\t  with R times finer spacing, named \"<name>_nest<index>\"" << std::endl;
+    std::cout << "\t\t\t  (repeatable, geometry matches the parent at shared nodes)" << std::endl;
+    std::cout << "-precision <type>\t: Storage type of the grid (default \"f32\")" << std::endl;
+    std::cout << "\tf32\t\t: 32-bit float" << std::endl;
+    std::cout << "\thalf\t\t: 16-bit float (tiff)" << std::endl;
+    std::cout << "\tq16\t\t: 16-bit integer, scale/offset in tiff GDAL metadata (tiff)" << std::endl;
+    std::cout << "\tf64\t\t: 64-bit float, double wave samplers (tiff, grd7)" << std::endl;
+    std::cout << "-layer \"<switches>\"\t: Adds a layer, all layers are generated in one pass into" << std::endl;
+    std::cout << "\t\t\t  \"<name>_bathy\" and \"<name>_eta\" (waves) grids (repeatable)" << std::endl;
+    std::cout << "\t\t\t  takes -t -gap -z -wall -w -tana -lut -simd on top of the options" << std::endl;
+    std::cout << "\t-op <op>\t: Combine op, default \"set\" for the first layer of a grid," << std::endl;
+    std::cout << "\t\t\t  then \"min\" for bathymetry and \"add\" for waves" << std::endl;
+    std::cout << "\t\t\t  set, min, max, add" << std::endl;
+    std::cout << "\t-t wall\t\t: Sets cells within -w of the borders to land" << std::endl;
+    std::cout << "\t-t clamp\t: Clamps cells to the -z range" << std::endl;
+    std::cout << "-layers <file>\t\t: Adds the layers of the file, one layer per line" << std::endl;
+    std::cout << "-sources <file>\t\t: Superposes the solitary waves of the file instead of -t" << std::endl;
+    std::cout << "\t\t\t  (also in a layer), one source per line in cells" << std::endl;
+    std::cout << "\t\t\t  \"x y height [depth]\" or \"x0 y0 x1 y1 height [depth]\" segments" << std::endl;
+    std::cout << "\t\t\t  depth defaults to the -z bottom, sources are culled by support radius" << std::endl;
+    std::cout << "-cache <dir>\t\t: Links outputs of a job generated before from the directory," << std::endl;
+    std::cout << "\t\t\t  only patches the header if just lat/lon of a bathymetry changed" << std::endl;
+    std::cout << "\t\t\t  (cached files are read only, links may share them)" << std::endl;
+    std::cout << "-input <file>\t\t: Applies the layers to an existing grd or grdbin grid" << std::endl;
+    std::cout << "\t\t\t  instead of generating one, size and lat/lon are of the grid" << std::endl;
+    std::cout << "\t\t\t  (default op \"min\" for bathymetry, \"add\" for waves)" << std::endl;
+    std::cout << "-frames <N>\t\t: Writes N frames of a plane wave (wavehorizontal, wavevertical)" << std::endl;
+    std::cout << "\t\t\t  travelling with celerity sqrt(g(d + H)), named \"<name>_t<index>\"" << std::endl;
+    std::cout << "-dt <seconds>\t\t: Time between the frames" << std::endl;
+    std::cout << "-derived <fields>\t: Comma separated fields reduced while the grid is generated," << std::endl;
+    std::cout << "\t\t\t  written to \"<name>.json\"" << std::endl;
+    std::cout << "\tslope\t\t: Gradient magnitude grid \"<name>_slope\", max and mean" << std::endl;
+    std::cout << "\thist\t\t: Histogram of 64 bins over the -z range (waves 0 to H)" << std::endl;
+    std::cout << "\twet\t\t: Wet (depth above zero) and dry cell counts" << std::endl;
+    std::cout << "\tcfl\t\t: Time step of -courant at the deepest cell" << std::endl;
+    std::cout << "-courant <C>\t\t: Courant number of the cfl time step (default 1)" << std::endl;
+    std::cout << "-fuzz <count>\t\t: Compares the optimized samplers and writers against the" << std::endl;
+    std::cout << "\t\t\t  reference loop and writers on edge cases and count random options" << std::endl;
+    std::cout << "-seed <value>\t\t: Random seed of -fuzz (default 1)" << std::endl;
+    std::cout << "-layout <type>\t\t: Grid memory layout while generating (default \"rows\")" << std::endl;
+    std::cout << "\trows\t\t: Row major" << std::endl;
+    std::cout << "\ttiled\t\t: 64x64 tiles, one job per tile, converted to rows in bands on write" << std::endl;
+    std::cout << "-pages <type>\t\t: Pages of the grid memory, not zero initialized (default \"thp\")" << std::endl;
+    std::cout << "\tsmall\t\t: Base pages" << std::endl;
+    std::cout << "\tthp\t\t: Transparent huge pages" << std::endl;
+    std::cout << "\tlarge\t\t: Explicit huge pages, thp if none are reserved" << std::endl;
+    std::cout << "-interleave\t\t: Interleaves the grid pages over the NUMA nodes (Linux)" << std::endl;
+    std::cout << "-io <type>\t\t: Output file backend (default \"ofstream\")" << std::endl;
+    std::cout << "\tofstream\t: Blocking writes on the writing thread" << std::endl;
+    std::cout << "\turing\t\t: Chunks queued to io_uring (Linux), pwrite if unavailable" << std::endl;
+    std::cout << "\tpwrite\t\t: Chunks written by a writer thread pool" << std::endl;
+    std::cout << "-direct\t\t\t: Output bypasses the page cache (O_DIRECT), needs -io uring|pwrite" << std::endl;
 }
 
 static void PrintOptions(const NamiGenOptions& options)
@@ -52,12 +136,22 @@ static void PrintOptions(const NamiGenOptions& options)
     std::cout << "Walls\t: " << ((options.hasWalls) ? std::string("true") : std::string("false")) << std::endl;
     std::cout << "Width\t: " << options.wallWidth << std::endl;
     std::cout << "Tana\t: " << options.tana << std::endl;
+    std::cout << "Threads\t: " << ResolveThreadCount(options.threadCount) << std::endl;
+    std::cout << "Simd\t: " << SimdLevelToString(ResolveSimdLevel(options.simd)) << std::endl;
+    std::cout << "Lut\t: " << options.lutError << std::endl;
+    std::cout << "Prec\t: " << GenPrecisionToString(options.precision) << std::endl;
+    std::cout << "Build\t: " << NAMI_ARCH_NAME << " (CPU " << ArchLevelToString(DetectArchLevel()) << ")" << std::endl;
 }
 
 int main(int argc, const char* argv[])
 {
-    NamiGenOptions namiOptions = namiOptsDefault;
-    std::string outputFileName = "output";
+    // Hand over to the micro architecture specific build if there is one
+    #ifdef NAMI_ARCH_DISPATCH
+        int variantResult = RunArchVariant(argc, argv);
+        if(variantResult >= 0) return variantResult;
+    #endif
+
+    NamiGenJob job = DefaultJob();
     if(argc == 1)
     {
         PrintHelp();
@@ -65,197 +159,45 @@ int main(int argc, const char* argv[])
     else
     {
         // Consume Args
-        for(int i = 1; i < argc; i++)
-        {
-            const std::string arg = argv[i];
+        std::vector<std::string> args(argv + 1, argv + argc);
+        if(!ParseArgs(args, job)) return 0;
 
-            // Traverse Switches
-            int argId = 0;
-            for(const std::string& sw : switches)
-            {
-                if(arg == sw)
-                {
-                    // Found a valid switch
-                    // Check if we can consume enough args
-                    if(argc - i <= switchArgCounts[argId])
-                    {
-                        // not enough arg count to open this
-                        std::cout << "Invalid arg count" << std::endl;
-                        return 0;
-                    }
-                    else
-                    {
-                        // Arg Parse
-                        if(arg == switches[0]) // -l
-                        {
-                            NamiGenType type = GenTypeToEnum(argv[i + 1]);
-                            if(type == NamiGenType::INVALID)
-                            {
-                                std::cout << "Invalid " << switches[0] << " switch" << std::endl;
-                                return 0;
-                            }
-                            namiOptions.type = type;
-                        }
-                        else if(arg == switches[1]) // -o
-                        {
-                            NamiGenOut outType = GenOutToEnum(argv[i + 1]);
-                            if(outType == NamiGenOut::INVALID)
-                            {
-                                std::cout << "Invalid " << switches[1] << " switch" << std::endl;
-                                return 0;
-                            }
-                            namiOptions.output = outType;
-                        }
-                        else if(arg == switches[2]) // -lat
-                        {
-                            namiOptions.latMin = std::stod(argv[i + 1]);
-                            namiOptions.latMax = std::stod(argv[i + 2]);
-                        }
-                        else if(arg == switches[3]) // -lon
-                        {
-                            namiOptions.lonMin = std::stod(argv[i + 1]);
-                            namiOptions.lonMax = std::stod(argv[i + 2]);
-                        }
-                        else if(arg == switches[4]) // -size
-                        {
-                            namiOptions.sizeX = std::stoi(argv[i + 1]);
-                            namiOptions.sizeY = std::stoi(argv[i + 2]);
-                        }
-                        else if(arg == switches[5]) // -gap
-                        {
-                            namiOptions.gapBottom = std::stoi(argv[i + 1]);
-                            namiOptions.gapTop = std::stoi(argv[i + 2]);
-                        }
-                        else if(arg == switches[6]) // -z
-                        {
-                            namiOptions.zLand = std::stof(argv[i + 1]);
-                            namiOptions.zBottom = std::stof(argv[i + 2]);
-                        }
-                        else if(arg == switches[7]) // -wall
-                        {
-                            namiOptions.hasWalls = true;
-                        }
-                        else if(arg == switches[8]) // -w
-                        {
-                            namiOptions.wallWidth = std::stoi(argv[i + 1]);
-                        }
-                        else if(arg == switches[9]) // -n
-                        {
-                            outputFileName = argv[i + 1];
-                        }
-                        else if(arg == switches[10]) // -tana
-                        {
-                            namiOptions.tana = std::stof(argv[i + 1]);
-                        }
-                        i += switchArgCounts[argId];
-                        break;
-                    }
-                }
-                argId++;
-            }
-            if(argId == switches.size())
-            {
-                std::cout << "Invalid Switch" << std::endl;
-                return 0;
-            }
+        if(!job.batchFile.empty())
+        {
+            std::vector<NamiGenJob> jobs;
+            if(!LoadBatch(job.batchFile, job, jobs)) return 0;
+            unsigned int threadCount = ResolveThreadCount(job.options.threadCount);
+            std::cout << "Batch\t: " << jobs.size() << " jobs, "
+                      << threadCount << " threads" << std::endl;
+            return RunBatch(jobs, threadCount) ? 0 : 1;
         }
 
+        if(job.benchSize > 0)
+            return RunBenchmark(job) ? 0 : 1;
+
+        if(job.fuzzCount > 0)
+            return RunFuzz(job.fuzzCount, job.fuzzSeed) ? 0 : 1;
+
         // Empty
         std::cout << "Using These Parameters" << std::endl;
-        PrintOptions(namiOptions);
+        PrintOptions(job.options);
         std::cout << "----------" << std::endl;
 
-        // Allocation and Traversal
-        float min = FLT_MAX;
-        float max = -FLT_MAX;
-        std::vector<float> grdData(namiOptions.sizeX * 
-                                   namiOptions.sizeY);
-        for(int i = 0; i < grdData.size(); i++)
-        {
-            int x = i % namiOptions.sizeX;
-            int y = i / namiOptions.sizeX;
-
-            // Wave Segment
-            switch(namiOptions.type)
-            {
-                case NamiGenType::WAVE_CIRCULAR:
-                case NamiGenType::WAVE_HORIZONTAL:
-                case NamiGenType::WAVE_VERTICAL:
-                case NamiGenType::WAVE_EMPTY:
-                {
-                    grdData[i] = WaveSample(x, y, namiOptions);
-                    min = std::min(grdData[i], min);
-                    max = std::max(grdData[i], max);
-                    continue;
-                }
-            }
-            // Bathy Segment
-            // Wall
-            if(namiOptions.type == NamiGenType::DUHIS &&
-               y < namiOptions.wallWidth ||
-               y >= (namiOptions.sizeY - namiOptions.wallWidth))
-            {
-                grdData[i] = namiOptions.zLand;             
-            }
-            else if(namiOptions.type != NamiGenType::DUHIS &&
-                    (namiOptions.hasWalls &&
-                     (x < namiOptions.wallWidth ||
-                      x >= (namiOptions.sizeX - namiOptions.wallWidth) ||
-                      y < namiOptions.wallWidth ||
-                      y >= (namiOptions.sizeY - namiOptions.wallWidth))))
-            {
-                grdData[i] = namiOptions.zLand;
-            }
-            else
-            {
-                switch(namiOptions.type)
-                {
-                    case NamiGenType::CIRCULAR_LINEAR:
-                    case NamiGenType::CIRCULAR_SINUSODIAL:
-                    {
-                        grdData[i] = CircleSample(x, y, namiOptions);
-                        break;
-                    }
-                    case NamiGenType::LINEAR_L:
-                    case NamiGenType::LINEAR_R:
-                    case NamiGenType::LINEAR_T:
-                    case NamiGenType::LINEAR_B:
-                    case NamiGenType::SINUSODIAL_L:
-                    case NamiGenType::SINUSODIAL_R:
-                    case NamiGenType::SINUSODIAL_T:
-                    case NamiGenType::SINUSODIAL_B:
-                    {
-                        grdData[i] = SampleFlat(x, y, namiOptions);
-                        break;
-                    }
-                    case NamiGenType::DUHIS:
-                    {
-                        grdData[i] = SampleDuhis(x, y, namiOptions);
-                        break;
-                    }
-                }
-            }
-            min = std::min(grdData[i], min);
-            max = std::max(grdData[i], max);
-        }
+        if(!ValidateJob(job)) return 0;
 
-        // Generation Complete Now Write
-        if(namiOptions.output == NamiGenOut::GRD)
-        {
-            outputFileName += ".grd";
-            OutGRD(grdData.data(),
-                   namiOptions,
-                   min, max,
-                   outputFileName);
-        }
-        else
+        // Tiles are independent jobs, generated and written in parallel
+        if(job.tilesX * job.tilesY > 1)
         {
-            outputFileName += "_bin.grd";
-            OutGRDBin(grdData.data(),
-                      namiOptions,
-                      min, max,
-                      outputFileName);
+            std::vector<NamiGenJob> tiles;
+            if(!ExpandTiles(job, tiles)) return 0;
+            return RunBatch(tiles, ResolveThreadCount(job.options.threadCount)) ? 0 : 1;
         }
+
+        NamiThreadPool pool(ResolveThreadCount(job.options.threadCount));
+        NamiGridMemory grdData;
+        NamiStageTimes times = namiStageTimesEmpty;
+        if(!RunJob(job, pool, grdData, &times)) return 1;
+        if(job.profile) PrintProfile(job, times);
     }
     return 0;
-}  
\ No newline at end of file
+}
@@ -0,0 +1,313 @@
+#pragma once
+
+// Library interface of NamiGen
+// Grids are generated into caller owned memory and written to any
+// std::ostream or a user callback, no files or processes are involved
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <sstream>
+#include <ostream>
+#include <streambuf>
+#include <utility>
+#include <functional>
+#include <type_traits>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenWriters.h"
+#include "NamiGenTiff.h"
+#include "NamiGenPrecision.h"
+
+// Non owning view of contiguous memory (std::span is C++20)
+template<class T>
+class NamiSpan
+{
+    private:
+        T*                  ptr;
+        size_t              count;
+
+    public:
+        // Constructors & Destructor
+                            NamiSpan() : ptr(nullptr), count(0) {}
+                            NamiSpan(T* data, size_t size) : ptr(data), count(size) {}
+        // Only from element types that are "T" or less qualified
+        template<class U, class = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+                            NamiSpan(std::vector<U>& v) : ptr(v.data()), count(v.size()) {}
+        template<class U, class = std::enable_if_t<std::is_convertible<const U*, T*>::value>>
+                            NamiSpan(const std::vector<U>& v) : ptr(v.data()), count(v.size()) {}
+        template<class U, class = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+                            NamiSpan(const NamiSpan<U>& s) : ptr(s.data()), count(s.size()) {}
+
+        T*                  data() const { return ptr; }
+        size_t              size() const { return count; }
+        bool                empty() const { return count == 0; }
+};
+
+// Whole grid of the options
+inline static NamiRect NamiFullWindow(const NamiGenOptions& opts)
+{
+    return NamiRect{0, 0, opts.sizeX, opts.sizeY};
+}
+
+inline static bool NamiWindowValid(const NamiRect& window,
+                                   const NamiGenOptions& opts)
+{
+    return (window.x >= 0 && window.y >= 0 &&
+            window.width > 0 && window.height > 0 &&
+            window.width <= opts.sizeX - window.x &&
+            window.height <= opts.sizeY - window.y);
+}
+
+// Options describing "window" as a standalone grid, used by the writers
+// Size is the window size, lon/lat range is narrowed to the window cells
+// (x is lon, y is lat, node registered)
+// Generation should still use the full grid options
+inline static NamiGenOptions NamiWindowOptions(const NamiGenOptions& opts,
+                                               const NamiRect& window)
+{
+    NamiGenOptions result = opts;
+    if(window.x == 0 && window.y == 0 &&
+       window.width == opts.sizeX && window.height == opts.sizeY)
+        return result;
+
+    double lonStep = (opts.sizeX > 1) ? (opts.lonMax - opts.lonMin) / (opts.sizeX - 1) : 0.0;
+    double latStep = (opts.sizeY > 1) ? (opts.latMax - opts.latMin) / (opts.sizeY - 1) : 0.0;
+    result.lonMin = opts.lonMin + lonStep * window.x;
+    result.lonMax = opts.lonMin + lonStep * (window.x + window.width - 1);
+    result.latMin = opts.latMin + latStep * window.y;
+    result.latMax = opts.latMin + latStep * (window.y + window.height - 1);
+    result.sizeX = window.width;
+    result.sizeY = window.height;
+    return result;
+}
+
+// Checks "window" and an output of "size" elements, resolves the default stride
+inline static bool NamiOutputValid(const NamiGenOptions& opts, size_t size,
+                                   const NamiRect& window, size_t& stride)
+{
+    if(!NamiWindowValid(window, opts)) return false;
+    if(stride == 0) stride = static_cast<size_t>(window.width);
+    if(stride < static_cast<size_t>(window.width)) return false;
+
+    size_t required = (static_cast<size_t>(window.height) - 1) * stride + window.width;
+    return size >= required;
+}
+
+// Runs "func(pool)" on "pool" or on a pool created from opts.threadCount
+template<class Func>
+inline static NamiMinMax NamiRunOnPool(const NamiGenOptions& opts,
+                                       NamiThreadPool* pool, Func&& func)
+{
+    if(pool != nullptr) return func(*pool);
+    NamiThreadPool localPool(ResolveThreadCount(opts.threadCount));
+    return func(localPool);
+}
+
+// Generates "window" of the grid described by "opts" into "out"
+// "out" starts with the cell (window.x, window.y) and rows are "stride" floats
+// apart (0 is tightly packed, window.width), so a window can be written
+// directly into a larger array
+// "pool" is used if given, otherwise one is created from opts.threadCount
+// Returns false if the window or the buffer is invalid
+inline static bool NamiGenerate(const NamiGenOptions& opts,
+                                NamiSpan<float> out,
+                                const NamiRect& window,
+                                NamiMinMax& minMax,
+                                size_t stride = 0,
+                                NamiThreadPool* pool = nullptr)
+{
+    if(out.data() == nullptr || !NamiOutputValid(opts, out.size(), window, stride))
+        return false;
+    minMax = NamiRunOnPool(opts, pool, [&](NamiThreadPool& p)
+    {
+        return GenerateWindow(out.data(), stride, window, opts, p);
+    });
+    return true;
+}
+
+// Storage precision variants, min/max is of the values before conversion
+// Double precision, wave profiles are sampled in double
+inline static bool NamiGenerate(const NamiGenOptions& opts,
+                                NamiSpan<double> out,
+                                const NamiRect& window,
+                                NamiMinMax& minMax,
+                                size_t stride = 0,
+                                NamiThreadPool* pool = nullptr)
+{
+    if(out.data() == nullptr || !NamiOutputValid(opts, out.size(), window, stride))
+        return false;
+    minMax = NamiRunOnPool(opts, pool, [&](NamiThreadPool& p)
+    {
+        return GenerateWindowDouble(out.data(), stride, window, opts, p);
+    });
+    return true;
+}
+
+// IEEE binary16 values
+inline static bool NamiGenerateHalf(const NamiGenOptions& opts,
+                                    NamiSpan<uint16_t> out,
+                                    const NamiRect& window,
+                                    NamiMinMax& minMax,
+                                    size_t stride = 0,
+                                    NamiThreadPool* pool = nullptr)
+{
+    if(out.data() == nullptr || !NamiOutputValid(opts, out.size(), window, stride))
+        return false;
+    minMax = NamiRunOnPool(opts, pool, [&](NamiThreadPool& p)
+    {
+        return GenerateWindowStored(out.data(), stride, window, opts, p,
+                                    [](float v) { return FloatToHalf(v); });
+    });
+    return true;
+}
+
+// int16 values of "quantization" ("Q16Quantization" covers the profile range)
+inline static bool NamiGenerateQ16(const NamiGenOptions& opts,
+                                   NamiSpan<int16_t> out,
+                                   const NamiRect& window,
+                                   const NamiQuantization& quantization,
+                                   NamiMinMax& minMax,
+                                   size_t stride = 0,
+                                   NamiThreadPool* pool = nullptr)
+{
+    if(out.data() == nullptr || !NamiOutputValid(opts, out.size(), window, stride) ||
+       !(quantization.scale > 0.0))
+        return false;
+    minMax = NamiRunOnPool(opts, pool, [&](NamiThreadPool& p)
+    {
+        return GenerateWindowStored(out.data(), stride, window, opts, p,
+                                    [&](float v) { return QuantizeQ16(v, quantization); });
+    });
+    return true;
+}
+
+// Receives the output bytes in order, returns false to abort writing
+using NamiWriteCallback = std::function<bool(const char* data, size_t size)>;
+
+// Stream buffer that forwards writes to a callback
+// Not seekable
+class NamiCallbackStreamBuf : public std::streambuf
+{
+    private:
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+        NamiWriteCallback   callback;
+        std::vector<char>   buffer;
+
+        bool                Flush()
+        {
+            size_t size = static_cast<size_t>(pptr() - pbase());
+            setp(buffer.data(), buffer.data() + buffer.size());
+            return (size == 0) || callback(buffer.data(), size);
+        }
+
+    protected:
+        int_type            overflow(int_type c) override
+        {
+            if(!Flush()) return traits_type::eof();
+            if(traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+            return c;
+        }
+        int                 sync() override { return Flush() ? 0 : -1; }
+
+    public:
+        // Constructors & Destructor
+                            NamiCallbackStreamBuf(NamiWriteCallback cb)
+                                : callback(std::move(cb))
+                                , buffer(BUFFER_SIZE)
+                            {
+                                setp(buffer.data(), buffer.data() + buffer.size());
+                            }
+};
+
+// Writes the full grid "data" (sizeX * sizeY, row major) in opts.output format
+// "minMax" should be the value returned by "NamiGenerate"
+// Windows are written with "NamiWindowOptions"
+// TIFF output needs a seekable stream
+// Returns false on invalid input or stream failure
+inline static bool NamiWrite(std::ostream& out,
+                             NamiSpan<const float> data,
+                             const NamiGenOptions& opts,
+                             const NamiMinMax& minMax,
+                             NamiThreadPool* pool = nullptr)
+{
+    size_t cellCount = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    if(opts.sizeX <= 0 || opts.sizeY <= 0 ||
+       data.data() == nullptr || data.size() < cellCount) return false;
+
+    NamiThreadPool inlinePool(0);
+    NamiThreadPool& writePool = (pool != nullptr) ? *pool : inlinePool;
+    switch(opts.output)
+    {
+        case NamiGenOut::GRD:
+            return WriteGRD(out, data.data(), opts, minMax.min, minMax.max, writePool);
+        case NamiGenOut::GRD_BIN:
+            return WriteGRDBin(out, data.data(), opts, minMax.min, minMax.max);
+        case NamiGenOut::GRD_7:
+            return WriteGRD7(out, data.data(), opts, minMax.min, minMax.max);
+        case NamiGenOut::TIFF:
+            return WriteTiff(out, data.data(), opts, minMax.min, minMax.max,
+                             opts.compress == NamiGenCompress::PACKBITS, writePool);
+        default:
+            return false;
+    }
+}
+
+// Callback variant, TIFF output is assembled in memory first
+// since its header is written last
+inline static bool NamiWrite(const NamiWriteCallback& callback,
+                             NamiSpan<const float> data,
+                             const NamiGenOptions& opts,
+                             const NamiMinMax& minMax,
+                             NamiThreadPool* pool = nullptr)
+{
+    if(opts.output == NamiGenOut::TIFF)
+    {
+        std::stringstream memory(std::ios::in | std::ios::out | std::ios::binary);
+        if(!NamiWrite(memory, data, opts, minMax, pool)) return false;
+        std::string bytes = memory.str();
+        return callback(bytes.data(), bytes.size());
+    }
+
+    NamiCallbackStreamBuf buffer(callback);
+    std::ostream out(&buffer);
+    bool success = NamiWrite(out, data, opts, minMax, pool);
+    out.flush();
+    return success && static_cast<bool>(out);
+}
+
+// Writes the full grid "data" to "fileName" in opts.output format
+// Returns false on invalid input or if the file can not be written
+inline static bool NamiWriteFile(const std::string& fileName,
+                                 NamiSpan<const float> data,
+                                 const NamiGenOptions& opts,
+                                 const NamiMinMax& minMax,
+                                 NamiThreadPool& pool)
+{
+    size_t cellCount = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    if(opts.sizeX <= 0 || opts.sizeY <= 0 ||
+       data.data() == nullptr || data.size() < cellCount) return false;
+
+    switch(opts.output)
+    {
+        case NamiGenOut::GRD:
+            return OutGRD(data.data(), opts, minMax.min, minMax.max, fileName, pool);
+        case NamiGenOut::GRD_BIN:
+            return OutGRDBin(data.data(), opts, minMax.min, minMax.max, fileName);
+        case NamiGenOut::GRD_7:
+            return OutGRD7(data.data(), opts, minMax.min, minMax.max, fileName);
+        case NamiGenOut::TIFF:
+            return OutTiff(data.data(), opts, minMax.min, minMax.max,
+                           opts.compress == NamiGenCompress::PACKBITS,
+                           fileName, pool);
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+
+#include "NamiGenSimd.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+// Micro architecture of this executable, set by the build
+#ifndef NAMI_ARCH_NAME
+    #define NAMI_ARCH_NAME "generic"
+#endif
+
+// x86-64 micro architecture levels
+enum class NamiArchLevel
+{
+    BASELINE,
+    V2,
+    V3,
+    V4
+};
+
+inline static const char* ArchLevelToString(NamiArchLevel level)
+{
+    static const char* names[] = {"x86-64", "x86-64-v2", "x86-64-v3", "x86-64-v4"};
+    return names[static_cast<int>(level)];
+}
+
+inline static NamiArchLevel DetectArchLevel()
+{
+    #if !defined(NAMI_SIMD_X86)
+        return NamiArchLevel::BASELINE;
+    #elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool v2 = ((info[2] & (1 << 0)) &&      // SSE3
+                   (info[2] & (1 << 9)) &&      // SSSE3
+                   (info[2] & (1 << 19)) &&     // SSE4.1
+                   (info[2] & (1 << 20)) &&     // SSE4.2
+                   (info[2] & (1 << 23)));      // POPCNT
+        bool fma = (info[2] & (1 << 12)) != 0;
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        unsigned long long xcr0 = (osxsave) ? _xgetbv(0) : 0;
+        __cpuidex(info, 7, 0);
+        bool v3 = (v2 && fma && (xcr0 & 0x6) == 0x6 &&
+                   (info[1] & (1 << 3)) &&      // BMI1
+                   (info[1] & (1 << 5)) &&      // AVX2
+                   (info[1] & (1 << 8)));       // BMI2
+        bool v4 = (v3 && (xcr0 & 0xE6) == 0xE6 &&
+                   (info[1] & (1 << 16)) &&     // AVX512F
+                   (info[1] & (1 << 17)) &&     // AVX512DQ
+                   (info[1] & (1 << 28)) &&     // AVX512CD
+                   (info[1] & (1 << 30)) &&     // AVX512BW
+                   (info[1] & (1u << 31)));     // AVX512VL
+    #else
+        __builtin_cpu_init();
+        bool v2 = (__builtin_cpu_supports("sse3") &&
+                   __builtin_cpu_supports("ssse3") &&
+                   __builtin_cpu_supports("sse4.1") &&
+                   __builtin_cpu_supports("sse4.2") &&
+                   __builtin_cpu_supports("popcnt"));
+        bool v3 = (v2 &&
+                   __builtin_cpu_supports("avx2") &&
+                   __builtin_cpu_supports("fma") &&
+                   __builtin_cpu_supports("bmi") &&
+                   __builtin_cpu_supports("bmi2"));
+        bool v4 = (v3 &&
+                   __builtin_cpu_supports("avx512f") &&
+                   __builtin_cpu_supports("avx512dq") &&
+                   __builtin_cpu_supports("avx512cd") &&
+                   __builtin_cpu_supports("avx512bw") &&
+                   __builtin_cpu_supports("avx512vl"));
+    #endif
+    #if defined(NAMI_SIMD_X86)
+        if(v4) return NamiArchLevel::V4;
+        if(v3) return NamiArchLevel::V3;
+        if(v2) return NamiArchLevel::V2;
+        return NamiArchLevel::BASELINE;
+    #endif
+}
+
+// Path of the running executable
+inline static std::string ExecutablePath(const char* argv0)
+{
+    #if defined(_WIN32)
+        char path[MAX_PATH];
+        DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+        if(length > 0 && length < MAX_PATH) return std::string(path, length);
+    #elif defined(__linux__)
+        char path[4096];
+        ssize_t length = readlink("/proc/self/exe", path, sizeof(path));
+        if(length > 0 && length < static_cast<ssize_t>(sizeof(path)))
+            return std::string(path, length);
+    #endif
+    return argv0;
+}
+
+// Re-runs the process with the best "namigen-<arch>" executable that is
+// next to this one and the CPU supports
+// Returns the exit code of the variant, or -1 if no variant is run
+// (none found, unsupported or "NAMIGEN_NO_DISPATCH" is set)
+inline static int RunArchVariant(int argc, const char* argv[])
+{
+    if(std::getenv("NAMIGEN_NO_DISPATCH") != nullptr) return -1;
+
+    std::string self = ExecutablePath(argv[0]);
+    size_t slash = self.find_last_of("/\\");
+    std::string directory = (slash == std::string::npos) ? std::string() : self.substr(0, slash + 1);
+    #ifdef _WIN32
+        static const std::string extension = ".exe";
+    #else
+        static const std::string extension = "";
+    #endif
+
+    for(int level = static_cast<int>(DetectArchLevel());
+        level > static_cast<int>(NamiArchLevel::BASELINE); level--)
+    {
+        std::string variant = directory + "namigen-" +
+                              ArchLevelToString(static_cast<NamiArchLevel>(level)) +
+                              extension;
+        if(!std::ifstream(variant)) continue;
+
+        std::vector<const char*> args(argv, argv + argc);
+        args[0] = variant.c_str();
+        args.push_back(nullptr);
+        #ifdef _WIN32
+            _putenv_s("NAMIGEN_NO_DISPATCH", "1");
+            intptr_t result = _spawnv(_P_WAIT, variant.c_str(), args.data());
+            if(result >= 0) return static_cast<int>(result);
+        #else
+            setenv("NAMIGEN_NO_DISPATCH", "1", 1);
+            execv(variant.c_str(), const_cast<char* const*>(args.data()));
+        #endif
+        // Failed to run, try the next level
+    }
+    return -1;
+}
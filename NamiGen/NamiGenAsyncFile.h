@@ -0,0 +1,626 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <iostream>
+#include <streambuf>
+#include <algorithm>
+#include <condition_variable>
+
+#include "NamiGenOptions.h"
+#include "NamiGenTiming.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <malloc.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/uio.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+        #include <linux/io_uring.h>
+    #endif
+#endif
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+    #define NAMI_HAS_IO_URING
+#endif
+
+// Asynchronous sequential file output
+// Appended bytes are gathered into NAMI_ASYNC_CHUNK_SIZE aligned chunks,
+// full chunks are queued to the kernel (io_uring) or to writer threads
+// (pwrite) while the caller keeps producing the next ones
+// Only NAMI_ASYNC_CHUNK_COUNT chunks are in flight, appends block on
+// a free chunk so memory stays bounded
+// "direct" bypasses the page cache (O_DIRECT / FILE_FLAG_NO_BUFFERING),
+// the last chunk is padded to the alignment and the file is truncated
+// back to its size on Close
+// Header fields known only at the end are written with "Patch"
+constexpr size_t NAMI_ASYNC_CHUNK_SIZE = 4 * 1024 * 1024;
+constexpr int NAMI_ASYNC_CHUNK_COUNT = 8;
+constexpr size_t NAMI_ASYNC_ALIGNMENT = 4096;
+// pwrite backend threads
+constexpr int NAMI_ASYNC_WRITER_THREADS = 4;
+
+class NamiAsyncFile
+{
+    private:
+        struct Chunk
+        {
+            char*               data;
+            size_t              size;
+            size_t              done;
+            uint64_t            offset;
+            #ifndef _WIN32
+                struct iovec    iov;
+            #endif
+        };
+
+        struct PatchData
+        {
+            uint64_t            offset;
+            std::string         bytes;
+        };
+
+        std::string                 fileName;
+        NamiGenIO                   backend;
+        bool                        direct;
+        #ifdef _WIN32
+            HANDLE                  file;
+        #else
+            int                     fd;
+        #endif
+
+        std::vector<Chunk>          chunks;
+        int                         current;
+        uint64_t                    fileOffset;
+        std::vector<PatchData>      patches;
+        std::atomic<bool>           failed;
+        NamiTimer                   timer;
+        double                      seconds;
+
+        // Free chunks and the pwrite queue
+        std::mutex                  mutex;
+        std::condition_variable     condition;
+        std::vector<int>            freeChunks;
+        std::queue<int>             writeQueue;
+        std::vector<std::thread>    writers;
+        bool                        stop;
+
+        #ifdef NAMI_HAS_IO_URING
+            int                     ringFd;
+            void*                   sqRing;
+            void*                   cqRing;
+            size_t                  sqRingSize;
+            size_t                  cqRingSize;
+            struct io_uring_sqe*    sqes;
+            size_t                  sqesSize;
+            unsigned*               sqTail;
+            unsigned*               sqMask;
+            unsigned*               sqArray;
+            unsigned*               cqHead;
+            unsigned*               cqTail;
+            unsigned*               cqMask;
+            struct io_uring_cqe*    cqes;
+            int                     inFlight;
+
+            bool                    SetupRing();
+            void                    CloseRing();
+            void                    SubmitRing(int chunk);
+            bool                    ReapRing(bool wait);
+        #endif
+
+        bool                        OpenFile(bool unbuffered);
+        void                        CloseFile();
+        bool                        WriteAt(const char* data, size_t size, uint64_t offset);
+        void                        WriterThread();
+        int                         AcquireChunk();
+        void                        SubmitChunk(int chunk);
+
+    public:
+        // Constructors & Destructor
+                                    NamiAsyncFile();
+                                    NamiAsyncFile(const NamiAsyncFile&) = delete;
+        NamiAsyncFile&              operator=(const NamiAsyncFile&) = delete;
+                                    ~NamiAsyncFile();
+
+        // "io" URING falls back to PWRITE if the ring can not be created,
+        // "direct" falls back to cached writes if the file system refuses it
+        bool                        Open(const std::string& fileName,
+                                         NamiGenIO io, bool direct);
+        bool                        Append(const char* data, size_t size);
+        // Written over the appended bytes after the last chunk
+        void                        Patch(uint64_t offset, const char* data, size_t size);
+        // Waits for every queued chunk, returns false if any write failed
+        bool                        Close();
+
+        // Resolved backend and direct state, valid after Open
+        NamiGenIO                   Backend() const { return backend; }
+        bool                        Direct() const { return direct; }
+        uint64_t                    Size() const { return fileOffset; }
+        // Open to Close wall time
+        double                      Seconds() const { return seconds; }
+};
+
+// std::ostream adapter, lets the ostream writers target an async file
+class NamiAsyncStreamBuf : public std::streambuf
+{
+    private:
+        NamiAsyncFile&      file;
+
+    protected:
+        std::streamsize     xsputn(const char* s, std::streamsize n) override
+        {
+            return file.Append(s, static_cast<size_t>(n)) ? n : 0;
+        }
+        int_type            overflow(int_type c) override
+        {
+            if(traits_type::eq_int_type(c, traits_type::eof()))
+                return traits_type::not_eof(c);
+            char ch = traits_type::to_char_type(c);
+            return file.Append(&ch, 1) ? c : traits_type::eof();
+        }
+
+    public:
+        // Constructors & Destructor
+                            NamiAsyncStreamBuf(NamiAsyncFile& f) : file(f) {}
+};
+
+inline static std::string AsyncReport(const NamiAsyncFile& file)
+{
+    double megaBytes = static_cast<double>(file.Size()) / (1024.0 * 1024.0);
+    std::string result = GenIOToString(file.Backend());
+    if(file.Direct()) result += " direct";
+    result += "\t" + std::to_string(file.Seconds()) + "s\t" +
+              std::to_string(megaBytes / std::max(file.Seconds(), 1e-9)) + " MB/s";
+    return result;
+}
+
+inline NamiAsyncFile::NamiAsyncFile()
+    : backend(NamiGenIO::INVALID)
+    , direct(false)
+    #ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE)
+    #else
+        , fd(-1)
+    #endif
+    , current(-1)
+    , fileOffset(0)
+    , failed(false)
+    , seconds(0.0)
+    , stop(false)
+    #ifdef NAMI_HAS_IO_URING
+        , ringFd(-1)
+        , sqRing(nullptr)
+        , cqRing(nullptr)
+        , sqRingSize(0)
+        , cqRingSize(0)
+        , sqes(nullptr)
+        , sqesSize(0)
+        , inFlight(0)
+    #endif
+{}
+
+inline NamiAsyncFile::~NamiAsyncFile()
+{
+    Close();
+}
+
+inline bool NamiAsyncFile::OpenFile(bool unbuffered)
+{
+    #ifdef _WIN32
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if(unbuffered) flags |= FILE_FLAG_NO_BUFFERING;
+        file = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, nullptr,
+                           CREATE_ALWAYS, flags, nullptr);
+        return file != INVALID_HANDLE_VALUE;
+    #else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+        #ifdef O_DIRECT
+            if(unbuffered) flags |= O_DIRECT;
+        #endif
+        fd = open(fileName.c_str(), flags, 0644);
+        if(fd < 0) return false;
+        #if !defined(O_DIRECT) && defined(F_NOCACHE)
+            if(unbuffered && fcntl(fd, F_NOCACHE, 1) != 0) { CloseFile(); return false; }
+        #elif !defined(O_DIRECT)
+            if(unbuffered) { CloseFile(); return false; }
+        #endif
+        return true;
+    #endif
+}
+
+inline void NamiAsyncFile::CloseFile()
+{
+    #ifdef _WIN32
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        file = INVALID_HANDLE_VALUE;
+    #else
+        if(fd >= 0) close(fd);
+        fd = -1;
+    #endif
+}
+
+inline bool NamiAsyncFile::WriteAt(const char* data, size_t size, uint64_t offset)
+{
+    while(size > 0)
+    {
+        #ifdef _WIN32
+            OVERLAPPED overlapped = {};
+            overlapped.Offset = static_cast<DWORD>(offset);
+            overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD request = static_cast<DWORD>(std::min<size_t>(size, 1u << 30));
+            DWORD written = 0;
+            if(!WriteFile(file, data, request, &written, &overlapped) || written == 0)
+                return false;
+        #else
+            ssize_t written = pwrite(fd, data, size, static_cast<off_t>(offset));
+            if(written < 0 && errno == EINTR) continue;
+            if(written <= 0) return false;
+        #endif
+        data += written;
+        size -= static_cast<size_t>(written);
+        offset += static_cast<uint64_t>(written);
+    }
+    return true;
+}
+
+inline void NamiAsyncFile::WriterThread()
+{
+    while(true)
+    {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return stop || !writeQueue.empty(); });
+            if(writeQueue.empty()) return;
+            index = writeQueue.front();
+            writeQueue.pop();
+        }
+        Chunk& c = chunks[index];
+        if(!WriteAt(c.data, c.size, c.offset)) failed = true;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            freeChunks.push_back(index);
+        }
+        condition.notify_all();
+    }
+}
+
+#ifdef NAMI_HAS_IO_URING
+
+inline bool NamiAsyncFile::SetupRing()
+{
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    long result = syscall(__NR_io_uring_setup, NAMI_ASYNC_CHUNK_COUNT, &params);
+    if(result < 0) return false;
+    ringFd = static_cast<int>(result);
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(singleMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if(sqRing == MAP_FAILED) { sqRing = nullptr; CloseRing(); return false; }
+    if(singleMap) cqRing = sqRing;
+    else
+    {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if(cqRing == MAP_FAILED) { cqRing = nullptr; CloseRing(); return false; }
+    }
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqeMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if(sqeMap == MAP_FAILED) { CloseRing(); return false; }
+    sqes = static_cast<struct io_uring_sqe*>(sqeMap);
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+inline void NamiAsyncFile::CloseRing()
+{
+    if(sqes) munmap(sqes, sqesSize);
+    if(cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if(sqRing) munmap(sqRing, sqRingSize);
+    if(ringFd >= 0) close(ringFd);
+    sqes = nullptr;
+    sqRing = cqRing = nullptr;
+    ringFd = -1;
+}
+
+// Writes the remaining bytes of "chunk", a short write is resubmitted
+// on its completion
+inline void NamiAsyncFile::SubmitRing(int chunk)
+{
+    Chunk& c = chunks[chunk];
+    c.iov.iov_base = c.data + c.done;
+    c.iov.iov_len = c.size - c.done;
+
+    // Only this thread submits, ring never holds more than the chunk count
+    unsigned tail = *sqTail;
+    unsigned index = tail & *sqMask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&c.iov);
+    sqe->len = 1;
+    sqe->off = c.offset + c.done;
+    sqe->user_data = static_cast<uint64_t>(chunk);
+    sqArray[index] = index;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    long result;
+    do result = syscall(__NR_io_uring_enter, ringFd, 1, 0, 0, nullptr, 0);
+    while(result < 0 && errno == EINTR);
+    if(result < 0)
+    {
+        failed = true;
+        freeChunks.push_back(chunk);
+        return;
+    }
+    inFlight++;
+}
+
+// Returns false if the ring can not be waited on
+inline bool NamiAsyncFile::ReapRing(bool wait)
+{
+    if(wait)
+    {
+        long result;
+        do result = syscall(__NR_io_uring_enter, ringFd, 0, 1,
+                            IORING_ENTER_GETEVENTS, nullptr, 0);
+        while(result < 0 && errno == EINTR);
+        if(result < 0) { failed = true; return false; }
+    }
+
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    std::vector<int> resubmit;
+    for(; head != tail; head++)
+    {
+        const struct io_uring_cqe& cqe = cqes[head & *cqMask];
+        int chunk = static_cast<int>(cqe.user_data);
+        Chunk& c = chunks[chunk];
+        inFlight--;
+        if(cqe.res <= 0)
+        {
+            failed = true;
+            freeChunks.push_back(chunk);
+            continue;
+        }
+        c.done += static_cast<size_t>(cqe.res);
+        if(c.done < c.size) resubmit.push_back(chunk);
+        else freeChunks.push_back(chunk);
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    for(int chunk : resubmit) SubmitRing(chunk);
+    return true;
+}
+
+#endif
+
+inline bool NamiAsyncFile::Open(const std::string& name, NamiGenIO io, bool unbuffered)
+{
+    Close();
+    fileName = name;
+    direct = unbuffered;
+    if(!OpenFile(direct))
+    {
+        if(!direct) return false;
+        std::cout << "Write\t: direct i/o refused, using cached writes" << std::endl;
+        direct = false;
+        if(!OpenFile(false)) return false;
+    }
+
+    chunks.resize(NAMI_ASYNC_CHUNK_COUNT);
+    for(int i = 0; i < NAMI_ASYNC_CHUNK_COUNT; i++)
+    {
+        #ifdef _WIN32
+            void* ptr = _aligned_malloc(NAMI_ASYNC_CHUNK_SIZE, NAMI_ASYNC_ALIGNMENT);
+        #else
+            void* ptr = nullptr;
+            if(posix_memalign(&ptr, NAMI_ASYNC_ALIGNMENT, NAMI_ASYNC_CHUNK_SIZE) != 0)
+                ptr = nullptr;
+        #endif
+        chunks[i].data = static_cast<char*>(ptr);
+        if(ptr == nullptr) { Close(); return false; }
+        freeChunks.push_back(i);
+    }
+
+    backend = NamiGenIO::PWRITE;
+    #ifdef NAMI_HAS_IO_URING
+        if(io == NamiGenIO::URING && SetupRing()) backend = NamiGenIO::URING;
+    #else
+        (void)io;
+    #endif
+    if(backend == NamiGenIO::PWRITE)
+    {
+        for(int i = 0; i < NAMI_ASYNC_WRITER_THREADS; i++)
+            writers.emplace_back(&NamiAsyncFile::WriterThread, this);
+    }
+    fileOffset = 0;
+    current = -1;
+    failed = false;
+    timer.Restart();
+    return true;
+}
+
+inline int NamiAsyncFile::AcquireChunk()
+{
+    #ifdef NAMI_HAS_IO_URING
+        if(backend == NamiGenIO::URING)
+        {
+            ReapRing(false);
+            while(freeChunks.empty() && ReapRing(true));
+            if(freeChunks.empty()) return -1;
+            int chunk = freeChunks.back();
+            freeChunks.pop_back();
+            return chunk;
+        }
+    #endif
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return !freeChunks.empty(); });
+    int chunk = freeChunks.back();
+    freeChunks.pop_back();
+    return chunk;
+}
+
+inline void NamiAsyncFile::SubmitChunk(int chunk)
+{
+    Chunk& c = chunks[chunk];
+    c.offset = fileOffset;
+    c.done = 0;
+    fileOffset += c.size;
+    // Only the last chunk is partial, direct writes need the aligned size
+    if(direct)
+    {
+        size_t aligned = (c.size + NAMI_ASYNC_ALIGNMENT - 1) / NAMI_ASYNC_ALIGNMENT * NAMI_ASYNC_ALIGNMENT;
+        std::memset(c.data + c.size, 0, aligned - c.size);
+        c.size = aligned;
+    }
+
+    #ifdef NAMI_HAS_IO_URING
+        if(backend == NamiGenIO::URING)
+        {
+            SubmitRing(chunk);
+            return;
+        }
+    #endif
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        writeQueue.push(chunk);
+    }
+    condition.notify_all();
+}
+
+inline bool NamiAsyncFile::Append(const char* data, size_t size)
+{
+    while(size > 0)
+    {
+        if(failed) return false;
+        if(current < 0)
+        {
+            current = AcquireChunk();
+            if(current < 0) return false;
+            chunks[current].size = 0;
+        }
+        Chunk& c = chunks[current];
+        size_t count = std::min(size, NAMI_ASYNC_CHUNK_SIZE - c.size);
+        std::memcpy(c.data + c.size, data, count);
+        c.size += count;
+        data += count;
+        size -= count;
+        if(c.size == NAMI_ASYNC_CHUNK_SIZE)
+        {
+            SubmitChunk(current);
+            current = -1;
+        }
+    }
+    return !failed;
+}
+
+inline void NamiAsyncFile::Patch(uint64_t offset, const char* data, size_t size)
+{
+    patches.push_back(PatchData{offset, std::string(data, size)});
+}
+
+inline bool NamiAsyncFile::Close()
+{
+    if(chunks.empty())
+    {
+        CloseFile();
+        return false;
+    }
+
+    uint64_t alignedEnd = fileOffset;
+    if(current >= 0 && chunks[current].size > 0)
+    {
+        SubmitChunk(current);
+        alignedEnd = chunks[current].offset + chunks[current].size;
+    }
+    current = -1;
+
+    // Drain
+    #ifdef NAMI_HAS_IO_URING
+        if(backend == NamiGenIO::URING)
+        {
+            while(inFlight > 0 && ReapRing(true));
+            CloseRing();
+        }
+    #endif
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    for(std::thread& t : writers) t.join();
+    writers.clear();
+    stop = false;
+    CloseFile();
+
+    // Padding and the patches go through a cached handle
+    bool success = !failed;
+    if(success && (alignedEnd != fileOffset || !patches.empty()))
+    {
+        #ifdef _WIN32
+            file = CreateFileA(fileName.c_str(), GENERIC_WRITE, 0, nullptr,
+                               OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            success = (file != INVALID_HANDLE_VALUE);
+            LARGE_INTEGER size;
+            size.QuadPart = static_cast<LONGLONG>(fileOffset);
+            success = success && SetFilePointerEx(file, size, nullptr, FILE_BEGIN) &&
+                      SetEndOfFile(file);
+        #else
+            fd = open(fileName.c_str(), O_WRONLY);
+            success = (fd >= 0) && ftruncate(fd, static_cast<off_t>(fileOffset)) == 0;
+        #endif
+        for(const PatchData& p : patches)
+            success = success && WriteAt(p.bytes.data(), p.bytes.size(), p.offset);
+        CloseFile();
+    }
+    patches.clear();
+
+    for(Chunk& c : chunks)
+    {
+        #ifdef _WIN32
+            _aligned_free(c.data);
+        #else
+            free(c.data);
+        #endif
+    }
+    chunks.clear();
+    freeChunks.clear();
+    writeQueue = std::queue<int>();
+    seconds = timer.Elapsed();
+    return success;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenTiming.h"
+#include "NamiGenJob.h"
+
+// Batch file, one job per line written as command line switches
+// on top of the command line options
+// '#' starts a comment, empty lines are skipped
+// Values can be swept, every combination of the swept values
+// of a line becomes a job
+//      a,b,c           : list of values
+//      start:end:step  : inclusive numeric range
+// Swept or unnamed jobs get "_<index>" appended to their name
+
+// Returns false if the token looks like a range but is not a valid one
+inline static bool ExpandSweepToken(const std::string& token,
+                                    std::vector<std::string>& values)
+{
+    values.clear();
+    if(token.find(',') != std::string::npos)
+    {
+        std::istringstream stream(token);
+        std::string value;
+        while(std::getline(stream, value, ','))
+            if(!value.empty()) values.push_back(value);
+        return !values.empty();
+    }
+
+    std::vector<std::string> parts;
+    std::istringstream stream(token);
+    std::string part;
+    while(std::getline(stream, part, ':'))
+        parts.push_back(part);
+
+    double range[3];
+    bool numeric = (parts.size() == 3);
+    for(size_t i = 0; numeric && i < 3; i++)
+    {
+        size_t end = 0;
+        try { range[i] = std::stod(parts[i], &end); }
+        catch(...) { numeric = false; }
+        numeric = numeric && (end == parts[i].size());
+    }
+    // Tokens without a ':' (and paths such as "C:/out") are used as is,
+    // anything else with a ':' has to be a complete range
+    if(!numeric)
+    {
+        size_t colon = token.find(':');
+        bool path = (colon != std::string::npos && colon + 1 < token.size() &&
+                     (token[colon + 1] == '/' || token[colon + 1] == '\\'));
+        if(colon != std::string::npos && !path) return false;
+        values.push_back(token);
+        return true;
+    }
+
+    double span = (range[1] - range[0]) / range[2];
+    if(range[2] == 0.0 || span < 0.0) return false;
+    // Integer ranges stay integers (sizes, gaps)
+    bool integer = (token.find_first_of(".eE") == std::string::npos);
+    int count = static_cast<int>(std::floor(span + 1e-9)) + 1;
+    for(int i = 0; i < count; i++)
+    {
+        double value = range[0] + i * range[2];
+        if(integer)
+        {
+            values.push_back(std::to_string(static_cast<long long>(std::llround(value))));
+        }
+        else
+        {
+            std::ostringstream out;
+            out.precision(17);
+            out << value;
+            values.push_back(out.str());
+        }
+    }
+    return true;
+}
+
+// Splits the job window into tilesX * tilesY jobs, one file per tile
+// Files are named "<name>_<column>_<row>", tiles differ by at most a cell
+// Appends to "jobs", returns false if a tile is invalid
+inline static bool ExpandTiles(const NamiGenJob& job,
+                               std::vector<NamiGenJob>& jobs)
+{
+    NamiRect region = JobWindow(job);
+    for(int ty = 0; ty < job.tilesY; ty++)
+    {
+        int y0 = region.y + static_cast<int>(static_cast<int64_t>(region.height) * ty / job.tilesY);
+        int y1 = region.y + static_cast<int>(static_cast<int64_t>(region.height) * (ty + 1) / job.tilesY);
+        for(int tx = 0; tx < job.tilesX; tx++)
+        {
+            int x0 = region.x + static_cast<int>(static_cast<int64_t>(region.width) * tx / job.tilesX);
+            int x1 = region.x + static_cast<int>(static_cast<int64_t>(region.width) * (tx + 1) / job.tilesX);
+
+            NamiGenJob tile = job;
+            tile.window = NamiRect{x0, y0, x1 - x0, y1 - y0};
+            tile.tilesX = 1;
+            tile.tilesY = 1;
+            tile.outputFileName += "_" + std::to_string(tx) + "_" + std::to_string(ty);
+            if(!ValidateJob(tile)) return false;
+            jobs.push_back(tile);
+        }
+    }
+    return true;
+}
+
+inline static bool LoadBatch(const std::string& fileName,
+                             const NamiGenJob& baseJob,
+                             std::vector<NamiGenJob>& jobs)
+{
+    std::ifstream file(fileName);
+    if(!file)
+    {
+        std::cout << "Unable to open batch file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNo = 0;
+    while(std::getline(file, line))
+    {
+        lineNo++;
+        line = line.substr(0, line.find('#'));
+
+        std::vector<std::vector<std::string>> tokens;
+        std::istringstream lineStream(line);
+        std::string token;
+        bool named = false;
+        while(lineStream >> token)
+        {
+            named |= (token == switches[9]);
+            tokens.emplace_back();
+            if(!ExpandSweepToken(token, tokens.back()))
+            {
+                std::cout << "Batch line " << lineNo << ": invalid range \""
+                          << token << "\"" << std::endl;
+                return false;
+            }
+        }
+        if(tokens.empty()) continue;
+
+        size_t comboCount = 1;
+        for(const std::vector<std::string>& t : tokens)
+            comboCount *= t.size();
+
+        // Cartesian product, last token changes fastest
+        std::vector<std::string> args(tokens.size());
+        for(size_t combo = 0; combo < comboCount; combo++)
+        {
+            size_t remaining = combo;
+            for(size_t i = tokens.size(); i-- > 0;)
+            {
+                args[i] = tokens[i][remaining % tokens[i].size()];
+                remaining /= tokens[i].size();
+            }
+
+            NamiGenJob job = baseJob;
+            job.batchFile.clear();
+            if(!ParseArgs(args, job))
+            {
+                std::cout << "Batch line " << lineNo << ": invalid args" << std::endl;
+                return false;
+            }
+            if(!job.batchFile.empty())
+            {
+                std::cout << "Batch line " << lineNo << ": nested batch" << std::endl;
+                return false;
+            }
+            if(!ValidateJob(job))
+            {
+                std::cout << "Batch line " << lineNo << ": invalid job" << std::endl;
+                return false;
+            }
+            if(!named)
+                job.outputFileName += "_" + std::to_string(jobs.size());
+            else if(comboCount > 1)
+                job.outputFileName += "_" + std::to_string(combo);
+            if(job.tilesX * job.tilesY > 1)
+            {
+                if(!ExpandTiles(job, jobs))
+                {
+                    std::cout << "Batch line " << lineNo << ": invalid tile" << std::endl;
+                    return false;
+                }
+            }
+            else jobs.push_back(job);
+        }
+    }
+    return true;
+}
+
+// Jobs are distributed over a work stealing pool, each job runs
+// single threaded and workers reuse their grid buffer between jobs
+// If there are fewer jobs than threads, jobs run one after another
+// on the whole pool instead
+inline static bool RunBatch(const std::vector<NamiGenJob>& jobs,
+                            unsigned int threadCount)
+{
+    NamiTimer timer;
+    std::vector<char> results(jobs.size(), 0);
+
+    if(jobs.size() < threadCount)
+    {
+        NamiThreadPool pool(threadCount);
+        NamiGridMemory grdData;
+        for(size_t i = 0; i < jobs.size(); i++)
+            results[i] = RunJob(jobs[i], pool, grdData);
+    }
+    else
+    {
+        NamiStealingPool pool(threadCount);
+        std::vector<NamiGridMemory> buffers(pool.ThreadCount());
+        // Zero thread pool, nested work runs on the calling worker
+        NamiThreadPool inlinePool(0);
+        pool.Run(static_cast<int>(jobs.size()), [&](int job, unsigned int worker)
+        {
+            results[job] = RunJob(jobs[job], inlinePool, buffers[worker]);
+        });
+    }
+
+    double seconds = timer.Elapsed();
+    size_t failed = std::count(results.begin(), results.end(), 0);
+    std::cout << "Batch\t: " << (jobs.size() - failed) << "/" << jobs.size()
+              << " jobs in " << seconds << "s" << std::endl;
+    return failed == 0;
+}
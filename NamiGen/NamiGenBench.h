@@ -0,0 +1,108 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#include "NamiGenOptions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenWriters.h"
+#include "NamiGenTiming.h"
+#include "NamiGenJob.h"
+
+// Smallest benchmark grid size
+constexpr int NAMI_BENCH_MIN_SIZE = 256;
+
+// Square sizes from NAMI_BENCH_MIN_SIZE doubling up to "maxSize"
+// ("maxSize" itself is always the last one)
+inline static std::vector<int> BenchSizes(int maxSize)
+{
+    std::vector<int> sizes;
+    for(int size = NAMI_BENCH_MIN_SIZE; size < maxSize; size *= 2)
+        sizes.push_back(size);
+    sizes.push_back(maxSize);
+    return sizes;
+}
+
+// Runs every generation type with the ascii and binary writers
+// over the benchmark sizes, rest of the options are taken from "baseJob"
+// One tab separated line per stage of a run (generate and write, or a single
+// combined stream stage), MB/s are relative to the output file size
+// Options "ValidateJob" rejects stop the sweep before anything is run
+inline static bool RunBenchmark(const NamiGenJob& baseJob)
+{
+    static const std::string BENCH_FILE_NAME = "namigen_bench";
+    static const NamiGenOut outputs[] = {NamiGenOut::GRD, NamiGenOut::GRD_BIN};
+
+    NamiThreadPool pool(ResolveThreadCount(baseJob.options.threadCount));
+    NamiGridMemory grdData;
+    bool success = true;
+
+    std::cout << "Bench\t: type\tsize\tout\tstage\ts\tMcells/s\tMB/s" << std::endl;
+    for(int size : BenchSizes(baseJob.benchSize))
+    {
+        for(NamiGenOut output : outputs)
+        {
+            for(int t = static_cast<int>(NamiGenType::CIRCULAR_SINUSODIAL);
+                t <= static_cast<int>(NamiGenType::WAVE_EMPTY); t++)
+            {
+                NamiGenJob job = baseJob;
+                job.options.type = static_cast<NamiGenType>(t);
+                job.options.output = output;
+                job.options.sizeX = size;
+                job.options.sizeY = size;
+                job.outputFileName = BENCH_FILE_NAME;
+                job.verify = false;
+                // Cache hits would time the links
+                job.cacheDir.clear();
+
+                std::string prefix = "Bench\t: " + GenTypeToString(job.options.type) + "\t" +
+                                     std::to_string(size) + "\t" + GenOutToString(output) + "\t";
+                if(output == NamiGenOut::GRD_BIN && !GRDBinSizeValid(job.options))
+                {
+                    std::cout << prefix << "skipped (binary grd limit)" << std::endl;
+                    continue;
+                }
+                if(!ValidateJob(job))
+                {
+                    std::cout << prefix << "invalid options" << std::endl;
+                    return false;
+                }
+
+                NamiStageTimes times = namiStageTimesEmpty;
+                std::string fileName = job.outputFileName + OutputExtension(output);
+                if(!RunJob(job, pool, grdData, &times))
+                {
+                    std::cout << prefix << "failed" << std::endl;
+                    success = false;
+                    continue;
+                }
+                double cells = static_cast<double>(size) * size;
+                double fileMB = static_cast<double>(FileSize(fileName)) / (1024.0 * 1024.0);
+                std::remove(fileName.c_str());
+
+                auto stage = [&](const char* stageName, double seconds)
+                {
+                    std::cout << prefix << stageName << "\t" << seconds << "\t"
+                              << (cells / seconds * 1e-6) << "\t"
+                              << (fileMB / seconds) << std::endl;
+                };
+                // Streamed runs generate and write in one pass
+                if(job.stream)
+                {
+                    stage("stream", times.stream);
+                }
+                else
+                {
+                    stage("generate", times.generate);
+                    stage("write", times.write);
+                }
+            }
+        }
+    }
+    std::cout << "Bench\t: Peak RSS "
+              << (static_cast<double>(PeakRSSBytes()) / (1024.0 * 1024.0))
+              << " MB" << std::endl;
+    return success;
+}
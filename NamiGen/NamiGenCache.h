@@ -0,0 +1,281 @@
+#pragma once
+
+// Content addressed output cache
+// Outputs of a job are stored under the hash of everything that changes
+// their values (value key), headers also depend on the lat/lon range
+// (header key)
+//      same header key     : outputs are linked to the cached files
+//      same value key      : cached files are copied and the headers are patched
+//                            (grd, grdbin, grd7; tiff is regenerated)
+// Cached files are read only, links are reflinks if the file system
+// supports them, hard links otherwise (rerun with the cache or remove
+// the outputs before writing them without it)
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <filesystem>
+#include <system_error>
+
+#ifdef __linux__
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <linux/fs.h>
+#endif
+
+#include "NamiGenOptions.h"
+#include "NamiGenWriters.h"
+
+// Bumped when generated values or file layouts change
+constexpr const char* NAMI_GEN_VERSION = "1.3";
+
+// Geometry (lat/lon) part of the binary headers, see "GRDBinHeader" and "GRD7Header"
+constexpr size_t NAMI_GRD_BIN_GEOMETRY_OFFSET = 4 + 2 * sizeof(int16_t);
+constexpr size_t NAMI_GRD_BIN_GEOMETRY_SIZE = 4 * sizeof(double);
+constexpr size_t NAMI_GRD7_GEOMETRY_OFFSET = 3 * sizeof(int32_t) + 4 * sizeof(int32_t);
+constexpr size_t NAMI_GRD7_GEOMETRY_SIZE = 4 * sizeof(double);
+
+// Canonical "name=value;" text of the key fields, hashed with FNV-1a
+class NamiCacheKey
+{
+    private:
+        std::ostringstream  text;
+
+    public:
+        // Constructors & Destructor
+                            NamiCacheKey() { text.precision(17); }
+
+        template<class T>
+        NamiCacheKey&       Add(const char* name, const T& value)
+        {
+            text << name << '=' << value << ';';
+            return *this;
+        }
+
+        std::string         Text() const { return text.str(); }
+        std::string         Hex() const
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for(char c : text.str())
+            {
+                hash ^= static_cast<unsigned char>(c);
+                hash *= 0x100000001b3ull;
+            }
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+            return hex;
+        }
+};
+
+// Output file of a job and the options its header is written with
+struct NamiCacheFile
+{
+    std::string     fileName;
+    NamiGenOptions  headerOptions;
+};
+
+enum class NamiCacheResult
+{
+    MISS,
+    HIT,
+    PATCHED
+};
+
+// Copy on write clone of "src", false if the file system can not share extents
+inline static bool ReflinkFile(const std::string& src, const std::string& dst)
+{
+    #if defined(__linux__) && defined(FICLONE)
+        int srcFd = open(src.c_str(), O_RDONLY);
+        if(srcFd < 0) return false;
+        int dstFd = open(dst.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        bool success = (dstFd >= 0) && (ioctl(dstFd, FICLONE, srcFd) == 0);
+        if(dstFd >= 0) close(dstFd);
+        close(srcFd);
+        if(!success && dstFd >= 0) std::remove(dst.c_str());
+        return success;
+    #else
+        (void)src; (void)dst;
+        return false;
+    #endif
+}
+
+// Independent copy of "src", reflinked if possible
+inline static bool CloneFile(const std::string& src, const std::string& dst)
+{
+    std::error_code error;
+    std::filesystem::remove(dst, error);
+    if(ReflinkFile(src, dst)) return true;
+    return std::filesystem::copy_file(src, dst, error);
+}
+
+// "dst" refers to the read only "src", reflink, hard link or copy
+inline static bool LinkFile(const std::string& src, const std::string& dst)
+{
+    std::error_code error;
+    std::filesystem::remove(dst, error);
+    if(ReflinkFile(src, dst)) return true;
+    std::filesystem::create_hard_link(src, dst, error);
+    if(!error) return true;
+    return CloneFile(src, dst);
+}
+
+// Writes "src" to "dst" with the lat/lon range of "opts" in the header
+// Returns false for formats that can not be patched (tiff)
+inline static bool CopyPatched(const std::string& src, const std::string& dst,
+                               const NamiGenOptions& opts)
+{
+    switch(opts.output)
+    {
+        case NamiGenOut::GRD:
+        {
+            // Header lines change length, values are copied after the new header
+            std::ifstream in(src, std::ifstream::binary);
+            std::string minMaxLine;
+            for(int i = 0; i < NAMI_GRD_HEADER_LINES; i++)
+                std::getline(in, minMaxLine);
+            if(!in) return false;
+
+            std::string header = GRDHeader(opts, 0.0, 0.0);
+            header.erase(header.rfind('\n', header.size() - 2) + 1);
+            std::error_code error;
+            std::filesystem::remove(dst, error);
+            std::ofstream out(dst, std::ofstream::binary);
+            out << header << minMaxLine << "\n";
+            out << in.rdbuf();
+            return static_cast<bool>(out);
+        }
+        case NamiGenOut::GRD_BIN:
+        case NamiGenOut::GRD_7:
+        {
+            // Fixed size headers, only the geometry bytes are rewritten
+            if(!CloneFile(src, dst)) return false;
+            std::vector<char> header;
+            size_t offset, size;
+            if(opts.output == NamiGenOut::GRD_BIN)
+            {
+                header.resize(NAMI_GRD_BIN_HEADER_SIZE);
+                GRDBinHeader(header.data(), opts, 0.0, 0.0);
+                offset = NAMI_GRD_BIN_GEOMETRY_OFFSET;
+                size = NAMI_GRD_BIN_GEOMETRY_SIZE;
+            }
+            else
+            {
+                header.resize(NAMI_GRD7_HEADER_SIZE);
+                GRD7Header(header.data(), opts, 0.0, 0.0);
+                offset = NAMI_GRD7_GEOMETRY_OFFSET;
+                size = NAMI_GRD7_GEOMETRY_SIZE;
+            }
+            std::filesystem::permissions(dst, std::filesystem::perms::owner_write,
+                                         std::filesystem::perm_options::add);
+            std::fstream out(dst, std::fstream::binary | std::fstream::in | std::fstream::out);
+            out.seekp(static_cast<std::streamoff>(offset));
+            out.write(header.data() + offset, static_cast<std::streamsize>(size));
+            return static_cast<bool>(out);
+        }
+        default:
+            return false;
+    }
+}
+
+inline static std::string CacheEntryName(const std::string& cacheDir,
+                                         const NamiCacheKey& valueKey)
+{
+    return (std::filesystem::path(cacheDir) / valueKey.Hex()).string();
+}
+
+// Size and modification time of a cached file, a write through a hard
+// link (root ignores the read only bit) changes the stamp
+inline static std::string CacheStamp(const std::string& fileName)
+{
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(fileName, error);
+    if(error) return "";
+    auto time = std::filesystem::last_write_time(fileName, error);
+    if(error) return "";
+    return std::to_string(size) + ":" +
+           std::to_string(static_cast<long long>(time.time_since_epoch().count()));
+}
+
+// Entry file: header key hash, file count, stamps of the cached files
+// and the value key text
+inline static NamiCacheResult CacheLookup(const std::string& cacheDir,
+                                          const NamiCacheKey& valueKey,
+                                          const NamiCacheKey& headerKey,
+                                          const std::vector<NamiCacheFile>& files)
+{
+    std::string entry = CacheEntryName(cacheDir, valueKey);
+    std::ifstream keyFile(entry + ".key");
+    std::string headerHex, keyText;
+    size_t count = 0;
+    if(!(keyFile >> headerHex >> count) || count != files.size()) return NamiCacheResult::MISS;
+    for(size_t i = 0; i < count; i++)
+    {
+        std::string stamp;
+        keyFile >> stamp;
+        if(stamp != CacheStamp(entry + "_" + std::to_string(i))) return NamiCacheResult::MISS;
+    }
+    keyFile.ignore(1);
+    std::getline(keyFile, keyText);
+    if(keyText != valueKey.Text()) return NamiCacheResult::MISS;
+
+    bool sameHeader = (headerHex == headerKey.Hex());
+    if(!sameHeader)
+    {
+        for(const NamiCacheFile& f : files)
+            if(f.headerOptions.output == NamiGenOut::TIFF) return NamiCacheResult::MISS;
+    }
+
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        std::string cached = entry + "_" + std::to_string(i);
+        bool success = (sameHeader) ? LinkFile(cached, files[i].fileName)
+                                    : CopyPatched(cached, files[i].fileName, files[i].headerOptions);
+        if(!success) return NamiCacheResult::MISS;
+    }
+    return (sameHeader) ? NamiCacheResult::HIT : NamiCacheResult::PATCHED;
+}
+
+// Copies the written outputs into the cache, entry file is written last
+// so partially stored entries are never found
+inline static bool CacheStore(const std::string& cacheDir,
+                              const NamiCacheKey& valueKey,
+                              const NamiCacheKey& headerKey,
+                              const std::vector<NamiCacheFile>& files)
+{
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    std::string entry = CacheEntryName(cacheDir, valueKey);
+    std::vector<std::string> stamps;
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        std::string cached = entry + "_" + std::to_string(i);
+        // Jobs of a batch may store the same entry at once
+        std::string temp = cached + "." + std::to_string(std::hash<std::string>{}(files[i].fileName)) + ".tmp";
+        if(!CloneFile(files[i].fileName, temp)) return false;
+        std::filesystem::permissions(temp,
+                                     std::filesystem::perms::owner_read |
+                                     std::filesystem::perms::group_read |
+                                     std::filesystem::perms::others_read, error);
+        std::filesystem::rename(temp, cached, error);
+        if(error) return false;
+        stamps.push_back(CacheStamp(cached));
+    }
+
+    std::string temp = entry + ".key." + std::to_string(std::hash<std::string>{}(files[0].fileName)) + ".tmp";
+    {
+        std::ofstream keyFile(temp);
+        keyFile << headerKey.Hex() << " " << files.size() << "\n";
+        for(const std::string& stamp : stamps)
+            keyFile << stamp << "\n";
+        keyFile << valueKey.Text() << "\n";
+        if(!keyFile) return false;
+    }
+    std::filesystem::rename(temp, entry + ".key", error);
+    return !error;
+}
@@ -0,0 +1,311 @@
+#pragma once
+
+// Derived fields
+// Slope, depth histogram, wet/dry counts and the CFL time step are reduced
+// per tile right after the tile is generated, the grid is not read again
+// Slope of a tile border row needs the next tile, these two rows per tile
+// are finished after the generation
+// Depths are positive (land is negative), cells deeper than zero are wet
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenSamplers.h"
+
+// Derived field flags
+constexpr int NAMI_DERIVED_SLOPE = 1 << 0;
+constexpr int NAMI_DERIVED_HIST = 1 << 1;
+constexpr int NAMI_DERIVED_WET = 1 << 2;
+constexpr int NAMI_DERIVED_CFL = 1 << 3;
+
+constexpr int NAMI_DERIVED_HIST_BINS = 64;
+
+static const std::vector<std::string> derivedStrings =
+{
+    std::string("slope"),
+    std::string("hist"),
+    std::string("wet"),
+    std::string("cfl")
+};
+
+// Comma separated field names to flags, -1 on an invalid name
+inline static int DerivedToFlags(const std::string& list)
+{
+    int flags = 0;
+    std::istringstream stream(list);
+    std::string name;
+    while(std::getline(stream, name, ','))
+    {
+        auto it = std::find(derivedStrings.begin(), derivedStrings.end(), name);
+        if(it == derivedStrings.end()) return -1;
+        flags |= 1 << static_cast<int>(it - derivedStrings.begin());
+    }
+    return flags;
+}
+
+struct NamiDerived
+{
+    int                     fields;
+    double                  courant;
+    NamiMinMax              minMax;
+    // Cell size in meters (lon spacing at the center latitude)
+    double                  dx, dy;
+    // Bins over [histMin, histMax], outliers go to the end bins
+    float                   histMin, histMax;
+    std::vector<uint64_t>   histogram;
+    uint64_t                wet, dry;
+    // Gradient magnitude (rise over run), window size
+    std::vector<float>      slope;
+    NamiMinMax              slopeMinMax;
+    double                  slopeSum;
+};
+
+// Grid spacing of the grd header geometry
+inline static void DerivedCellSize(const NamiGenOptions& opts, double& dx, double& dy)
+{
+    double lonStep = (opts.sizeX > 1) ? (opts.lonMax - opts.lonMin) / (opts.sizeX - 1) : 0.0;
+    double latStep = (opts.sizeY > 1) ? (opts.latMax - opts.latMin) / (opts.sizeY - 1) : 0.0;
+    double latCenter = (opts.latMin + opts.latMax) * 0.5 * NAMI_PI / 180.0;
+    dx = std::abs(lonStep) * LAT_METER * std::cos(latCenter);
+    dy = std::abs(latStep) * LAT_METER;
+}
+
+// Histogram range is known before the generation, profiles stay in
+// between the land and bottom heights, waves in between 0 and H
+inline static void DerivedHistogramRange(const NamiGenOptions& opts, float& low, float& high)
+{
+    if(IsWaveType(opts.type))
+    {
+        low = 0.0f;
+        high = std::abs(opts.zLand);
+    }
+    else
+    {
+        low = std::min(opts.zLand, opts.zBottom);
+        high = std::max(opts.zLand, opts.zBottom);
+    }
+    if(!(high > low)) high = low + 1.0f;
+}
+
+// Gradient magnitude of a cell, central differences inside the window
+// and one sided ones on its borders
+inline static float SlopeCell(const float* data, const NamiRect& window,
+                              int x, int y, double dx, double dy)
+{
+    size_t width = static_cast<size_t>(window.width);
+    int lx = x - window.x;
+    int ly = y - window.y;
+    int x0 = std::max(lx - 1, 0);
+    int x1 = std::min(lx + 1, window.width - 1);
+    int y0 = std::max(ly - 1, 0);
+    int y1 = std::min(ly + 1, window.height - 1);
+    double gx = 0.0, gy = 0.0;
+    if(x1 > x0 && dx > 0.0)
+        gx = (data[ly * width + x1] - data[ly * width + x0]) / ((x1 - x0) * dx);
+    if(y1 > y0 && dy > 0.0)
+        gy = (data[y1 * width + lx] - data[y0 * width + lx]) / ((y1 - y0) * dy);
+    return static_cast<float>(std::sqrt(gx * gx + gy * gy));
+}
+
+// Per tile reduction, merged in tile order
+struct NamiDerivedTile
+{
+    uint64_t                histogram[NAMI_DERIVED_HIST_BINS];
+    uint64_t                wet, dry;
+    NamiMinMax              slopeMinMax;
+    double                  slopeSum;
+};
+
+inline static void SlopeRows(NamiDerivedTile& tile, NamiDerived& derived,
+                             const float* data, const NamiRect& window,
+                             int rowStart, int rowEnd)
+{
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* slopeRow = derived.slope.data() + static_cast<size_t>(y - window.y) * window.width;
+        for(int x = window.x; x < window.x + window.width; x++)
+        {
+            float s = SlopeCell(data, window, x, y, derived.dx, derived.dy);
+            slopeRow[x - window.x] = s;
+            tile.slopeMinMax.min = std::min(s, tile.slopeMinMax.min);
+            tile.slopeMinMax.max = std::max(s, tile.slopeMinMax.max);
+            tile.slopeSum += s;
+        }
+    }
+}
+
+// Values of rows [rowStart, rowEnd), "rows" points to "rowStart"
+inline static void ReduceRows(NamiDerivedTile& tile, const NamiDerived& derived,
+                              const float* rows, size_t count)
+{
+    float scale = NAMI_DERIVED_HIST_BINS / (derived.histMax - derived.histMin);
+    for(size_t i = 0; i < count; i++)
+    {
+        float v = rows[i];
+        if(derived.fields & NAMI_DERIVED_HIST)
+        {
+            int bin = static_cast<int>((v - derived.histMin) * scale);
+            tile.histogram[std::min(std::max(bin, 0), NAMI_DERIVED_HIST_BINS - 1)]++;
+        }
+        if(v > 0.0f) tile.wet++;
+        else tile.dry++;
+    }
+}
+
+inline static void InitDerived(NamiDerived& derived, const NamiGenOptions& opts,
+                               const NamiRect& window, int fields, double courant)
+{
+    derived.fields = fields;
+    derived.courant = courant;
+    DerivedCellSize(opts, derived.dx, derived.dy);
+    DerivedHistogramRange(opts, derived.histMin, derived.histMax);
+    derived.histogram.assign(NAMI_DERIVED_HIST_BINS, 0);
+    derived.wet = derived.dry = 0;
+    derived.slope.resize((fields & NAMI_DERIVED_SLOPE)
+                            ? static_cast<size_t>(window.width) * window.height : 0);
+    derived.slopeMinMax = namiMinMaxEmpty;
+    derived.slopeSum = 0.0;
+}
+
+inline static void MergeDerived(NamiDerived& derived, const NamiDerivedTile& tile)
+{
+    for(int i = 0; i < NAMI_DERIVED_HIST_BINS; i++)
+        derived.histogram[i] += tile.histogram[i];
+    derived.wet += tile.wet;
+    derived.dry += tile.dry;
+    MergeMinMax(derived.slopeMinMax, tile.slopeMinMax);
+    derived.slopeSum += tile.slopeSum;
+}
+
+// Generates "window" (packed) with "rowFunc" and reduces every tile
+// while it is in cache
+inline static NamiMinMax GenerateDerived(float* data, const NamiRect& window,
+                                         const NamiRowFunc& rowFunc,
+                                         const NamiGenOptions& opts,
+                                         int fields, double courant,
+                                         NamiThreadPool& pool,
+                                         NamiDerived& derived)
+{
+    InitDerived(derived, opts, window, fields, courant);
+    bool slope = (fields & NAMI_DERIVED_SLOPE) != 0;
+    int rowEnd = window.y + window.height;
+    size_t width = static_cast<size_t>(window.width);
+    int tileCount = (window.height + NAMI_TILE_ROWS - 1) / NAMI_TILE_ROWS;
+    std::vector<NamiDerivedTile> tiles(tileCount, NamiDerivedTile{{}, 0, 0, namiMinMaxEmpty, 0.0});
+    std::vector<NamiDerivedTile> borders(tiles);
+
+    derived.minMax = GenerateTiles(window.y, rowEnd, pool, [&](int rowStart, int rowLast)
+    {
+        float* rows = data + static_cast<size_t>(rowStart - window.y) * width;
+        NamiMinMax result = rowFunc(rows, width, rowStart, rowLast);
+        NamiDerivedTile& tile = tiles[(rowStart - window.y) / NAMI_TILE_ROWS];
+        ReduceRows(tile, derived, rows, static_cast<size_t>(rowLast - rowStart) * width);
+        // Rows that only need this tile
+        int first = (rowStart == window.y) ? rowStart : rowStart + 1;
+        int last = (rowLast == rowEnd) ? rowLast : rowLast - 1;
+        if(slope && first < last) SlopeRows(tile, derived, data, window, first, last);
+        return result;
+    });
+
+    // Border rows of the tiles
+    if(slope)
+    {
+        for(int i = 0; i < tileCount; i++)
+        {
+            pool.Submit([&, i]()
+            {
+                int rowStart = window.y + i * NAMI_TILE_ROWS;
+                int rowLast = std::min(rowStart + NAMI_TILE_ROWS, rowEnd);
+                int first = (rowStart == window.y) ? rowStart : rowStart + 1;
+                int last = (rowLast == rowEnd) ? rowLast : rowLast - 1;
+                if(first != rowStart) SlopeRows(borders[i], derived, data, window, rowStart, rowStart + 1);
+                if(last != rowLast && last >= first) SlopeRows(borders[i], derived, data, window, last, rowLast);
+            });
+        }
+        pool.Wait();
+    }
+
+    for(int i = 0; i < tileCount; i++)
+    {
+        MergeDerived(derived, tiles[i]);
+        MergeDerived(derived, borders[i]);
+    }
+    return derived.minMax;
+}
+
+// Reference reduction of a generated window, single pass in row order
+inline static void ReduceDerivedReference(NamiDerived& derived, const float* data,
+                                          const NamiRect& window,
+                                          const NamiGenOptions& opts,
+                                          int fields, double courant)
+{
+    InitDerived(derived, opts, window, fields, courant);
+    NamiDerivedTile tile = {{}, 0, 0, namiMinMaxEmpty, 0.0};
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+    ReduceRows(tile, derived, data, cellCount);
+    if(fields & NAMI_DERIVED_SLOPE)
+        SlopeRows(tile, derived, data, window, window.y, window.y + window.height);
+    MergeDerived(derived, tile);
+    derived.minMax = namiMinMaxEmpty;
+    for(size_t i = 0; i < cellCount; i++)
+        MergeMinMax(derived.minMax, NamiMinMax{data[i], data[i]});
+}
+
+// Largest stable time step of the shallow water speed sqrt(g d) at the
+// deepest cell, 0 if there is no water
+inline static double CFLTimeStep(const NamiDerived& derived)
+{
+    double depth = derived.minMax.max;
+    double cell = std::min(derived.dx, derived.dy);
+    if(!(depth > 0.0) || !(cell > 0.0)) return 0.0;
+    return derived.courant * cell / std::sqrt(NAMI_GRAVITY * depth);
+}
+
+// JSON sidecar of the requested fields, file names are left out so
+// cached sidecars stay valid for any output name
+inline static bool WriteDerivedJSON(const std::string& fileName,
+                                    const NamiDerived& derived)
+{
+    std::ofstream file(fileName);
+    file.precision(9);
+    file << "{\n"
+         << "  \"min\": " << derived.minMax.min << ",\n"
+         << "  \"max\": " << derived.minMax.max << ",\n"
+         << "  \"cellSize\": [" << derived.dx << ", " << derived.dy << "]";
+    if(derived.fields & NAMI_DERIVED_WET)
+    {
+        file << ",\n  \"wetCells\": " << derived.wet
+             << ",\n  \"dryCells\": " << derived.dry;
+    }
+    if(derived.fields & NAMI_DERIVED_HIST)
+    {
+        file << ",\n  \"histogram\": {\"min\": " << derived.histMin
+             << ", \"max\": " << derived.histMax << ", \"counts\": [";
+        for(size_t i = 0; i < derived.histogram.size(); i++)
+            file << ((i == 0) ? "" : ", ") << derived.histogram[i];
+        file << "]}";
+    }
+    if(derived.fields & NAMI_DERIVED_SLOPE)
+    {
+        uint64_t cellCount = derived.wet + derived.dry;
+        file << ",\n  \"slope\": {\"max\": " << derived.slopeMinMax.max
+             << ", \"mean\": " << ((cellCount > 0) ? derived.slopeSum / cellCount : 0.0) << "}";
+    }
+    if(derived.fields & NAMI_DERIVED_CFL)
+    {
+        file << ",\n  \"cfl\": {\"courant\": " << derived.courant
+             << ", \"maxDepth\": " << std::max(derived.minMax.max, 0.0f)
+             << ", \"dt\": " << CFLTimeStep(derived) << "}";
+    }
+    file << "\n}\n";
+    return static_cast<bool>(file);
+}
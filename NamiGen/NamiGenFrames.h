@@ -0,0 +1,222 @@
+#pragma once
+
+// Time evolving plane solitary waves
+// A plane wave keeps its sech^2 shape and travels towards the positive axis
+// with celerity c = sqrt(g (d + H)), frame "i" is the initial wave moved by
+// c * i * dt
+// Axis distances are computed once, a frame only evaluates the profile along
+// its axis and fills the rows, frames are generated on the pool while a
+// writer thread writes the previous ones ("<name>_t<index>" files)
+// Both share the pool, each only waits for the jobs it submitted
+
+#include <cmath>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenStream.h"
+#include "NamiGenAPI.h"
+#include "NamiGenTiming.h"
+
+// Frame buffers in flight (generating, waiting, writing)
+constexpr int NAMI_FRAME_RING_SIZE = 3;
+
+// Types with an analytic propagation, circular waves spread and
+// change shape so they have no closed form frame
+inline static bool IsFrameType(NamiGenType type)
+{
+    return (type == NamiGenType::WAVE_HORIZONTAL ||
+            type == NamiGenType::WAVE_VERTICAL ||
+            type == NamiGenType::WAVE_EMPTY);
+}
+
+inline static float WaveCelerity(const NamiGenOptions& opts)
+{
+    float H = std::abs(opts.zLand);
+    return std::sqrt(NAMI_GRAVITY * (opts.zBottom + H));
+}
+
+// Reference frame value of a cell at time "t", "WaveSample" at t = 0
+inline static float FrameSample(int x, int y, float t, const NamiGenOptions& opts)
+{
+    if(opts.type == NamiGenType::WAVE_EMPTY) return 0.0f;
+    float H = std::abs(opts.zLand);
+    float d = opts.zBottom;
+    float xFactor = static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER;
+    float yFactor = static_cast<float>(opts.latMax - opts.latMin) * LAT_METER;
+    float centerDist = (opts.type == NamiGenType::WAVE_HORIZONTAL)
+                            ? static_cast<float>(y - opts.gapBottom) * yFactor
+                            : static_cast<float>(x - opts.gapBottom) * xFactor;
+    centerDist -= WaveCelerity(opts) * t;
+    float coshTerm = std::cosh((std::sqrt(0.75f * H / d / d / d) * centerDist));
+    return H / (coshTerm * coshTerm);
+}
+
+// Distances of the window cells along the propagation axis (rows of
+// horizontal waves, columns of vertical ones), shared by every frame
+struct NamiFrameAxis
+{
+    bool                alongY;
+    float               H, k, c;
+    std::vector<float>  distance;
+};
+
+inline static NamiFrameAxis GenFrameAxis(const NamiGenOptions& opts,
+                                         const NamiRect& window)
+{
+    NamiFrameAxis axis;
+    float H = std::abs(opts.zLand);
+    float d = opts.zBottom;
+    axis.alongY = (opts.type == NamiGenType::WAVE_HORIZONTAL);
+    axis.H = (opts.type == NamiGenType::WAVE_EMPTY) ? 0.0f : H;
+    axis.k = std::sqrt(0.75f * H / d / d / d);
+    axis.c = WaveCelerity(opts);
+
+    int begin = (axis.alongY) ? window.y : window.x;
+    int count = (axis.alongY) ? window.height : window.width;
+    float factor = (axis.alongY) ? static_cast<float>(opts.latMax - opts.latMin) * LAT_METER
+                                 : static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER;
+    axis.distance.resize(count);
+    for(int i = 0; i < count; i++)
+        axis.distance[i] = static_cast<float>(begin + i - opts.gapBottom) * factor;
+    return axis;
+}
+
+// Profile of a frame along the axis, returns its min/max
+inline static NamiMinMax FrameProfile(std::vector<float>& profile,
+                                      const NamiFrameAxis& axis, float t)
+{
+    profile.resize(axis.distance.size());
+    float shift = axis.c * t;
+    NamiMinMax result = namiMinMaxEmpty;
+    for(size_t i = 0; i < profile.size(); i++)
+    {
+        float coshTerm = std::cosh(axis.k * (axis.distance[i] - shift));
+        float value = axis.H / (coshTerm * coshTerm);
+        profile[i] = value;
+        result.min = std::min(value, result.min);
+        result.max = std::max(value, result.max);
+    }
+    return result;
+}
+
+// Fills the window (packed) with the profile, horizontal waves are
+// constant along a row, vertical ones repeat the profile on every row
+inline static void FillFrame(float* data, const NamiRect& window,
+                             const NamiFrameAxis& axis,
+                             const std::vector<float>& profile,
+                             NamiThreadPool& pool)
+{
+    size_t width = static_cast<size_t>(window.width);
+    GenerateTiles(window.y, window.y + window.height, pool, [&](int rowStart, int rowLast)
+    {
+        for(int y = rowStart; y < rowLast; y++)
+        {
+            float* rowPtr = data + static_cast<size_t>(y - window.y) * width;
+            if(axis.alongY)
+                std::fill(rowPtr, rowPtr + width, profile[y - window.y]);
+            else
+                std::copy(profile.begin(), profile.end(), rowPtr);
+        }
+        return namiMinMaxEmpty;
+    });
+}
+
+inline static std::string FrameFileName(const std::string& name, int index,
+                                        int frameCount, const std::string& extension)
+{
+    int digits = std::max(4, static_cast<int>(std::to_string(frameCount - 1).size()));
+    char number[16];
+    std::snprintf(number, sizeof(number), "%0*d", digits, index);
+    return name + "_t" + number + extension;
+}
+
+// Checks a generated frame (window packed) before it is written,
+// returning false stops the sequence
+using NamiFrameCheck = std::function<bool(const float* data, int frame, float t)>;
+
+// Generates "frameCount" frames "dt" seconds apart and writes them as
+// "<name>_t<index><extension>" through a writer thread
+// Busy time of the writer is written to "writeTime" if given
+inline static bool GenerateFrames(const NamiGenOptions& opts,
+                                  const NamiRect& window,
+                                  int frameCount, float dt,
+                                  const std::string& name,
+                                  const std::string& extension,
+                                  NamiThreadPool& pool,
+                                  const NamiFrameCheck& check = nullptr,
+                                  double* writeTime = nullptr)
+{
+    NamiGenOptions outOptions = NamiWindowOptions(opts, window);
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+    NamiFrameAxis axis = GenFrameAxis(opts, window);
+
+    struct FrameSlot
+    {
+        std::vector<float>  values;
+        NamiMinMax          minMax;
+        int                 frame;
+    };
+    std::vector<FrameSlot> slots(NAMI_FRAME_RING_SIZE);
+    NamiSlotQueue freeSlots, readySlots;
+    for(int i = 0; i < NAMI_FRAME_RING_SIZE; i++)
+    {
+        slots[i].values.resize(cellCount);
+        freeSlots.Push(i);
+    }
+
+    // Writer thread, -1 terminates
+    std::atomic<bool> written(true);
+    double writerBusy = 0.0;
+    std::thread writer([&]()
+    {
+        int slotIndex;
+        while((slotIndex = readySlots.Pop()) >= 0)
+        {
+            NamiTimer timer;
+            FrameSlot& slot = slots[slotIndex];
+            std::string fileName = FrameFileName(name, slot.frame, frameCount, extension);
+            if(written && !NamiWriteFile(fileName, NamiSpan<const float>(slot.values),
+                                         outOptions, slot.minMax, pool))
+            {
+                std::cout << "Unable to write \"" << fileName << "\"" << std::endl;
+                written = false;
+            }
+            writerBusy += timer.Elapsed();
+            freeSlots.Push(slotIndex);
+        }
+    });
+
+    bool checked = true;
+    std::vector<float> profile;
+    for(int frame = 0; frame < frameCount && checked && written; frame++)
+    {
+        float t = static_cast<float>(frame) * dt;
+        int slotIndex = freeSlots.Pop();
+        FrameSlot& slot = slots[slotIndex];
+        slot.frame = frame;
+        slot.minMax = FrameProfile(profile, axis, t);
+        FillFrame(slot.values.data(), window, axis, profile, pool);
+        if(check && !check(slot.values.data(), frame, t))
+        {
+            checked = false;
+            freeSlots.Push(slotIndex);
+            break;
+        }
+        readySlots.Push(slotIndex);
+    }
+    readySlots.Push(-1);
+    writer.join();
+    if(writeTime) *writeTime = writerBusy;
+    return checked && written;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cmath>
+#include <cfloat>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -10,8 +11,8 @@
 constexpr float NAMI_PI = 3.1415927f;
 constexpr float NAMI_E = 2.7182817f;
 constexpr float LAT_METER = 111699.0f;
+constexpr float NAMI_GRAVITY = 9.81f;
 
-static float SecH(float radians);
 static float CircleSampleSinusodial(float distance, const NamiGenOptions& opts);
 static float CircleSampleLinear(float distance, const NamiGenOptions& opts);
 static float SampleSinusodial(float norm, const NamiGenOptions& opts);
@@ -54,7 +55,7 @@ inline static float CircleSample(int x, int y, const NamiGenOptions& opts)
     float yFloat = static_cast<float>(y);
 
     // Distance
-    float distance = std::sqrtf(std::abs(xFloat - centerPointX) *
+    float distance = std::sqrt(std::abs(xFloat - centerPointX) *
                                 std::abs(xFloat - centerPointX) +
                                 std::abs(yFloat - centerPointY) *
                                 std::abs(yFloat - centerPointY));
@@ -206,6 +207,104 @@ inline static float WaveSample(int x, int y, const NamiGenOptions& opts)
     return H / (coshTerm * coshTerm);
 }
 
+// Double precision "WaveSample" for f64 storage
+inline static double WaveSampleDouble(int x, int y, const NamiGenOptions& opts)
+{
+    double centerDist;
+    double H = std::abs(static_cast<double>(opts.zLand));
+    double d = opts.zBottom;
+    double xFactor = (opts.lonMax - opts.lonMin) * LAT_METER;
+    double yFactor = (opts.latMax - opts.latMin) * LAT_METER;
+    switch(opts.type)
+    {
+        case NamiGenType::WAVE_CIRCULAR:
+        {
+            double xDist = static_cast<double>(x - opts.gapBottom) * xFactor;
+            double yDist = static_cast<double>(y - opts.gapTop) * yFactor;
+            centerDist = std::sqrt(xDist * xDist + yDist * yDist);
+            break;
+        }
+        case NamiGenType::WAVE_HORIZONTAL:
+        {
+            centerDist = static_cast<double>(y - opts.gapBottom) * yFactor;
+            break;
+        }
+        case NamiGenType::WAVE_VERTICAL:
+        {
+            centerDist = static_cast<double>(x - opts.gapBottom) * xFactor;
+            break;
+        }
+        default:
+            return 0.0;
+    }
+    double coshTerm = std::cosh((std::sqrt(0.75 * H / d / d / d) * centerDist));
+    return H / (coshTerm * coshTerm);
+}
+
+inline static float SampleCell(int x, int y, const NamiGenOptions& opts)
+{
+    // Wave Segment
+    switch(opts.type)
+    {
+        case NamiGenType::WAVE_CIRCULAR:
+        case NamiGenType::WAVE_HORIZONTAL:
+        case NamiGenType::WAVE_VERTICAL:
+        case NamiGenType::WAVE_EMPTY:
+            return WaveSample(x, y, opts);
+    }
+    // Bathy Segment
+    // Wall
+    if(opts.type == NamiGenType::DUHIS &&
+       y < opts.wallWidth ||
+       y >= (opts.sizeY - opts.wallWidth))
+    {
+        return opts.zLand;
+    }
+    else if(opts.type != NamiGenType::DUHIS &&
+            (opts.hasWalls &&
+             (x < opts.wallWidth ||
+              x >= (opts.sizeX - opts.wallWidth) ||
+              y < opts.wallWidth ||
+              y >= (opts.sizeY - opts.wallWidth))))
+    {
+        return opts.zLand;
+    }
+    switch(opts.type)
+    {
+        case NamiGenType::CIRCULAR_LINEAR:
+        case NamiGenType::CIRCULAR_SINUSODIAL:
+            return CircleSample(x, y, opts);
+        case NamiGenType::LINEAR_L:
+        case NamiGenType::LINEAR_R:
+        case NamiGenType::LINEAR_T:
+        case NamiGenType::LINEAR_B:
+        case NamiGenType::SINUSODIAL_L:
+        case NamiGenType::SINUSODIAL_R:
+        case NamiGenType::SINUSODIAL_T:
+        case NamiGenType::SINUSODIAL_B:
+            return SampleFlat(x, y, opts);
+        case NamiGenType::DUHIS:
+            return SampleDuhis(x, y, opts);
+    }
+    return 0.0f;
+}
+
+struct NamiMinMax
+{
+    float min;
+    float max;
+};
+
+constexpr NamiMinMax namiMinMaxEmpty = NamiMinMax{FLT_MAX, -FLT_MAX};
+
+// Merge order matters for bit exactness,
+// ties are resolved to the later value same as the serial loop
+inline static void MergeMinMax(NamiMinMax& result, const NamiMinMax& tile)
+{
+    result.min = std::min(tile.min, result.min);
+    result.max = std::max(tile.max, result.max);
+}
+
 // Out Functions
 inline static int NumDecimalDigit(float f)
 {
@@ -221,10 +320,11 @@ inline static int NumDecimalDigit(float f)
     return digits;
 }
 
-inline static void OutGRD(const float* data,
-                          const NamiGenOptions& opts,
-                          double min, double max,
-                          const std::string& fileName)
+// Reference writer (ostream per value), fast writer is in "NamiGenWriters.h"
+inline static void OutGRDReference(const float* data,
+                                   const NamiGenOptions& opts,
+                                   double min, double max,
+                                   const std::string& fileName)
 {
     static const std::string FOURCC_GRD = "DSAA";
 
@@ -273,13 +373,13 @@ inline static void OutGRD(const float* data,
         lineCounter++;
         dataPtr += 1;
     }
-    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
 }
 
-inline static void OutGRDBin(const float* data,
-                             const NamiGenOptions& opts,
-                             double min, double max,
-                             const std::string& fileName)
+// Reference writer (write per value), fast writer is in "NamiGenWriters.h"
+inline static void OutGRDBinReference(const float* data,
+                                      const NamiGenOptions& opts,
+                                      double min, double max,
+                                      const std::string& fileName)
 {
     static const std::string FOURCC_GRD_BIN = "DSBB";
 
@@ -307,5 +407,4 @@ inline static void OutGRDBin(const float* data,
         outFile.write(reinterpret_cast<const char*>(dataPtr), sizeof(float));
         dataPtr += 1;
     }
-    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
 }
\ No newline at end of file
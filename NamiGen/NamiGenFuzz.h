@@ -0,0 +1,426 @@
+#pragma once
+
+#include <cmath>
+#include <cfloat>
+#include <random>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <filesystem>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenWriters.h"
+#include "NamiGenStream.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenSimd.h"
+#include "NamiGenProfileCache.h"
+#include "NamiGenAPI.h"
+#include "NamiGenTiledGrid.h"
+
+// Differential fuzzing of the optimized generation and write paths
+// Oracle is the serial per cell loop ("SampleCell" over the whole grid,
+// same as the original main loop) and the ostream per value writers
+// ("OutGRDReference", "OutGRDBinReference")
+//      scalar samplers     : bit exact values and min/max (of grids without NaN)
+//      SIMD kernels        : "SimdUlpTolerance" ULPs of the type (see "FuzzUlpMagnitude")
+//      profile tables      : "-lut" error plus the SIMD tolerance
+//      writers             : byte exact files of the same values
+//      tiled layout        : same values and files as the row major path
+
+// Largest fuzzed grid dimension
+constexpr int NAMI_FUZZ_MAX_SIZE = 300;
+
+// Single fuzz case, window is generated on top of the whole grid
+struct NamiFuzzCase
+{
+    NamiGenOptions  options;
+    NamiRect        window;
+    int             threads;
+    bool            stream;
+    bool            mapped;
+};
+
+// Switches that reproduce the generation of a case with -verify
+inline static std::string FuzzCaseArgs(const NamiFuzzCase& c)
+{
+    const NamiGenOptions& o = c.options;
+    std::ostringstream args;
+    args.precision(9);
+    args << "-t " << GenTypeToString(o.type)
+         << " -size " << o.sizeX << " " << o.sizeY
+         << " -gap " << o.gapBottom << " " << o.gapTop
+         << " -z " << o.zLand << " " << o.zBottom
+         << " -tana " << o.tana
+         << " -w " << o.wallWidth << ((o.hasWalls) ? " -wall" : "")
+         << std::setprecision(17)
+         << " -lat " << o.latMin << " " << o.latMax
+         << " -lon " << o.lonMin << " " << o.lonMax
+         << std::setprecision(9)
+         << " -simd " << SimdLevelToString(ResolveSimdLevel(o.simd))
+         << " -lut " << o.lutError
+         << " -threads " << c.threads
+         << " -window " << c.window.x << " " << c.window.y << " "
+         << c.window.width << " " << c.window.height;
+    return args.str();
+}
+
+// Fixed edge cases, run before the random ones
+// Non square sizes exercise the line break logic of the ascii writer
+// (it breaks on "i % sizeY" as well as on row ends)
+inline static std::vector<NamiFuzzCase> FuzzEdgeCases()
+{
+    static const int sizes[][2] =
+    {
+        {1, 1}, {1, 7}, {7, 1}, {2, 3}, {3, 2},
+        {10, 20}, {20, 10}, {11, 3}, {3, 11}, {33, 257}
+    };
+    std::vector<NamiFuzzCase> cases;
+    int type = static_cast<int>(NamiGenType::CIRCULAR_SINUSODIAL);
+    for(const auto& size : sizes)
+    {
+        NamiFuzzCase c;
+        c.options = namiOptsDefault;
+        c.options.type = static_cast<NamiGenType>(type);
+        c.options.sizeX = size[0];
+        c.options.sizeY = size[1];
+        c.options.gapBottom = size[0] / 4;
+        c.options.gapTop = size[0] / 2;
+        c.window = NamiFullWindow(c.options);
+        c.threads = 1 + (type % 3);
+        c.stream = true;
+        c.mapped = true;
+        cases.push_back(c);
+        if(++type > static_cast<int>(NamiGenType::WAVE_EMPTY))
+            type = static_cast<int>(NamiGenType::CIRCULAR_SINUSODIAL);
+    }
+
+    // Wide circular waves, the cosh based SIMD kernel was 5 ULPs off here
+    static const double waveSpans[] = {1e-4, 3e-5};
+    static const float waveZ[][2] = {{-0.05f, 300.0f}, {-0.2f, 60.0f}};
+    for(int i = 0; i < 2; i++)
+    {
+        NamiFuzzCase c;
+        c.options = namiOptsDefault;
+        c.options.type = NamiGenType::WAVE_CIRCULAR;
+        c.options.sizeX = 1500;
+        c.options.sizeY = 1200;
+        c.options.gapBottom = 700;
+        c.options.gapTop = 600;
+        c.options.latMax = waveSpans[i];
+        c.options.lonMax = waveSpans[i];
+        c.options.zLand = waveZ[i][0];
+        c.options.zBottom = waveZ[i][1];
+        c.options.simd = NamiGenSimd::AVX2;
+        c.window = NamiRect{650, 550, 100, 100};
+        c.threads = 4;
+        c.stream = false;
+        c.mapped = false;
+        cases.push_back(c);
+    }
+    return cases;
+}
+
+inline static NamiFuzzCase FuzzRandomCase(std::mt19937& rng)
+{
+    auto uniformInt = [&](int min, int max)
+    {
+        return std::uniform_int_distribution<int>(min, max)(rng);
+    };
+    auto uniformFloat = [&](float min, float max)
+    {
+        return std::uniform_real_distribution<float>(min, max)(rng);
+    };
+    auto chance = [&](int percent) { return uniformInt(0, 99) < percent; };
+
+    NamiFuzzCase c;
+    NamiGenOptions& o = c.options;
+    o = namiOptsDefault;
+    o.type = static_cast<NamiGenType>(uniformInt(static_cast<int>(NamiGenType::CIRCULAR_SINUSODIAL),
+                                                 static_cast<int>(NamiGenType::WAVE_EMPTY)));
+    // Mostly small grids, odd and unequal sizes are common
+    int maxSize = chance(70) ? 64 : NAMI_FUZZ_MAX_SIZE;
+    o.sizeX = uniformInt(1, maxSize);
+    o.sizeY = chance(20) ? o.sizeX : uniformInt(1, maxSize);
+
+    // Gaps inside, at and beyond the grid, zero, negative and inverted
+    int largest = std::max(o.sizeX, o.sizeY);
+    switch(uniformInt(0, 4))
+    {
+        case 0:  o.gapBottom = 0; o.gapTop = 0; break;
+        case 1:  o.gapBottom = uniformInt(-largest, 0); o.gapTop = uniformInt(0, 2 * largest); break;
+        case 2:  o.gapBottom = uniformInt(0, 2 * largest); o.gapTop = uniformInt(0, 2 * largest); break;
+        case 3:  o.gapBottom = largest; o.gapTop = largest; break;
+        default:
+            o.gapBottom = uniformInt(0, largest);
+            o.gapTop = uniformInt(o.gapBottom, largest);
+            break;
+    }
+
+    // Slopes from flat to nearly vertical
+    static const float tanaValues[] = {1.0f, 0.0f, 1e-6f, 1e-3f, 1e3f, 1e6f, -1.0f};
+    o.tana = chance(50) ? uniformFloat(0.01f, 10.0f)
+                        : tanaValues[uniformInt(0, static_cast<int>(std::size(tanaValues)) - 1)];
+    o.zLand = uniformFloat(-100.0f, 0.0f);
+    o.zBottom = uniformFloat(0.5f, 1000.0f);
+    if(chance(10)) std::swap(o.zLand, o.zBottom);
+
+    o.hasWalls = chance(50);
+    o.wallWidth = uniformInt(0, largest / 2 + 2);
+    // Cells are "span * LAT_METER" apart, wave spans are small enough that
+    // the solitary wave covers many cells instead of dropping to 0 in one
+    auto span = [&]()
+    {
+        return (IsWaveType(o.type)) ? std::pow(10.0, uniformFloat(-6.0f, -4.0f))
+                                    : static_cast<double>(uniformFloat(1e-4f, 1.0f));
+    };
+    o.latMin = uniformFloat(-80.0f, 79.0f);
+    o.latMax = o.latMin + span();
+    o.lonMin = uniformFloat(-180.0f, 179.0f);
+    o.lonMax = o.lonMin + span();
+    o.simd = static_cast<NamiGenSimd>(uniformInt(static_cast<int>(NamiGenSimd::OFF),
+                                                 static_cast<int>(NamiGenSimd::AVX512)));
+    o.lutError = chance(25) ? uniformFloat(1e-4f, 1e-1f) : 0.0f;
+
+    c.window.x = uniformInt(0, o.sizeX - 1);
+    c.window.y = uniformInt(0, o.sizeY - 1);
+    c.window.width = uniformInt(1, o.sizeX - c.window.x);
+    c.window.height = uniformInt(1, o.sizeY - c.window.y);
+    c.threads = uniformInt(1, 4);
+    c.stream = chance(25);
+    c.mapped = chance(25);
+    return c;
+}
+
+// ULPs are measured at the scale the samplers round at, bathymetry profiles
+// are scaled by the z range before zLand is added, so their error follows
+// the range even where the output is close to zero
+inline static float FuzzUlpMagnitude(const NamiGenOptions& opts,
+                                     const NamiMinMax& refMinMax)
+{
+    float magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+    if(!IsWaveType(opts.type))
+        magnitude = std::max(magnitude, std::abs(opts.zBottom - opts.zLand));
+    return magnitude;
+}
+
+// Cells equal within "ulpTolerance" ULPs at "magnitude" plus "absTolerance",
+// NaN and infinity only match themselves
+inline static bool FuzzValuesMatch(const float* reference, const float* data,
+                                   size_t count, float magnitude,
+                                   float ulpTolerance, float absTolerance)
+{
+    float ulp = std::nextafter(magnitude, FLT_MAX) - magnitude;
+    if(ulp == 0.0f || !std::isfinite(ulp)) ulp = FLT_MIN;
+    float bound = ulp * ulpTolerance + absTolerance;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        float r = reference[i];
+        float d = data[i];
+        if(std::isnan(r) || std::isnan(d))
+        {
+            if(std::isnan(r) != std::isnan(d)) return false;
+        }
+        else if(std::isinf(r) || std::isinf(d))
+        {
+            if(r != d) return false;
+        }
+        else if(!(std::abs(r - d) <= bound)) return false;
+    }
+    return true;
+}
+
+inline static std::string FuzzReadFile(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ifstream::binary);
+    return std::string(std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>());
+}
+
+// Runs a case, prints and returns the failed checks
+// Temporary files are named "<fileName>.*"
+inline static int RunFuzzCase(const NamiFuzzCase& c, const std::string& fileName)
+{
+    const NamiGenOptions& opts = c.options;
+    NamiThreadPool pool(c.threads);
+    size_t cellCount = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    std::vector<std::string> failures;
+
+    // Oracle, serial loop over the whole grid
+    std::vector<float> refData(cellCount);
+    NamiMinMax refMinMax = GenerateRowsReference(refData.data(), opts.sizeX,
+                                                 0, opts.sizeY, 0, opts.sizeX, opts);
+
+    bool exact = (ResolveSimdLevel(opts.simd) == NamiSimdLevel::SCALAR &&
+                  !UseProfileLUT(opts));
+    float ulpTolerance = (exact) ? 0.0f : SimdUlpTolerance(opts.type);
+    float absTolerance = (UseProfileLUT(opts)) ? opts.lutError : 0.0f;
+    float magnitude = FuzzUlpMagnitude(opts, refMinMax);
+
+    std::vector<float> data(cellCount);
+    NamiMinMax minMax = GenerateGrid(data.data(), opts, pool);
+    if(!FuzzValuesMatch(refData.data(), data.data(), cellCount,
+                        magnitude, ulpTolerance, absTolerance))
+        failures.push_back("grid values");
+    // Min/max of grids with NaN depends on the merge order
+    bool hasNaN = std::any_of(refData.begin(), refData.end(),
+                              [](float v) { return std::isnan(v); });
+    if(exact && !hasNaN &&
+       (minMax.min != refMinMax.min || minMax.max != refMinMax.max))
+        failures.push_back("grid min/max");
+
+    // Window into a wider strided buffer, padding should stay untouched
+    static constexpr float PAD = -12345.0f;
+    const NamiRect& w = c.window;
+    size_t stride = static_cast<size_t>(w.width) + 3;
+    std::vector<float> windowData(stride * w.height, PAD);
+    GenerateWindow(windowData.data(), stride, w, opts, pool);
+    bool windowPass = true;
+    for(int y = 0; y < w.height && windowPass; y++)
+    {
+        const float* row = windowData.data() + y * stride;
+        const float* refRow = refData.data() + static_cast<size_t>(w.y + y) * opts.sizeX + w.x;
+        windowPass = FuzzValuesMatch(refRow, row, w.width, magnitude,
+                                     ulpTolerance, absTolerance) &&
+                     std::all_of(row + w.width, row + stride,
+                                 [](float v) { return v == PAD; });
+    }
+    if(!windowPass) failures.push_back("window values");
+
+    // Writers against the reference writers over the same values
+    std::string refFile = fileName + ".ref";
+    NamiGenOptions grdOpts = opts;
+    grdOpts.output = NamiGenOut::GRD;
+    OutGRDReference(data.data(), grdOpts, minMax.min, minMax.max, refFile);
+    std::string refGRD = FuzzReadFile(refFile);
+    std::ostringstream grd;
+    WriteGRD(grd, data.data(), grdOpts, minMax.min, minMax.max, pool);
+    if(grd.str() != refGRD) failures.push_back("grd writer");
+
+    // Reference binary writer stores the host byte order
+    NamiGenOptions binOpts = opts;
+    binOpts.output = NamiGenOut::GRD_BIN;
+    bool binary = IsLittleEndian() && GRDBinSizeValid(binOpts);
+    std::string refBin;
+    if(binary)
+    {
+        OutGRDBinReference(data.data(), binOpts, minMax.min, minMax.max, refFile);
+        refBin = FuzzReadFile(refFile);
+        std::ostringstream bin(std::ios::out | std::ios::binary);
+        WriteGRDBin(bin, data.data(), binOpts, minMax.min, minMax.max);
+        if(bin.str() != refBin) failures.push_back("grdbin writer");
+    }
+    std::remove(refFile.c_str());
+
+    // Tiled layout runs the same samplers per tile, SIMD tails move with the
+    // tile columns so values are within the case tolerance
+    // Writers should give the files of the converted rows
+    NamiTiledGrid tiled;
+    NamiMinMax tiledMinMax = GenerateTiled(tiled, NamiFullWindow(opts), opts, pool);
+    std::vector<float> tiledRows(cellCount);
+    tiled.CopyRows(tiledRows.data(), 0, opts.sizeY);
+    if(!FuzzValuesMatch(refData.data(), tiledRows.data(), cellCount,
+                        magnitude, ulpTolerance, absTolerance) ||
+       (exact && !FuzzValuesMatch(data.data(), tiledRows.data(), cellCount,
+                                  magnitude, 0.0f, 0.0f)) ||
+       (exact && !hasNaN &&
+        (tiledMinMax.min != minMax.min || tiledMinMax.max != minMax.max)))
+        failures.push_back("tiled values");
+    std::ostringstream rowsGRD, tiledGRD;
+    WriteGRD(rowsGRD, tiledRows.data(), grdOpts, minMax.min, minMax.max, pool);
+    WriteTiled(tiledGRD, tiled, grdOpts, minMax, pool);
+    if(tiledGRD.str() != rowsGRD.str()) failures.push_back("tiled grd writer");
+    if(binary)
+    {
+        std::ostringstream rowsBin(std::ios::out | std::ios::binary);
+        std::ostringstream tiledBin(std::ios::out | std::ios::binary);
+        WriteGRDBin(rowsBin, tiledRows.data(), binOpts, minMax.min, minMax.max);
+        WriteTiled(tiledBin, tiled, binOpts, minMax, pool);
+        if(tiledBin.str() != rowsBin.str()) failures.push_back("tiled grdbin writer");
+    }
+    GenerateTiled(tiled, w, opts, pool);
+    tiledRows.resize(static_cast<size_t>(w.width) * w.height);
+    tiled.CopyRows(tiledRows.data(), 0, w.height);
+    bool tiledWindowPass = true;
+    for(int y = 0; y < w.height && tiledWindowPass; y++)
+    {
+        const float* refRow = refData.data() + static_cast<size_t>(w.y + y) * opts.sizeX + w.x;
+        tiledWindowPass = FuzzValuesMatch(refRow,
+                                          tiledRows.data() + static_cast<size_t>(y) * w.width,
+                                          w.width, magnitude, ulpTolerance, absTolerance);
+    }
+    if(!tiledWindowPass) failures.push_back("tiled window values");
+
+    // File paths generate again, values are deterministic
+    std::string outFile = fileName + ".out";
+    if(c.stream)
+    {
+        NamiMinMax streamed;
+        if(!StreamGRD(grdOpts, outFile, pool, streamed, NamiGenIO::OFSTREAM, false, false) || FuzzReadFile(outFile) != refGRD)
+            failures.push_back("grd stream");
+        if(binary && (!StreamGRD(binOpts, outFile, pool, streamed, NamiGenIO::OFSTREAM, false, false) ||
+                      FuzzReadFile(outFile) != refBin))
+            failures.push_back("grdbin stream");
+        // Same bands through the async backends, pwrite on odd thread counts
+        NamiGenIO io = (c.threads % 2 == 0) ? NamiGenIO::URING : NamiGenIO::PWRITE;
+        if(!StreamGRD(grdOpts, outFile, pool, streamed, io, false, false) || FuzzReadFile(outFile) != refGRD)
+            failures.push_back("grd async stream");
+        if(binary && (!StreamGRD(binOpts, outFile, pool, streamed, io, false, false) ||
+                      FuzzReadFile(outFile) != refBin))
+            failures.push_back("grdbin async stream");
+    }
+    if(c.mapped && binary)
+    {
+        bool pass = false;
+        {
+            NamiMappedFile mappedFile;
+            float* grid = MapGRDBin(mappedFile, binOpts, outFile);
+            if(grid != nullptr)
+            {
+                NamiMinMax mappedMinMax = GenerateGrid(grid, binOpts, pool);
+                FinalizeGRDBin(mappedFile, binOpts, mappedMinMax.min, mappedMinMax.max);
+                pass = true;
+            }
+        }
+        if(!pass || FuzzReadFile(outFile) != refBin)
+            failures.push_back("grdbin mmap");
+    }
+    std::remove(outFile.c_str());
+
+    for(const std::string& f : failures)
+        std::cout << "Fuzz\t: FAIL " << f << "\t" << FuzzCaseArgs(c) << std::endl;
+    return static_cast<int>(failures.size());
+}
+
+// Runs the edge cases and "count" random cases of "seed"
+// Returns false if any case fails
+// Temporary files are written to the system temp directory
+inline static bool RunFuzz(int count, unsigned int seed)
+{
+    std::error_code error;
+    std::filesystem::path tempDir = std::filesystem::temp_directory_path(error);
+    if(error) tempDir = ".";
+    std::string fileName = (tempDir / ("namigen_fuzz_" + std::to_string(seed))).string();
+
+    std::vector<NamiFuzzCase> cases = FuzzEdgeCases();
+    std::mt19937 rng(seed);
+    for(int i = 0; i < count; i++)
+        cases.push_back(FuzzRandomCase(rng));
+
+    int failedCases = 0;
+    for(const NamiFuzzCase& c : cases)
+        failedCases += (RunFuzzCase(c, fileName) > 0) ? 1 : 0;
+
+    std::cout << "Fuzz\t: " << cases.size() << " cases (seed " << seed << "), "
+              << failedCases << " failed "
+              << ((failedCases == 0) ? "PASS" : "FAIL") << std::endl;
+    return failedCases == 0;
+}
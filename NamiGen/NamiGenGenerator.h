@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cfloat>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenSimd.h"
+#include "NamiGenProfileCache.h"
+
+// Rows per generation tile
+constexpr int NAMI_TILE_ROWS = 32;
+
+// Row functions generate rows [rowStart, rowEnd) and columns [colBegin, colEnd)
+// of the grid, "data" points to the cell (colBegin, rowStart) and consecutive
+// rows are "stride" floats apart
+
+// Reference generation, samples each cell with "SampleCell"
+inline static NamiMinMax GenerateRowsReference(float* data, size_t stride,
+                                               int rowStart, int rowEnd,
+                                               int colBegin, int colEnd,
+                                               const NamiGenOptions& opts)
+{
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        for(int x = colBegin; x < colEnd; x++)
+        {
+            float value = SampleCell(x, y, opts);
+            rowPtr[x - colBegin] = value;
+            result.min = std::min(value, result.min);
+            result.max = std::max(value, result.max);
+        }
+    }
+    return result;
+}
+
+// Specialized generation, land regions are filled directly
+// and the sampler is only called inside the wall mask
+template<class Sampler>
+inline static NamiMinMax GenerateRows(float* data, size_t stride,
+                                      int rowStart, int rowEnd,
+                                      int colBegin, int colEnd,
+                                      const NamiGenOptions& opts,
+                                      const NamiWallMask& mask,
+                                      const Sampler& sampler)
+{
+    // Mask columns relative to the window
+    int width = colEnd - colBegin;
+    int xStart = std::max(0, std::min(mask.colStart - colBegin, width));
+    int xEnd = std::max(xStart, std::min(mask.colEnd - colBegin, width));
+
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        if(y < mask.rowStart || y >= mask.rowEnd)
+        {
+            std::fill(rowPtr, rowPtr + width, opts.zLand);
+        }
+        else
+        {
+            std::fill(rowPtr, rowPtr + xStart, opts.zLand);
+            // Y only samplers are constant along the row
+            if(Sampler::SAMPLE_DOMAIN == NamiSampleDomain::Y && xStart < xEnd)
+                std::fill(rowPtr + xStart, rowPtr + xEnd,
+                          sampler.Sample(colBegin + xStart, y));
+            else
+                for(int x = xStart; x < xEnd; x++)
+                    rowPtr[x] = sampler.Sample(colBegin + x, y);
+            std::fill(rowPtr + xEnd, rowPtr + width, opts.zLand);
+        }
+
+        for(int x = 0; x < width; x++)
+        {
+            result.min = std::min(rowPtr[x], result.min);
+            result.max = std::max(rowPtr[x], result.max);
+        }
+    }
+    return result;
+}
+
+// X only samplers, rows inside the mask are copies of "cachedRow"
+// ("width" values of a masked row starting at the first generated column)
+// "cachedMinMax" is the min/max of those values
+inline static NamiMinMax GenerateRowsCached(float* data, size_t stride,
+                                            int rowStart, int rowEnd,
+                                            const NamiGenOptions& opts,
+                                            const NamiWallMask& mask,
+                                            const float* cachedRow, int width,
+                                            const NamiMinMax& cachedMinMax)
+{
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        if(y < mask.rowStart || y >= mask.rowEnd)
+        {
+            std::fill(rowPtr, rowPtr + width, opts.zLand);
+            if(width > 0) MergeMinMax(result, NamiMinMax{opts.zLand, opts.zLand});
+        }
+        else
+        {
+            std::copy(cachedRow, cachedRow + width, rowPtr);
+            MergeMinMax(result, cachedMinMax);
+        }
+    }
+    return result;
+}
+
+inline static NamiMinMax GenerateRowsSimd(float* data, size_t stride,
+                                          int rowStart, int rowEnd,
+                                          int colBegin, int colEnd,
+                                          const NamiGenOptions& opts,
+                                          const NamiWallMask& mask,
+                                          const NamiSimdParams& params,
+                                          NamiSimdLevel level)
+{
+    switch(level)
+    {
+        #ifdef NAMI_SIMD_X86
+        case NamiSimdLevel::SSE:
+            return NamiSimdSSE::GenerateRows(data, stride, rowStart, rowEnd,
+                                             colBegin, colEnd, opts, mask, params);
+        case NamiSimdLevel::AVX2:
+            return NamiSimdAVX2::GenerateRows(data, stride, rowStart, rowEnd,
+                                              colBegin, colEnd, opts, mask, params);
+        case NamiSimdLevel::AVX512:
+            return NamiSimdAVX512::GenerateRows(data, stride, rowStart, rowEnd,
+                                                colBegin, colEnd, opts, mask, params);
+        #endif
+        default:
+            return GenerateRowsReference(data, stride, rowStart, rowEnd,
+                                         colBegin, colEnd, opts);
+    }
+}
+
+// Splits rows [rowBegin, rowEnd) into row tiles and runs "rowFunc" on the pool
+// "rowFunc" receives the tile row range
+// Tile min/max values are merged in tile order
+template<class RowFunc>
+inline static NamiMinMax GenerateTiles(int rowBegin, int rowEnd,
+                                       NamiThreadPool& pool,
+                                       RowFunc&& rowFunc)
+{
+    int tileCount = (rowEnd - rowBegin + NAMI_TILE_ROWS - 1) / NAMI_TILE_ROWS;
+    std::vector<NamiMinMax> tileResults(std::max(tileCount, 0), namiMinMaxEmpty);
+    for(int i = 0; i < tileCount; i++)
+    {
+        pool.Submit([&, i]()
+        {
+            int rowStart = rowBegin + i * NAMI_TILE_ROWS;
+            int rowLast = std::min(rowStart + NAMI_TILE_ROWS, rowEnd);
+            tileResults[i] = rowFunc(rowStart, rowLast);
+        });
+    }
+    pool.Wait();
+
+    NamiMinMax result = namiMinMaxEmpty;
+    for(const NamiMinMax& tile : tileResults)
+        MergeMinMax(result, tile);
+    return result;
+}
+
+// Window generators, "data" points to the cell (window.x, window.y)
+// and consecutive rows are "stride" floats apart
+inline static NamiMinMax GenerateWindowReference(float* data, size_t stride,
+                                                 const NamiRect& window,
+                                                 const NamiGenOptions& opts,
+                                                 NamiThreadPool& pool)
+{
+    int rowBegin = window.y;
+    int colEnd = window.x + window.width;
+    return GenerateTiles(rowBegin, window.y + window.height, pool, [&](int rowStart, int rowLast)
+    {
+        float* rows = data + static_cast<size_t>(rowStart - rowBegin) * stride;
+        return GenerateRowsReference(rows, stride, rowStart, rowLast,
+                                     window.x, colEnd, opts);
+    });
+}
+
+// Generates rows [rowStart, rowEnd) of a fixed column range, "data" points
+// to the first cell of "rowStart" and rows are "stride" floats apart
+using NamiRowFunc = std::function<NamiMinMax(float* data, size_t stride,
+                                             int rowStart, int rowEnd)>;
+
+// Row function of any column range [tileColBegin, tileColEnd) inside the
+// range it was made for, samplers and tables are shared by the ranges
+using NamiTileFunc = std::function<NamiMinMax(float* data, size_t stride,
+                                              int rowStart, int rowEnd,
+                                              int tileColBegin, int tileColEnd)>;
+
+// Sampler type is resolved once here, the returned function runs the
+// specialized loop of columns inside [colBegin, colEnd)
+inline static NamiTileFunc MakeTileFunc(const NamiGenOptions& opts,
+                                        int colBegin, int colEnd)
+{
+    NamiWallMask mask = GenWallMask(opts);
+    NamiSimdLevel level = ResolveSimdLevel(opts.simd);
+    if(level != NamiSimdLevel::SCALAR)
+    {
+        NamiSimdParams params = GenSimdParams(opts);
+        return [=](float* data, size_t stride, int rowStart, int rowEnd,
+                   int tileColBegin, int tileColEnd)
+        {
+            return GenerateRowsSimd(data, stride, rowStart, rowEnd, tileColBegin, tileColEnd,
+                                    opts, mask, params, level);
+        };
+    }
+
+    NamiTileFunc result;
+    auto generate = [&](const auto& sampler)
+    {
+        using Sampler = std::decay_t<decltype(sampler)>;
+        if(Sampler::SAMPLE_DOMAIN == NamiSampleDomain::X)
+        {
+            // Profile is evaluated once per column, rows are copied
+            auto cachedRow = std::make_shared<std::vector<float>>(colEnd - colBegin);
+            NamiMinMax cachedMinMax = GenerateRows(cachedRow->data(), cachedRow->size(),
+                                                   mask.rowStart, mask.rowStart + 1,
+                                                   colBegin, colEnd, opts, mask, sampler);
+            result = [=](float* data, size_t stride, int rowStart, int rowEnd,
+                         int tileColBegin, int tileColEnd)
+            {
+                const float* row = cachedRow->data() + (tileColBegin - colBegin);
+                int width = tileColEnd - tileColBegin;
+                NamiMinMax rowMinMax = cachedMinMax;
+                if(tileColBegin != colBegin || tileColEnd != colEnd)
+                {
+                    rowMinMax = namiMinMaxEmpty;
+                    for(int x = 0; x < width; x++)
+                        MergeMinMax(rowMinMax, NamiMinMax{row[x], row[x]});
+                }
+                return GenerateRowsCached(data, stride, rowStart, rowEnd, opts, mask,
+                                          row, width, rowMinMax);
+            };
+            return;
+        }
+        result = [=](float* data, size_t stride, int rowStart, int rowEnd,
+                     int tileColBegin, int tileColEnd)
+        {
+            return GenerateRows(data, stride, rowStart, rowEnd, tileColBegin, tileColEnd,
+                                opts, mask, sampler);
+        };
+    };
+    if(!DispatchLUTSampler(opts, generate))
+        DispatchSampler(opts, generate);
+    return result;
+}
+
+// Row function of the whole range [colBegin, colEnd)
+inline static NamiRowFunc MakeRowFunc(const NamiGenOptions& opts,
+                                      int colBegin, int colEnd)
+{
+    NamiTileFunc tileFunc = MakeTileFunc(opts, colBegin, colEnd);
+    return [=](float* data, size_t stride, int rowStart, int rowEnd)
+    {
+        return tileFunc(data, stride, rowStart, rowEnd, colBegin, colEnd);
+    };
+}
+
+inline static NamiRowFunc MakeReferenceRowFunc(const NamiGenOptions& opts,
+                                               int colBegin, int colEnd)
+{
+    return [=](float* data, size_t stride, int rowStart, int rowEnd)
+    {
+        return GenerateRowsReference(data, stride, rowStart, rowEnd,
+                                     colBegin, colEnd, opts);
+    };
+}
+
+inline static NamiMinMax GenerateWindow(float* data, size_t stride,
+                                        const NamiRect& window,
+                                        const NamiGenOptions& opts,
+                                        NamiThreadPool& pool)
+{
+    int rowBegin = window.y;
+    NamiRowFunc rowFunc = MakeRowFunc(opts, window.x, window.x + window.width);
+    return GenerateTiles(rowBegin, window.y + window.height, pool, [&](int rowStart, int rowLast)
+    {
+        float* rows = data + static_cast<size_t>(rowStart - rowBegin) * stride;
+        return rowFunc(rows, stride, rowStart, rowLast);
+    });
+}
+
+// Generates rows [rowBegin, rowEnd) of the grid
+// "data" points to the start of the row "rowBegin"
+inline static NamiMinMax GenerateBandReference(float* data,
+                                               int rowBegin, int rowEnd,
+                                               const NamiGenOptions& opts,
+                                               NamiThreadPool& pool)
+{
+    NamiRect band = {0, rowBegin, opts.sizeX, rowEnd - rowBegin};
+    return GenerateWindowReference(data, opts.sizeX, band, opts, pool);
+}
+
+inline static NamiMinMax GenerateBand(float* data,
+                                      int rowBegin, int rowEnd,
+                                      const NamiGenOptions& opts,
+                                      NamiThreadPool& pool)
+{
+    NamiRect band = {0, rowBegin, opts.sizeX, rowEnd - rowBegin};
+    return GenerateWindow(data, opts.sizeX, band, opts, pool);
+}
+
+inline static NamiMinMax GenerateGridReference(float* data,
+                                               const NamiGenOptions& opts,
+                                               NamiThreadPool& pool)
+{
+    return GenerateBandReference(data, 0, opts.sizeY, opts, pool);
+}
+
+inline static NamiMinMax GenerateGrid(float* data,
+                                      const NamiGenOptions& opts,
+                                      NamiThreadPool& pool)
+{
+    return GenerateBand(data, 0, opts.sizeY, opts, pool);
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include "NamiGenOptions.h"
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #ifdef __linux__
+        #include <sys/syscall.h>
+    #endif
+#endif
+
+// Grid storage without value initialization
+// Pages are mapped but not touched, the generators write every cell from
+// the pool jobs so each page is first touched (and placed on the NUMA node)
+// by the worker that generates it
+// "THP" asks for transparent huge pages on an aligned mapping, "LARGE" maps
+// explicit huge pages (hugetlbfs / SeLockMemoryPrivilege) and falls back to
+// THP if none are available
+// "interleave" spreads the pages round robin over the online NUMA nodes
+// (Linux only), generation and the writer then use the bandwidth of every
+// node instead of the first toucher's
+class NamiGridMemory
+{
+    private:
+        static constexpr size_t HUGE_PAGE_SIZE = size_t(2) * 1024 * 1024;
+
+        char*                   base;
+        size_t                  mappedSize;
+        float*                  data;
+        size_t                  capacity;
+        NamiGenPages            pages;
+        bool                    interleave;
+
+        bool                    Map(size_t bytes, NamiGenPages pageType);
+
+    public:
+        // Constructors & Destructor
+                                NamiGridMemory();
+                                NamiGridMemory(const NamiGridMemory&) = delete;
+        NamiGridMemory&         operator=(const NamiGridMemory&) = delete;
+                                ~NamiGridMemory();
+
+        // Storage only grows for the same page options, values are undefined
+        // after an allocation
+        bool                    Allocate(size_t count, NamiGenPages pages,
+                                         bool interleave);
+        void                    Release();
+
+        float*                  Data() { return data; }
+        const float*            Data() const { return data; }
+        size_t                  Capacity() const { return capacity; }
+};
+
+// Online NUMA nodes as a bit mask, empty if the system has a single node
+inline static std::vector<unsigned long> NumaOnlineNodes()
+{
+    std::vector<unsigned long> mask;
+    #ifdef __linux__
+        std::ifstream file("/sys/devices/system/node/online");
+        std::string line;
+        if(!std::getline(file, line)) return mask;
+
+        // Ranges as "0-1,3"
+        static constexpr int BITS = static_cast<int>(sizeof(unsigned long) * 8);
+        int nodeCount = 0;
+        size_t pos = 0;
+        while(pos < line.size())
+        {
+            size_t end = line.find(',', pos);
+            if(end == std::string::npos) end = line.size();
+            std::string range = line.substr(pos, end - pos);
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for(int n = first; n <= last; n++)
+            {
+                if(static_cast<size_t>(n / BITS) >= mask.size()) mask.resize(n / BITS + 1, 0);
+                mask[n / BITS] |= 1ul << (n % BITS);
+                nodeCount++;
+            }
+            pos = end + 1;
+        }
+        if(nodeCount < 2) mask.clear();
+    #endif
+    return mask;
+}
+
+inline NamiGridMemory::NamiGridMemory()
+    : base(nullptr)
+    , mappedSize(0)
+    , data(nullptr)
+    , capacity(0)
+    , pages(NamiGenPages::INVALID)
+    , interleave(false)
+{}
+
+inline NamiGridMemory::~NamiGridMemory()
+{
+    Release();
+}
+
+inline bool NamiGridMemory::Map(size_t bytes, NamiGenPages pageType)
+{
+    #ifdef _WIN32
+        DWORD type = MEM_RESERVE | MEM_COMMIT;
+        size_t size = bytes;
+        if(pageType == NamiGenPages::LARGE)
+        {
+            size_t largePage = GetLargePageMinimum();
+            if(largePage == 0) return false;
+            size = (bytes + largePage - 1) / largePage * largePage;
+            type |= MEM_LARGE_PAGES;
+        }
+        // Committed pages are backed on the first touch
+        void* ptr = VirtualAlloc(nullptr, size, type, PAGE_READWRITE);
+        if(ptr == nullptr) return false;
+        base = static_cast<char*>(ptr);
+        mappedSize = size;
+        data = reinterpret_cast<float*>(base);
+    #else
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        size_t size = bytes;
+        if(pageType == NamiGenPages::LARGE)
+        {
+            #ifdef MAP_HUGETLB
+                size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+                flags |= MAP_HUGETLB;
+            #else
+                return false;
+            #endif
+        }
+        // THP only backs 2MB aligned ranges, over map and trim the ends
+        else if(pageType == NamiGenPages::THP)
+            size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE + HUGE_PAGE_SIZE;
+
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if(ptr == MAP_FAILED) return false;
+        char* mapped = static_cast<char*>(ptr);
+
+        if(pageType == NamiGenPages::THP)
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(mapped);
+            size_t head = (HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE;
+            size_t body = size - HUGE_PAGE_SIZE;
+            if(head > 0) munmap(mapped, head);
+            size_t tail = size - head - body;
+            if(tail > 0) munmap(mapped + head + body, tail);
+            mapped += head;
+            size = body;
+            #ifdef MADV_HUGEPAGE
+                madvise(mapped, size, MADV_HUGEPAGE);
+            #endif
+        }
+        base = mapped;
+        mappedSize = size;
+        data = reinterpret_cast<float*>(base);
+    #endif
+    return true;
+}
+
+inline bool NamiGridMemory::Allocate(size_t count, NamiGenPages pageType,
+                                     bool interleaved)
+{
+    if(count <= capacity && pageType == pages && interleaved == interleave)
+        return true;
+
+    Release();
+    if(count == 0) return true;
+    size_t bytes = count * sizeof(float);
+    if(!Map(bytes, pageType))
+    {
+        if(pageType != NamiGenPages::LARGE || !Map(bytes, NamiGenPages::THP))
+            return false;
+        static bool warned = false;
+        if(!warned)
+            std::cout << "Memory\t: no large pages available, using thp" << std::endl;
+        warned = true;
+    }
+
+    #if defined(__linux__) && defined(SYS_mbind)
+        if(interleaved)
+        {
+            // Policy is set before the first touch, a failure keeps the
+            // default first touch placement
+            static constexpr int NAMI_MPOL_INTERLEAVE = 3;
+            std::vector<unsigned long> nodes = NumaOnlineNodes();
+            if(!nodes.empty())
+                syscall(SYS_mbind, base, mappedSize, NAMI_MPOL_INTERLEAVE,
+                        nodes.data(), nodes.size() * sizeof(unsigned long) * 8 + 1, 0);
+        }
+    #endif
+
+    capacity = count;
+    pages = pageType;
+    interleave = interleaved;
+    return true;
+}
+
+inline void NamiGridMemory::Release()
+{
+    #ifdef _WIN32
+        if(base) VirtualFree(base, 0, MEM_RELEASE);
+    #else
+        if(base) munmap(base, mappedSize);
+    #endif
+    base = nullptr;
+    mappedSize = 0;
+    data = nullptr;
+    capacity = 0;
+    pages = NamiGenPages::INVALID;
+    interleave = false;
+}
@@ -0,0 +1,1517 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenWriters.h"
+#include "NamiGenStream.h"
+#include "NamiGenTiff.h"
+#include "NamiGenTiming.h"
+#include "NamiGenAPI.h"
+#include "NamiGenNest.h"
+#include "NamiGenPrecision.h"
+#include "NamiGenLayers.h"
+#include "NamiGenSources.h"
+#include "NamiGenCache.h"
+#include "NamiGenReaders.h"
+#include "NamiGenFrames.h"
+#include "NamiGenDerived.h"
+#include "NamiGenArch.h"
+#include "NamiGenTiledGrid.h"
+#include "NamiGenGridMemory.h"
+
+// Single generation request, options and the run flags
+struct NamiGenJob
+{
+    NamiGenOptions  options;
+    // Without the extension
+    std::string     outputFileName;
+    bool            verify;
+    bool            mapOutput;
+    bool            stream;
+    bool            profile;
+    std::string     batchFile;
+    // Largest benchmark grid size, 0 is a normal run
+    int             benchSize;
+    // Generated region, zero width is the whole grid
+    NamiRect        window;
+    // Region is split into tilesX * tilesY files
+    int             tilesX, tilesY;
+    // Child grids generated after the parent
+    std::vector<NamiNest> nests;
+    // Layer switches, one entry per layer (see "BuildLayers")
+    std::vector<std::string> layers;
+    // Superposed wave sources, replace the profile of "type"
+    std::vector<NamiWaveSource> sources;
+    // Output cache directory, empty disables it
+    std::string     cacheDir;
+    // Existing grid that the layers are applied to, empty generates a new one
+    std::string     inputFile;
+    // Wave frames "frameDt" seconds apart, 0 writes a single grid
+    int             frameCount;
+    float           frameDt;
+    // Derived field flags reduced in the generation pass, see "NamiGenDerived.h"
+    int             derived;
+    double          courant;
+    // Random differential cases, 0 is a normal run
+    int             fuzzCount;
+    unsigned int    fuzzSeed;
+    // Grid memory layout while generating, files are always row major
+    NamiGenLayout   layout;
+    // Grid memory pages, interleaved over the NUMA nodes if set
+    NamiGenPages    pages;
+    bool            interleave;
+    // Output backend of the grid file, direct bypasses the page cache
+    NamiGenIO       io;
+    bool            direct;
+};
+
+inline static NamiGenJob DefaultJob()
+{
+    return NamiGenJob{namiOptsDefault, "output", false, false, false, false, "", 0,
+                      NamiRect{0, 0, 0, 0}, 1, 1, {}, {}, {}, "", "", 0, 0.0f, 0, 1.0, 0, 1,
+                      NamiGenLayout::ROWS, NamiGenPages::THP, false,
+                      NamiGenIO::OFSTREAM, false};
+}
+
+// Region of the grid that the job generates
+inline static NamiRect JobWindow(const NamiGenJob& job)
+{
+    return (job.window.width == 0) ? NamiFullWindow(job.options) : job.window;
+}
+
+// Numeric switch values, the whole token has to be a number
+// Throws std::invalid_argument with the token otherwise
+template<class T, class Convert>
+inline static T ArgToNumber(const std::string& arg, Convert convert)
+{
+    size_t end = 0;
+    T value = T(0);
+    try { value = static_cast<T>(convert(arg, &end)); }
+    catch(const std::logic_error&) { end = 0; }
+    if(end == 0 || end != arg.size()) throw std::invalid_argument(arg);
+    return value;
+}
+
+inline static int ArgToInt(const std::string& arg)
+{
+    return ArgToNumber<int>(arg, [](const std::string& s, size_t* e) { return std::stoi(s, e); });
+}
+
+inline static unsigned int ArgToUInt(const std::string& arg)
+{
+    // stoul accepts a sign, "-1" would wrap around
+    if(!arg.empty() && arg[0] == '-') throw std::invalid_argument(arg);
+    return ArgToNumber<unsigned int>(arg, [](const std::string& s, size_t* e) { return std::stoul(s, e); });
+}
+
+inline static float ArgToFloat(const std::string& arg)
+{
+    return ArgToNumber<float>(arg, [](const std::string& s, size_t* e) { return std::stof(s, e); });
+}
+
+inline static double ArgToDouble(const std::string& arg)
+{
+    return ArgToNumber<double>(arg, [](const std::string& s, size_t* e) { return std::stod(s, e); });
+}
+
+inline static bool ParseSwitches(const std::vector<std::string>& args, NamiGenJob& job);
+
+// Consumes switches and their values on top of "job"
+// Prints the reason and returns false on invalid args
+inline static bool ParseArgs(const std::vector<std::string>& args, NamiGenJob& job)
+{
+    try
+    {
+        return ParseSwitches(args, job);
+    }
+    catch(const std::invalid_argument& e)
+    {
+        std::cout << "Invalid value \"" << e.what() << "\"" << std::endl;
+        return false;
+    }
+}
+
+inline static bool ParseSwitches(const std::vector<std::string>& args, NamiGenJob& job)
+{
+    for(int i = 0; i < static_cast<int>(args.size()); i++)
+    {
+        const std::string& arg = args[i];
+
+        // Traverse Switches
+        int argId = 0;
+        for(const std::string& sw : switches)
+        {
+            if(arg == sw)
+            {
+                // Found a valid switch
+                // Check if we can consume enough args
+                if(static_cast<int>(args.size()) - i <= switchArgCounts[argId])
+                {
+                    // not enough arg count to open this
+                    std::cout << "Invalid arg count" << std::endl;
+                    return false;
+                }
+                else
+                {
+                    // Arg Parse
+                    if(arg == switches[0]) // -l
+                    {
+                        NamiGenType type = GenTypeToEnum(args[i + 1]);
+                        if(type == NamiGenType::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[0] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.options.type = type;
+                    }
+                    else if(arg == switches[1]) // -o
+                    {
+                        NamiGenOut outType = GenOutToEnum(args[i + 1]);
+                        if(outType == NamiGenOut::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[1] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.options.output = outType;
+                    }
+                    else if(arg == switches[2]) // -lat
+                    {
+                        job.options.latMin = ArgToDouble(args[i + 1]);
+                        job.options.latMax = ArgToDouble(args[i + 2]);
+                    }
+                    else if(arg == switches[3]) // -lon
+                    {
+                        job.options.lonMin = ArgToDouble(args[i + 1]);
+                        job.options.lonMax = ArgToDouble(args[i + 2]);
+                    }
+                    else if(arg == switches[4]) // -size
+                    {
+                        job.options.sizeX = ArgToInt(args[i + 1]);
+                        job.options.sizeY = ArgToInt(args[i + 2]);
+                    }
+                    else if(arg == switches[5]) // -gap
+                    {
+                        job.options.gapBottom = ArgToInt(args[i + 1]);
+                        job.options.gapTop = ArgToInt(args[i + 2]);
+                    }
+                    else if(arg == switches[6]) // -z
+                    {
+                        job.options.zLand = ArgToFloat(args[i + 1]);
+                        job.options.zBottom = ArgToFloat(args[i + 2]);
+                    }
+                    else if(arg == switches[7]) // -wall
+                    {
+                        job.options.hasWalls = true;
+                    }
+                    else if(arg == switches[8]) // -w
+                    {
+                        job.options.wallWidth = ArgToInt(args[i + 1]);
+                    }
+                    else if(arg == switches[9]) // -n
+                    {
+                        job.outputFileName = args[i + 1];
+                    }
+                    else if(arg == switches[10]) // -tana
+                    {
+                        job.options.tana = ArgToFloat(args[i + 1]);
+                    }
+                    else if(arg == switches[11]) // -threads
+                    {
+                        job.options.threadCount = ArgToInt(args[i + 1]);
+                    }
+                    else if(arg == switches[12]) // -simd
+                    {
+                        NamiGenSimd simd = GenSimdToEnum(args[i + 1]);
+                        if(simd == NamiGenSimd::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[12] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.options.simd = simd;
+                    }
+                    else if(arg == switches[13]) // -verify
+                    {
+                        job.verify = true;
+                    }
+                    else if(arg == switches[14]) // -mmap
+                    {
+                        job.mapOutput = true;
+                    }
+                    else if(arg == switches[15]) // -stream
+                    {
+                        job.stream = true;
+                    }
+                    else if(arg == switches[16]) // -compress
+                    {
+                        NamiGenCompress compress = GenCompressToEnum(args[i + 1]);
+                        if(compress == NamiGenCompress::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[16] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.options.compress = compress;
+                    }
+                    else if(arg == switches[17]) // -batch
+                    {
+                        job.batchFile = args[i + 1];
+                    }
+                    else if(arg == switches[18]) // -lut
+                    {
+                        job.options.lutError = ArgToFloat(args[i + 1]);
+                    }
+                    else if(arg == switches[19]) // -profile
+                    {
+                        job.profile = true;
+                    }
+                    else if(arg == switches[20]) // -bench
+                    {
+                        job.benchSize = ArgToInt(args[i + 1]);
+                    }
+                    else if(arg == switches[21]) // -window
+                    {
+                        job.window.x = ArgToInt(args[i + 1]);
+                        job.window.y = ArgToInt(args[i + 2]);
+                        job.window.width = ArgToInt(args[i + 3]);
+                        job.window.height = ArgToInt(args[i + 4]);
+                    }
+                    else if(arg == switches[22]) // -tiles
+                    {
+                        job.tilesX = ArgToInt(args[i + 1]);
+                        job.tilesY = ArgToInt(args[i + 2]);
+                    }
+                    else if(arg == switches[23]) // -nest
+                    {
+                        NamiNest nest;
+                        nest.ratio = ArgToInt(args[i + 1]);
+                        nest.extent.x = ArgToInt(args[i + 2]);
+                        nest.extent.y = ArgToInt(args[i + 3]);
+                        nest.extent.width = ArgToInt(args[i + 4]);
+                        nest.extent.height = ArgToInt(args[i + 5]);
+                        job.nests.push_back(nest);
+                    }
+                    else if(arg == switches[24]) // -precision
+                    {
+                        NamiGenPrecision precision = GenPrecisionToEnum(args[i + 1]);
+                        if(precision == NamiGenPrecision::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[24] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.options.precision = precision;
+                    }
+                    else if(arg == switches[25]) // -layer
+                    {
+                        job.layers.push_back(args[i + 1]);
+                    }
+                    else if(arg == switches[26]) // -layers
+                    {
+                        // One layer per line, '#' starts a comment
+                        std::ifstream file(args[i + 1]);
+                        if(!file)
+                        {
+                            std::cout << "Unable to open layer file \"" << args[i + 1] << "\"" << std::endl;
+                            return false;
+                        }
+                        std::string line;
+                        while(std::getline(file, line))
+                        {
+                            line = line.substr(0, line.find('#'));
+                            if(line.find_first_not_of(" \t\r") != std::string::npos)
+                                job.layers.push_back(line);
+                        }
+                    }
+                    else if(arg == switches[27]) // -sources
+                    {
+                        if(!LoadSources(args[i + 1], job.sources)) return false;
+                    }
+                    else if(arg == switches[28]) // -cache
+                    {
+                        job.cacheDir = args[i + 1];
+                    }
+                    else if(arg == switches[29]) // -input
+                    {
+                        // Grid size and lat/lon are of the input
+                        NamiGridHeader header;
+                        if(!ReadGridHeader(args[i + 1], header))
+                        {
+                            std::cout << "Unable to read grid \"" << args[i + 1] << "\"" << std::endl;
+                            return false;
+                        }
+                        job.inputFile = args[i + 1];
+                        job.options.sizeX = header.sizeX;
+                        job.options.sizeY = header.sizeY;
+                        job.options.latMin = header.latMin;
+                        job.options.latMax = header.latMax;
+                        job.options.lonMin = header.lonMin;
+                        job.options.lonMax = header.lonMax;
+                    }
+                    else if(arg == switches[30]) // -frames
+                    {
+                        job.frameCount = ArgToInt(args[i + 1]);
+                    }
+                    else if(arg == switches[31]) // -dt
+                    {
+                        job.frameDt = ArgToFloat(args[i + 1]);
+                    }
+                    else if(arg == switches[32]) // -derived
+                    {
+                        int derived = DerivedToFlags(args[i + 1]);
+                        if(derived < 0)
+                        {
+                            std::cout << "Invalid " << switches[32] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.derived = derived;
+                    }
+                    else if(arg == switches[33]) // -courant
+                    {
+                        job.courant = ArgToDouble(args[i + 1]);
+                    }
+                    else if(arg == switches[34]) // -fuzz
+                    {
+                        job.fuzzCount = ArgToInt(args[i + 1]);
+                    }
+                    else if(arg == switches[35]) // -seed
+                    {
+                        job.fuzzSeed = ArgToUInt(args[i + 1]);
+                    }
+                    else if(arg == switches[36]) // -layout
+                    {
+                        NamiGenLayout layout = GenLayoutToEnum(args[i + 1]);
+                        if(layout == NamiGenLayout::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[36] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.layout = layout;
+                    }
+                    else if(arg == switches[37]) // -pages
+                    {
+                        NamiGenPages pages = GenPagesToEnum(args[i + 1]);
+                        if(pages == NamiGenPages::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[37] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.pages = pages;
+                    }
+                    else if(arg == switches[38]) // -interleave
+                    {
+                        job.interleave = true;
+                    }
+                    else if(arg == switches[39]) // -io
+                    {
+                        NamiGenIO io = GenIOToEnum(args[i + 1]);
+                        if(io == NamiGenIO::INVALID)
+                        {
+                            std::cout << "Invalid " << switches[39] << " switch" << std::endl;
+                            return false;
+                        }
+                        job.io = io;
+                    }
+                    else if(arg == switches[40]) // -direct
+                    {
+                        job.direct = true;
+                    }
+                    i += switchArgCounts[argId];
+                    break;
+                }
+            }
+            argId++;
+        }
+        if(argId == static_cast<int>(switches.size()))
+        {
+            std::cout << "Invalid Switch" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Resolves the layer switches of "job" on top of its options
+// A layer takes the profile switches (-t, -gap, -z, -wall, -w, -tana, -lut, -simd),
+// "-op <set|min|max|add>", "-t wall" for a border mask and "-t clamp" to clamp
+// to the -z range
+// Prints the reason and returns false on invalid layers
+inline static bool BuildLayers(const NamiGenJob& job,
+                               std::vector<NamiLayer>& layers)
+{
+    static const std::vector<std::string> layerSwitches =
+    {
+        switches[0], switches[5], switches[6], switches[7],
+        switches[8], switches[10], switches[12], switches[18],
+        switches[27]
+    };
+
+    layers.clear();
+    for(const std::string& spec : job.layers)
+    {
+        std::vector<std::string> args;
+        std::istringstream stream(spec);
+        std::string token;
+        while(stream >> token) args.push_back(token);
+
+        NamiLayer layer = {job.options, NamiLayerOp::INVALID, NamiLayerKind::PROFILE, {}};
+        std::vector<std::string> profileArgs;
+        for(size_t i = 0; i < args.size(); i++)
+        {
+            bool hasValue = (i + 1 < args.size());
+            if(args[i] == "-op" && hasValue)
+            {
+                layer.op = LayerOpToEnum(args[++i]);
+                if(layer.op == NamiLayerOp::INVALID)
+                {
+                    std::cout << "Invalid layer op \"" << args[i] << "\"" << std::endl;
+                    return false;
+                }
+            }
+            else if(args[i] == switches[0] && hasValue &&
+                    (args[i + 1] == "wall" || args[i + 1] == "clamp"))
+            {
+                layer.kind = (args[++i] == "wall") ? NamiLayerKind::WALL : NamiLayerKind::CLAMP;
+            }
+            else
+            {
+                bool gridSwitch = (std::find(switches.begin(), switches.end(), args[i]) != switches.end() &&
+                                   std::find(layerSwitches.begin(), layerSwitches.end(), args[i]) == layerSwitches.end());
+                if(gridSwitch)
+                {
+                    std::cout << "Switch " << args[i] << " can not be used in a layer" << std::endl;
+                    return false;
+                }
+                profileArgs.push_back(args[i]);
+            }
+        }
+
+        NamiGenJob layerJob = job;
+        layerJob.sources.clear();
+        if(!ParseArgs(profileArgs, layerJob))
+        {
+            std::cout << "Invalid layer \"" << spec << "\"" << std::endl;
+            return false;
+        }
+        layer.options = layerJob.options;
+        layer.sources = std::move(layerJob.sources);
+        if(layer.op == NamiLayerOp::INVALID)
+            layer.op = DefaultLayerOp(layers, layer, !job.inputFile.empty());
+        layers.push_back(layer);
+    }
+    return true;
+}
+
+inline static std::string OutputExtension(NamiGenOut output)
+{
+    static const char* extensions[] = {"", ".grd", "_bin.grd", "_7.grd", ".tif"};
+    return extensions[static_cast<int>(output)];
+}
+
+// Checks option combinations that can not be generated
+inline static bool ValidateJob(const NamiGenJob& job)
+{
+    NamiRect window = JobWindow(job);
+    if(!NamiWindowValid(window, job.options))
+    {
+        std::cout << "Window should be non empty and inside the grid" << std::endl;
+        return false;
+    }
+    if(job.tilesX < 1 || job.tilesY < 1 ||
+       job.tilesX > window.width || job.tilesY > window.height)
+    {
+        std::cout << "Tile counts should be in [1, window size]" << std::endl;
+        return false;
+    }
+    if(job.stream && (job.window.width != 0 || job.tilesX * job.tilesY > 1))
+    {
+        std::cout << "Stream mode does not support windows or tiles" << std::endl;
+        return false;
+    }
+    // A negative table error would also tighten the -verify bound
+    if(job.options.lutError < 0.0f)
+    {
+        std::cout << "Invalid -lut, the table error should not be negative" << std::endl;
+        return false;
+    }
+    if(job.options.precision != NamiGenPrecision::F32)
+    {
+        if(job.options.output != NamiGenOut::GRD_7 &&
+           job.options.output != NamiGenOut::TIFF)
+        {
+            std::cout << "Storage precisions other than f32 need grd7 or tiff output" << std::endl;
+            return false;
+        }
+        // Surfer 7 stores doubles, a 16-bit grid would only be widened back
+        if(job.options.output == NamiGenOut::GRD_7 &&
+           job.options.precision != NamiGenPrecision::F64)
+        {
+            std::cout << "grd7 stores doubles, half and q16 need tiff output" << std::endl;
+            return false;
+        }
+        if(!job.nests.empty())
+        {
+            std::cout << "Nested grids are stored as f32" << std::endl;
+            return false;
+        }
+    }
+    if(!job.nests.empty() && (job.stream || job.window.width != 0 ||
+                              job.tilesX * job.tilesY > 1))
+    {
+        std::cout << "Nested grids need the whole parent grid (no stream, window or tiles)" << std::endl;
+        return false;
+    }
+    for(const NamiNest& nest : job.nests)
+    {
+        if(!NestValid(nest, job.options))
+        {
+            std::cout << "Nest extent should be inside the grid with at least 2x2 nodes"
+                      << " and ratio should be positive" << std::endl;
+            return false;
+        }
+        if(job.options.output == NamiGenOut::GRD_BIN &&
+           !GRDBinSizeValid(NestOptions(job.options, nest)))
+        {
+            std::cout << "Nested grid exceeds binary grd limit ("
+                      << NAMI_GRD_BIN_MAX_SIZE << "), use grd output" << std::endl;
+            return false;
+        }
+    }
+    if(!job.layers.empty())
+    {
+        std::vector<NamiLayer> layers;
+        if(!BuildLayers(job, layers)) return false;
+        if(job.stream || !job.nests.empty() ||
+           job.options.precision != NamiGenPrecision::F32)
+        {
+            std::cout << "Layers do not support stream, nested grids or precisions other than f32" << std::endl;
+            return false;
+        }
+        if(!job.sources.empty())
+        {
+            std::cout << "Sources of a layer job should be given in a layer" << std::endl;
+            return false;
+        }
+        for(const NamiLayer& layer : layers)
+        {
+            if(!SourcesValid(layer.sources, layer.options))
+            {
+                std::cout << "Source depths should be positive" << std::endl;
+                return false;
+            }
+            if(layer.options.lutError < 0.0f)
+            {
+                std::cout << "Invalid -lut, the table error should not be negative" << std::endl;
+                return false;
+            }
+        }
+    }
+    if(!job.inputFile.empty())
+    {
+        NamiGridHeader header;
+        if(!ReadGridHeader(job.inputFile, header) ||
+           header.sizeX != job.options.sizeX || header.sizeY != job.options.sizeY)
+        {
+            std::cout << "Input grid size can not be changed" << std::endl;
+            return false;
+        }
+        // Output is truncated while the input is mapped
+        std::error_code error;
+        std::string outputFileName = job.outputFileName + OutputExtension(job.options.output);
+        if(std::filesystem::weakly_canonical(outputFileName, error) ==
+           std::filesystem::weakly_canonical(job.inputFile, error))
+        {
+            std::cout << "Output should be a different file than the input grid" << std::endl;
+            return false;
+        }
+        if(job.stream || !job.nests.empty() || job.window.width != 0 ||
+           job.tilesX * job.tilesY > 1 || !job.sources.empty() ||
+           job.options.precision != NamiGenPrecision::F32)
+        {
+            std::cout << "Input grids are transformed as a whole f32 grid with layers"
+                      << " (no stream, nests, window, tiles or sources)" << std::endl;
+            return false;
+        }
+    }
+    if(job.frameCount != 0)
+    {
+        if(job.frameCount < 0 || !(job.frameDt > 0.0f))
+        {
+            std::cout << "Frame count and -dt should be positive" << std::endl;
+            return false;
+        }
+        if(!IsFrameType(job.options.type))
+        {
+            std::cout << "Frames need a plane wave (wavehorizontal, wavevertical, waveempty)" << std::endl;
+            return false;
+        }
+        if(job.stream || !job.nests.empty() || !job.layers.empty() ||
+           !job.sources.empty() || !job.inputFile.empty() ||
+           job.options.precision != NamiGenPrecision::F32)
+        {
+            std::cout << "Frames do not support stream, nests, layers, sources, input grids"
+                      << " or precisions other than f32" << std::endl;
+            return false;
+        }
+    }
+    if(job.derived != 0)
+    {
+        if(job.stream || !job.layers.empty() || !job.sources.empty() ||
+           !job.inputFile.empty() || job.frameCount > 0 ||
+           job.options.precision != NamiGenPrecision::F32)
+        {
+            std::cout << "Derived fields need a single f32 profile grid"
+                      << " (no stream, layers, sources, input grids or frames)" << std::endl;
+            return false;
+        }
+        if(!(job.courant > 0.0))
+        {
+            std::cout << "Courant number should be positive" << std::endl;
+            return false;
+        }
+    }
+    if(job.layout == NamiGenLayout::TILED &&
+       (job.stream || job.mapOutput || !job.nests.empty() || !job.layers.empty() ||
+        !job.sources.empty() || !job.inputFile.empty() || job.frameCount > 0 ||
+        job.derived != 0 || job.options.precision != NamiGenPrecision::F32))
+    {
+        std::cout << "Tiled layout needs a single f32 profile grid (no stream, mmap, nests,"
+                  << " layers, sources, input grids, frames or derived fields)" << std::endl;
+        return false;
+    }
+    if(job.io != NamiGenIO::OFSTREAM &&
+       (job.mapOutput || job.layout == NamiGenLayout::TILED || !job.layers.empty() ||
+        !job.inputFile.empty() || job.frameCount > 0 ||
+        job.options.precision != NamiGenPrecision::F32 ||
+        job.options.output == NamiGenOut::TIFF))
+    {
+        std::cout << "Asynchronous output writes row major f32 grd, grdbin and grd7 grids"
+                  << " (no mmap, tiled layout, layers, input grids, frames or tiff)" << std::endl;
+        return false;
+    }
+    if(job.direct && job.io == NamiGenIO::OFSTREAM)
+    {
+        std::cout << "Direct output needs \"-io uring\" or \"-io pwrite\"" << std::endl;
+        return false;
+    }
+    if(!job.sources.empty())
+    {
+        if(job.stream || !job.nests.empty() ||
+           job.options.precision != NamiGenPrecision::F32)
+        {
+            std::cout << "Sources do not support stream, nested grids or precisions other than f32" << std::endl;
+            return false;
+        }
+        if(!SourcesValid(job.sources, job.options))
+        {
+            std::cout << "Source depths should be positive" << std::endl;
+            return false;
+        }
+    }
+    // Tiles are checked one by one after the split
+    if(job.options.output == NamiGenOut::GRD_BIN &&
+       job.tilesX * job.tilesY == 1 &&
+       !GRDBinSizeValid(NamiWindowOptions(job.options, window)))
+    {
+        std::cout << "Size exceeds binary grd limit ("
+                  << NAMI_GRD_BIN_MAX_SIZE << "), use grd output" << std::endl;
+        return false;
+    }
+    if(job.stream && (job.options.output == NamiGenOut::GRD_7 ||
+                      job.options.output == NamiGenOut::TIFF))
+    {
+        std::cout << "Stream mode supports grd and grdbin outputs only" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Compares generated values against the reference samplers and prints the result
+// Profile tables are checked against their absolute error bound,
+// rest against the SIMD ULP tolerance
+inline static bool VerifyGenerated(const float* reference, const float* data,
+                                   size_t count, const NamiMinMax& refMinMax,
+                                   const NamiGenOptions& opts)
+{
+    bool pass;
+    if(ResolveSimdLevel(opts.simd) == NamiSimdLevel::SCALAR &&
+       UseProfileLUT(opts))
+    {
+        // Table error bound plus float rounding at the output magnitude
+        float magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+        float bound = opts.lutError + magnitude * FLT_EPSILON * SimdUlpTolerance(opts.type);
+        float error = MaxAbsError(reference, data, count);
+        pass = (error <= bound);
+        std::cout << "Verify\t: " << error << " abs error (bound "
+                  << bound << ") "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+    }
+    else
+    {
+        float tolerance = SimdUlpTolerance(opts.type);
+        float error = SimdUlpError(reference, data, count, refMinMax);
+        pass = (error <= tolerance);
+        std::cout << "Verify\t: " << error << " ULP (tolerance "
+                  << tolerance << ") "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+    }
+    return pass;
+}
+
+// Generates and writes the child grids of a job, "parent" is the generated
+// parent grid, children are named "<name>_nest<index>"
+inline static bool RunNests(const NamiGenJob& job,
+                            const float* parent,
+                            NamiThreadPool& pool,
+                            NamiStageTimes& times)
+{
+    std::vector<float> child;
+    for(size_t i = 0; i < job.nests.size(); i++)
+    {
+        NamiTimer timer;
+        const NamiNest& nest = job.nests[i];
+        NamiGenOptions fineOptions = RefineOptions(job.options, nest.ratio);
+        NamiGenOptions outOptions = NestOptions(job.options, nest);
+        NamiRect window = NestWindow(nest);
+        size_t cellCount = static_cast<size_t>(window.width) * window.height;
+
+        if(child.size() < cellCount) child.resize(cellCount);
+        GenerateWindow(child.data(), window.width, window, fineOptions, pool);
+        times.generate += timer.Elapsed();
+
+        // Samplers are verified before the parent values are injected
+        if(job.verify)
+        {
+            timer.Restart();
+            std::vector<float> refData(cellCount);
+            NamiMinMax refMinMax = GenerateWindowReference(refData.data(), window.width,
+                                                           window, fineOptions, pool);
+            bool pass = VerifyGenerated(refData.data(), child.data(), cellCount,
+                                        refMinMax, fineOptions);
+            times.verify += timer.Elapsed();
+            if(!pass) return false;
+        }
+
+        timer.Restart();
+        NamiMinMax minMax = InjectParent(child.data(), nest, parent, job.options.sizeX);
+        std::string fileName = job.outputFileName + "_nest" + std::to_string(i) +
+                               OutputExtension(outOptions.output);
+        if(!NamiWriteFile(fileName, NamiSpan<const float>(child.data(), cellCount),
+                          outOptions, minMax, pool))
+        {
+            std::cout << "Unable to write \"" << fileName << "\"" << std::endl;
+            return false;
+        }
+        times.write += timer.Elapsed();
+    }
+    return true;
+}
+
+// Generates and writes a job with a storage precision other than f32
+inline static bool RunStoredJob(const NamiGenJob& job,
+                                NamiThreadPool& pool,
+                                NamiStageTimes& times)
+{
+    NamiTimer timer;
+    const NamiGenOptions& namiOptions = job.options;
+    NamiRect window = JobWindow(job);
+    NamiGenOptions outOptions = NamiWindowOptions(namiOptions, window);
+    std::string outputFileName = job.outputFileName + OutputExtension(namiOptions.output);
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+
+    NamiStoredGrid grid;
+    GenerateStored(grid, window, namiOptions, pool);
+    times.generate = timer.Elapsed();
+
+    if(job.verify)
+    {
+        timer.Restart();
+        std::vector<float> refData(cellCount);
+        NamiMinMax refMinMax = GenerateWindowReference(refData.data(), window.width,
+                                                       window, namiOptions, pool);
+        // Storage rounding on top of the float generation bound
+        double magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+        double bound = StoredErrorBound(grid) + namiOptions.lutError +
+                       magnitude * FLT_EPSILON * SimdUlpTolerance(namiOptions.type);
+        double error = 0.0;
+        for(size_t i = 0; i < cellCount; i++)
+            error = std::max(error, std::abs(grid.Value(i) - refData[i]));
+        bool pass = (error <= bound);
+        std::cout << "Verify\t: " << error << " abs error (bound "
+                  << bound << ") "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+        times.verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+
+    timer.Restart();
+    if(!OutStored(grid, outOptions, outputFileName, pool))
+    {
+        std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+        return false;
+    }
+    times.write = timer.Elapsed();
+    return true;
+}
+
+// Generates a job into a tiled grid and writes it through the layout conversion
+inline static bool RunTiledJob(const NamiGenJob& job,
+                               NamiThreadPool& pool,
+                               NamiStageTimes& times)
+{
+    NamiTimer timer;
+    const NamiGenOptions& namiOptions = job.options;
+    NamiRect window = JobWindow(job);
+    NamiGenOptions outOptions = NamiWindowOptions(namiOptions, window);
+    std::string outputFileName = job.outputFileName + OutputExtension(namiOptions.output);
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+
+    NamiTiledGrid grid(job.pages, job.interleave);
+    NamiMinMax minMax = GenerateTiled(grid, window, namiOptions, pool);
+    times.generate = timer.Elapsed();
+
+    // Checked in row major order
+    std::vector<float> rows;
+    if(job.verify)
+    {
+        timer.Restart();
+        rows.resize(cellCount);
+        grid.CopyRows(rows.data(), 0, window.height);
+        std::vector<float> refData(cellCount);
+        NamiMinMax refMinMax = GenerateWindowReference(refData.data(), window.width,
+                                                       window, namiOptions, pool);
+        bool pass = VerifyGenerated(refData.data(), rows.data(), cellCount,
+                                    refMinMax, namiOptions);
+        times.verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+
+    timer.Restart();
+    if(!OutTiled(grid, outOptions, minMax, outputFileName, pool))
+    {
+        std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+        return false;
+    }
+    times.write = timer.Elapsed();
+
+    if(job.verify && (outOptions.output == NamiGenOut::GRD ||
+                      outOptions.output == NamiGenOut::GRD_BIN))
+    {
+        timer.Restart();
+        std::string refFileName = outputFileName + ".ref";
+        if(outOptions.output == NamiGenOut::GRD)
+            OutGRDReference(rows.data(), outOptions, minMax.min, minMax.max, refFileName);
+        else
+            OutGRDBinReference(rows.data(), outOptions, minMax.min, minMax.max, refFileName);
+        bool pass = FilesEqual(outputFileName, refFileName);
+        std::remove(refFileName.c_str());
+        std::cout << "Verify\t: tiled writer output "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+        times.verify += timer.Elapsed();
+        if(!pass) return false;
+    }
+    return true;
+}
+
+// Output file of the bathymetry or the eta grid of a layer job
+inline static std::string LayerFileName(const NamiGenJob& job, bool eta)
+{
+    return job.outputFileName + ((eta) ? "_eta" : "_bathy") +
+           OutputExtension(job.options.output);
+}
+
+// Generates the layers of a job in one pass and writes
+// "<name>_bathy" and "<name>_eta" (only the grids that have layers)
+inline static bool RunLayerJob(const NamiGenJob& job,
+                               NamiThreadPool& pool,
+                               NamiStageTimes& times)
+{
+    NamiTimer timer;
+    std::vector<NamiLayer> layers;
+    if(!BuildLayers(job, layers)) return false;
+    NamiRect window = JobWindow(job);
+    NamiGenOptions outOptions = NamiWindowOptions(job.options, window);
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+
+    NamiLayerGrids grids;
+    GenerateLayers(grids, layers, window, pool);
+    times.generate = timer.Elapsed();
+
+    if(job.verify)
+    {
+        timer.Restart();
+        NamiLayerGrids refGrids;
+        GenerateLayers(refGrids, layers, window, pool, true);
+        bool pass = true;
+        for(bool eta : {false, true})
+        {
+            const std::vector<float>& data = (eta) ? grids.eta : grids.bathymetry;
+            const std::vector<float>& refData = (eta) ? refGrids.eta : refGrids.bathymetry;
+            const NamiMinMax& refMinMax = (eta) ? refGrids.etaMinMax : refGrids.bathymetryMinMax;
+            if(data.empty()) continue;
+
+            float magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+            float bound = LayerErrorBound(layers, eta, magnitude);
+            float error = MaxAbsError(refData.data(), data.data(), cellCount);
+            bool gridPass = (error <= bound);
+            std::cout << "Verify\t: " << ((eta) ? "eta " : "bathymetry ")
+                      << error << " abs error (bound " << bound << ") "
+                      << ((gridPass) ? "PASS" : "FAIL") << std::endl;
+            pass &= gridPass;
+        }
+        times.verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+
+    timer.Restart();
+    for(bool eta : {false, true})
+    {
+        const std::vector<float>& data = (eta) ? grids.eta : grids.bathymetry;
+        if(data.empty()) continue;
+        std::string fileName = LayerFileName(job, eta);
+        if(!NamiWriteFile(fileName, NamiSpan<const float>(data),
+                          outOptions, (eta) ? grids.etaMinMax : grids.bathymetryMinMax,
+                          pool))
+        {
+            std::cout << "Unable to write \"" << fileName << "\"" << std::endl;
+            return false;
+        }
+    }
+    times.write = timer.Elapsed();
+    return true;
+}
+
+// Applies the layers of a job to its input grid and writes the result
+// Binary inputs are transformed in their copy on write mapping, only the
+// touched pages are copied and the input file is never written
+inline static bool RunTransformJob(const NamiGenJob& job,
+                                   NamiThreadPool& pool,
+                                   NamiStageTimes& times)
+{
+    NamiTimer timer;
+    std::vector<NamiLayer> layers;
+    if(!BuildLayers(job, layers)) return false;
+    NamiInputGrid input;
+    if(!ReadGrid(job.inputFile, input, pool)) return false;
+    size_t cellCount = static_cast<size_t>(job.options.sizeX) * job.options.sizeY;
+
+    // Reference needs the values before the transform
+    std::vector<float> refData;
+    if(job.verify) refData.assign(input.data, input.data + cellCount);
+
+    NamiMinMax minMax = TransformGrid(input.data, layers, job.options, pool);
+    times.generate = timer.Elapsed();
+
+    if(job.verify)
+    {
+        timer.Restart();
+        NamiMinMax refMinMax = TransformGrid(refData.data(), layers, job.options, pool, true);
+        float magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+        float bound = LayerErrorBound(layers, false, magnitude) +
+                      LayerErrorBound(layers, true, magnitude);
+        float error = MaxAbsError(refData.data(), input.data, cellCount);
+        bool pass = (error <= bound);
+        std::cout << "Verify\t: " << error << " abs error (bound "
+                  << bound << ") "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+        times.verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+
+    timer.Restart();
+    std::string outputFileName = job.outputFileName + OutputExtension(job.options.output);
+    if(!NamiWriteFile(outputFileName, NamiSpan<const float>(input.data, cellCount),
+                      job.options, minMax, pool))
+    {
+        std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+        return false;
+    }
+    times.write = timer.Elapsed();
+    return true;
+}
+
+// Output files of the derived fields of a job
+inline static std::string DerivedSlopeFileName(const NamiGenJob& job)
+{
+    return job.outputFileName + "_slope" + OutputExtension(job.options.output);
+}
+
+inline static std::string DerivedJSONFileName(const NamiGenJob& job)
+{
+    return job.outputFileName + ".json";
+}
+
+// Derived fields against a reduction of the generated grid
+inline static bool VerifyDerived(const NamiDerived& derived, const float* data,
+                                 const NamiRect& window, const NamiGenJob& job)
+{
+    NamiDerived reference;
+    ReduceDerivedReference(reference, data, window, job.options, job.derived, job.courant);
+    bool pass = (derived.histogram == reference.histogram &&
+                 derived.wet == reference.wet && derived.dry == reference.dry &&
+                 derived.slope == reference.slope &&
+                 derived.minMax.min == reference.minMax.min &&
+                 derived.minMax.max == reference.minMax.max);
+    std::cout << "Verify\t: derived fields "
+              << ((pass) ? "PASS" : "FAIL") << std::endl;
+    return pass;
+}
+
+inline static bool WriteDerived(const NamiGenJob& job, const NamiDerived& derived,
+                                const NamiGenOptions& outOptions, NamiThreadPool& pool)
+{
+    if(job.derived & NAMI_DERIVED_SLOPE)
+    {
+        std::string slopeFile = DerivedSlopeFileName(job);
+        if(!NamiWriteFile(slopeFile, NamiSpan<const float>(derived.slope),
+                          outOptions, derived.slopeMinMax, pool))
+        {
+            std::cout << "Unable to write \"" << slopeFile << "\"" << std::endl;
+            return false;
+        }
+    }
+    std::string jsonFile = DerivedJSONFileName(job);
+    if(!WriteDerivedJSON(jsonFile, derived))
+    {
+        std::cout << "Unable to write \"" << jsonFile << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Generates and writes the frames of a job, frames are checked against
+// "FrameSample" on every cell with -verify
+inline static bool RunFramesJob(const NamiGenJob& job,
+                                NamiThreadPool& pool,
+                                NamiStageTimes& times)
+{
+    NamiTimer timer;
+    NamiRect window = JobWindow(job);
+    size_t cellCount = static_cast<size_t>(window.width) * window.height;
+    std::vector<float> refData;
+    NamiFrameCheck check = [&](const float* data, int frame, float t)
+    {
+        NamiTimer verifyTimer;
+        refData.resize(cellCount);
+        NamiMinMax refMinMax = GenerateTiles(window.y, window.y + window.height, pool,
+                                             [&](int rowStart, int rowLast)
+        {
+            NamiMinMax result = namiMinMaxEmpty;
+            for(int y = rowStart; y < rowLast; y++)
+            for(int x = window.x; x < window.x + window.width; x++)
+            {
+                float value = FrameSample(x, y, t, job.options);
+                refData[static_cast<size_t>(y - window.y) * window.width + x - window.x] = value;
+                result.min = std::min(value, result.min);
+                result.max = std::max(value, result.max);
+            }
+            return result;
+        });
+        float error = SimdUlpError(refData.data(), data, cellCount, refMinMax);
+        bool pass = (error <= NAMI_SIMD_WAVE_ULP_TOLERANCE);
+        if(!pass)
+            std::cout << "Verify\t: frame " << frame << " " << error << " ULP (tolerance "
+                      << NAMI_SIMD_WAVE_ULP_TOLERANCE << ") FAIL" << std::endl;
+        times.verify += verifyTimer.Elapsed();
+        return pass;
+    };
+
+    bool success = GenerateFrames(job.options, window, job.frameCount, job.frameDt,
+                                  job.outputFileName, OutputExtension(job.options.output),
+                                  pool, (job.verify) ? check : nullptr, &times.write);
+    if(success && job.verify)
+        std::cout << "Verify\t: " << job.frameCount << " frames PASS" << std::endl;
+    // Writes overlap the generation, generate is the whole sequence
+    times.generate = timer.Elapsed() - times.verify;
+    return success;
+}
+
+// Writes the grid through a NamiAsyncFile, chunks are written while the
+// writers format the next ones, achieved bandwidth is reported
+inline static bool OutAsync(const std::string& fileName,
+                            NamiSpan<const float> data,
+                            const NamiGenOptions& opts,
+                            const NamiMinMax& minMax,
+                            NamiThreadPool& pool,
+                            NamiGenIO io, bool direct)
+{
+    NamiAsyncFile file;
+    if(!file.Open(fileName, io, direct)) return false;
+    NamiAsyncStreamBuf buffer(file);
+    std::ostream out(&buffer);
+    bool success = NamiWrite(out, data, opts, minMax, &pool);
+    if(!file.Close() || !success) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(),
+           static_cast<double>(minMax.min),
+           static_cast<double>(minMax.max));
+    std::cout << "Write\t: " << AsyncReport(file) << std::endl;
+    return true;
+}
+
+// Generates and writes a validated job
+// "grdData" holds the grid and is reused between calls
+// Stage wall times are written to "times" if given
+inline static bool GenerateJob(const NamiGenJob& job,
+                               NamiThreadPool& pool,
+                               NamiGridMemory& grdData,
+                               NamiStageTimes* times = nullptr)
+{
+    NamiStageTimes stageTimes = namiStageTimesEmpty;
+    if(times == nullptr) times = &stageTimes;
+    NamiTimer timer;
+
+    const NamiGenOptions& namiOptions = job.options;
+    // Windows are written as standalone grids
+    NamiRect window = JobWindow(job);
+    NamiGenOptions outOptions = NamiWindowOptions(namiOptions, window);
+    std::string outputFileName = job.outputFileName + OutputExtension(namiOptions.output);
+    bool mapped = (job.mapOutput && !job.stream &&
+                   namiOptions.output == NamiGenOut::GRD_BIN);
+    size_t cellCount = static_cast<size_t>(window.width) *
+                       static_cast<size_t>(window.height);
+
+    if(job.frameCount > 0)
+        return RunFramesJob(job, pool, *times);
+    if(!job.inputFile.empty())
+        return RunTransformJob(job, pool, *times);
+    if(!job.layers.empty())
+        return RunLayerJob(job, pool, *times);
+    if(namiOptions.precision != NamiGenPrecision::F32)
+        return RunStoredJob(job, pool, *times);
+    if(job.layout == NamiGenLayout::TILED)
+        return RunTiledJob(job, pool, *times);
+
+    // Streaming does not hold the grid
+    if(job.stream)
+    {
+        NamiMinMax minMax;
+        if(!StreamGRD(namiOptions, outputFileName, pool, minMax, job.io, job.direct))
+        {
+            std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+            return false;
+        }
+        times->stream = timer.Elapsed();
+        if(job.verify)
+        {
+            timer.Restart();
+            std::vector<float> refData(cellCount);
+            NamiMinMax refMinMax = GenerateGridReference(refData.data(), namiOptions, pool);
+            std::string refFileName = outputFileName + ".ref";
+            if(namiOptions.output == NamiGenOut::GRD)
+                OutGRDReference(refData.data(), namiOptions, refMinMax.min, refMinMax.max, refFileName);
+            else
+                OutGRDBinReference(refData.data(), namiOptions, refMinMax.min, refMinMax.max, refFileName);
+            bool pass = FilesEqual(outputFileName, refFileName);
+            std::remove(refFileName.c_str());
+            std::cout << "Verify\t: stream output "
+                      << ((pass) ? "PASS" : "FAIL") << std::endl;
+            times->verify = timer.Elapsed();
+            if(!pass) return false;
+        }
+        return true;
+    }
+
+    // Allocation and Traversal
+    NamiMappedFile mappedFile;
+    float* grid;
+    if(mapped)
+    {
+        grid = MapGRDBin(mappedFile, outOptions, outputFileName);
+        if(grid == nullptr)
+        {
+            std::cout << "Unable to map \"" << outputFileName << "\"" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        // Only grows, capacity is kept between jobs
+        // Not initialized, pages are first touched by the generating workers
+        if(!grdData.Allocate(cellCount, job.pages, job.interleave))
+        {
+            std::cout << "Unable to allocate " << cellCount << " cells" << std::endl;
+            return false;
+        }
+        grid = grdData.Data();
+    }
+    NamiDerived derived;
+    NamiMinMax minMax;
+    if(job.derived != 0)
+        minMax = GenerateDerived(grid, window,
+                                 MakeRowFunc(namiOptions, window.x, window.x + window.width),
+                                 namiOptions, job.derived, job.courant, pool, derived);
+    else if(job.sources.empty())
+        minMax = GenerateWindow(grid, window.width, window, namiOptions, pool);
+    else
+        minMax = GenerateSources(grid, window.width, window, job.sources,
+                                 namiOptions, pool);
+    float min = minMax.min;
+    float max = minMax.max;
+    times->generate = timer.Elapsed();
+
+    if(job.verify && !job.sources.empty())
+    {
+        // Culled sources against every source on every cell
+        timer.Restart();
+        std::vector<float> refData(cellCount);
+        NamiMinMax refMinMax = GenerateSources(refData.data(), window.width, window,
+                                               job.sources, namiOptions, pool, true);
+        float magnitude = std::max(std::abs(refMinMax.min), std::abs(refMinMax.max));
+        float bound = SourceErrorBound(job.sources, magnitude);
+        float error = MaxAbsError(refData.data(), grid, cellCount);
+        bool pass = (error <= bound);
+        std::cout << "Verify\t: " << error << " abs error (bound "
+                  << bound << ") "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+        times->verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+    else if(job.verify)
+    {
+        timer.Restart();
+        std::vector<float> refData(cellCount);
+        NamiMinMax refMinMax = GenerateWindowReference(refData.data(), window.width,
+                                                       window, namiOptions, pool);
+        bool pass = VerifyGenerated(refData.data(), grid, cellCount,
+                                    refMinMax, namiOptions);
+        if(job.derived != 0)
+            pass &= VerifyDerived(derived, grid, window, job);
+        times->verify = timer.Elapsed();
+        if(!pass) return false;
+    }
+
+    // Generation Complete Now Write
+    timer.Restart();
+    if(mapped)
+    {
+        FinalizeGRDBin(mappedFile, outOptions, min, max);
+        printf("%s MM(%f, %f)\n", outputFileName.c_str(),
+               static_cast<double>(min), static_cast<double>(max));
+    }
+    else if(job.io != NamiGenIO::OFSTREAM)
+    {
+        if(!OutAsync(outputFileName, NamiSpan<const float>(grid, cellCount),
+                     outOptions, minMax, pool, job.io, job.direct))
+        {
+            std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+            return false;
+        }
+    }
+    else if(!NamiWriteFile(outputFileName,
+                           NamiSpan<const float>(grid, cellCount),
+                           outOptions, minMax, pool))
+    {
+        std::cout << "Unable to write \"" << outputFileName << "\"" << std::endl;
+        return false;
+    }
+    if(job.derived != 0 && !WriteDerived(job, derived, outOptions, pool))
+        return false;
+
+    times->write = timer.Elapsed();
+
+    // New formats have no reference writer
+    if(job.verify && (outOptions.output == NamiGenOut::GRD ||
+                      outOptions.output == NamiGenOut::GRD_BIN))
+    {
+        timer.Restart();
+        std::string refFileName = outputFileName + ".ref";
+        if(outOptions.output == NamiGenOut::GRD)
+            OutGRDReference(grid, outOptions, min, max, refFileName);
+        else
+            OutGRDBinReference(grid, outOptions, min, max, refFileName);
+        bool pass = FilesEqual(outputFileName, refFileName);
+        std::remove(refFileName.c_str());
+        std::cout << "Verify\t: writer output "
+                  << ((pass) ? "PASS" : "FAIL") << std::endl;
+        times->verify += timer.Elapsed();
+        if(!pass) return false;
+    }
+    return RunNests(job, grid, pool, *times);
+}
+
+// Profile fields of "opts" that change the generated values
+inline static void AddCacheOptions(NamiCacheKey& key, const NamiGenOptions& opts)
+{
+    key.Add("type", GenTypeToString(opts.type))
+       .Add("size", opts.sizeX).Add("sizeY", opts.sizeY)
+       .Add("gap", opts.gapBottom).Add("gapTop", opts.gapTop)
+       .Add("z", opts.zLand).Add("zBottom", opts.zBottom)
+       .Add("wall", opts.hasWalls).Add("w", opts.wallWidth)
+       .Add("tana", opts.tana).Add("lut", opts.lutError)
+       .Add("simd", SimdLevelToString(ResolveSimdLevel(opts.simd)));
+}
+
+// Cache keys and the output files of a valid job
+// Lat/lon only changes the values of waves and derived fields, for the rest it is a header field
+inline static void JobCacheKeys(const NamiGenJob& job,
+                                NamiCacheKey& valueKey,
+                                NamiCacheKey& headerKey,
+                                std::vector<NamiCacheFile>& files)
+{
+    const NamiGenOptions& opts = job.options;
+    NamiRect window = JobWindow(job);
+    NamiGenOptions outOptions = NamiWindowOptions(opts, window);
+    std::vector<NamiLayer> layers;
+    BuildLayers(job, layers);
+
+    files.clear();
+    bool latLonValues = IsWaveType(opts.type) || !job.sources.empty();
+    valueKey.Add("version", NAMI_GEN_VERSION).Add("arch", NAMI_ARCH_NAME)
+            .Add("out", GenOutToString(opts.output))
+            .Add("compress", static_cast<int>(opts.compress))
+            .Add("precision", GenPrecisionToString(opts.precision))
+            // Tiled SIMD rows are evaluated in other groupings, the low bits differ
+            .Add("layout", static_cast<int>(job.layout))
+            .Add("window", window.x).Add("y", window.y)
+            .Add("w", window.width).Add("h", window.height);
+    bool transform = !job.inputFile.empty();
+    if(transform)
+    {
+        // Input is keyed by its path and stamp, rewriting it is a miss
+        valueKey.Add("input", job.inputFile).Add("stamp", CacheStamp(job.inputFile));
+        files.push_back({job.outputFileName + OutputExtension(opts.output), outOptions});
+    }
+    else if(job.frameCount > 0)
+    {
+        AddCacheOptions(valueKey, opts);
+        valueKey.Add("frames", job.frameCount).Add("dt", job.frameDt);
+        for(int i = 0; i < job.frameCount; i++)
+            files.push_back({FrameFileName(job.outputFileName, i, job.frameCount,
+                                           OutputExtension(opts.output)), outOptions});
+    }
+    else if(layers.empty())
+    {
+        AddCacheOptions(valueKey, opts);
+        files.push_back({job.outputFileName + OutputExtension(opts.output), outOptions});
+    }
+    bool hasBathymetry = false;
+    bool hasEta = false;
+    for(const NamiLayer& layer : layers)
+    {
+        bool eta = IsEtaLayer(layer);
+        latLonValues |= eta;
+        hasEta |= eta;
+        hasBathymetry |= !eta;
+        valueKey.Add("layer", static_cast<int>(layer.op))
+                .Add("kind", static_cast<int>(layer.kind));
+        AddCacheOptions(valueKey, layer.options);
+        for(const NamiWaveSource& s : layer.sources)
+            valueKey.Add("s", s.x0).Add("", s.y0).Add("", s.x1).Add("", s.y1)
+                    .Add("", s.height).Add("", s.depth);
+    }
+    if(job.derived != 0)
+    {
+        // Cell size changes the slope and the time step
+        latLonValues = true;
+        valueKey.Add("derived", job.derived).Add("courant", job.courant);
+        if(job.derived & NAMI_DERIVED_SLOPE)
+            files.push_back({DerivedSlopeFileName(job), outOptions});
+        files.push_back({DerivedJSONFileName(job), outOptions});
+    }
+    if(hasBathymetry && !transform) files.push_back({LayerFileName(job, false), outOptions});
+    if(hasEta && !transform) files.push_back({LayerFileName(job, true), outOptions});
+    for(const NamiWaveSource& s : job.sources)
+        valueKey.Add("s", s.x0).Add("", s.y0).Add("", s.x1).Add("", s.y1)
+                .Add("", s.height).Add("", s.depth);
+    for(size_t i = 0; i < job.nests.size(); i++)
+    {
+        const NamiNest& nest = job.nests[i];
+        valueKey.Add("nest", nest.ratio).Add("x", nest.extent.x).Add("y", nest.extent.y)
+                .Add("w", nest.extent.width).Add("h", nest.extent.height);
+        files.push_back({job.outputFileName + "_nest" + std::to_string(i) +
+                         OutputExtension(opts.output), NestOptions(opts, job.nests[i])});
+    }
+    if(latLonValues)
+        valueKey.Add("lat", opts.latMin).Add("latMax", opts.latMax)
+                .Add("lon", opts.lonMin).Add("lonMax", opts.lonMax);
+
+    headerKey.Add("values", valueKey.Hex())
+             .Add("lat", opts.latMin).Add("latMax", opts.latMax)
+             .Add("lon", opts.lonMin).Add("lonMax", opts.lonMax);
+}
+
+// Generates and writes a validated job, outputs are taken from and stored
+// in "job.cacheDir" if it is set
+inline static bool RunJob(const NamiGenJob& job,
+                          NamiThreadPool& pool,
+                          NamiGridMemory& grdData,
+                          NamiStageTimes* times = nullptr)
+{
+    if(job.cacheDir.empty()) return GenerateJob(job, pool, grdData, times);
+
+    NamiStageTimes stageTimes = namiStageTimesEmpty;
+    if(times == nullptr) times = &stageTimes;
+    NamiTimer timer;
+    NamiCacheKey valueKey, headerKey;
+    std::vector<NamiCacheFile> files;
+    JobCacheKeys(job, valueKey, headerKey, files);
+
+    NamiCacheResult result = CacheLookup(job.cacheDir, valueKey, headerKey, files);
+    if(result != NamiCacheResult::MISS)
+    {
+        times->cache = timer.Elapsed();
+        for(const NamiCacheFile& f : files)
+            std::cout << "Cache\t: " << ((result == NamiCacheResult::HIT) ? "hit " : "header ")
+                      << f.fileName << std::endl;
+        return true;
+    }
+
+    // Outputs may be links to the read only cached files of an older entry
+    for(const NamiCacheFile& f : files)
+        std::remove(f.fileName.c_str());
+    if(!GenerateJob(job, pool, grdData, times)) return false;
+
+    timer.Restart();
+    if(!CacheStore(job.cacheDir, valueKey, headerKey, files))
+        std::cout << "Cache\t: unable to store to \"" << job.cacheDir << "\"" << std::endl;
+    times->cache = timer.Elapsed();
+    return true;
+}
+
+inline static void PrintProfile(const NamiGenJob& job,
+                                const NamiStageTimes& times)
+{
+    NamiRect window = JobWindow(job);
+    double cells = static_cast<double>(window.width) * window.height;
+    size_t fileBytes = (job.layers.empty() || !job.inputFile.empty())
+                          ? FileSize(job.outputFileName + OutputExtension(job.options.output))
+                          : FileSize(LayerFileName(job, false)) + FileSize(LayerFileName(job, true));
+    for(int i = 0; i < job.frameCount; i++)
+        fileBytes += FileSize(FrameFileName(job.outputFileName, i, job.frameCount,
+                                            OutputExtension(job.options.output)));
+    cells *= std::max(job.frameCount, 1);
+    double fileMB = static_cast<double>(fileBytes) / (1024.0 * 1024.0);
+    // Cache hits do not generate
+    bool generated = (times.generate > 0.0 || times.stream > 0.0);
+    if(generated && job.stream)
+    {
+        std::cout << "Profile\t: Stream\t" << times.stream << "s\t"
+                  << (cells / times.stream * 1e-6) << " Mcells/s\t"
+                  << (fileMB / times.stream) << " MB/s" << std::endl;
+    }
+    else if(generated)
+    {
+        std::cout << "Profile\t: Generate\t" << times.generate << "s\t"
+                  << (cells / times.generate * 1e-6) << " Mcells/s" << std::endl;
+        std::cout << "Profile\t: Write\t" << times.write << "s\t"
+                  << (fileMB / times.write) << " MB/s" << std::endl;
+    }
+    if(job.verify && generated)
+        std::cout << "Profile\t: Verify\t" << times.verify << "s" << std::endl;
+    if(!job.cacheDir.empty())
+        std::cout << "Profile\t: Cache\t" << times.cache << "s" << std::endl;
+    std::cout << "Profile\t: Peak RSS\t"
+              << (static_cast<double>(PeakRSSBytes()) / (1024.0 * 1024.0))
+              << " MB" << std::endl;
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+// Layer pipeline
+// Profiles are stacked into a bathymetry and a wave (eta) grid in a single
+// pass, every row tile evaluates all of the layers while it is in cache
+// Both grids start at zero, layers are applied in order
+// "TransformGrid" applies the same layers in place to an existing grid
+
+#include <cmath>
+#include <cfloat>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenProfileCache.h"
+#include "NamiGenSimd.h"
+#include "NamiGenSources.h"
+
+// How a layer is combined with the grid below
+enum class NamiLayerOp
+{
+    INVALID,
+    SET,
+    MIN,
+    MAX,
+    ADD
+};
+
+// Profile layers sample "options" (or the sources), masks change the
+// grid below directly
+//      WALL    : cells closer than "wallWidth" to a border are set to "zLand"
+//      CLAMP   : cells are clamped to the range of "zLand" and "zBottom"
+enum class NamiLayerKind
+{
+    PROFILE,
+    WALL,
+    CLAMP
+};
+
+struct NamiLayer
+{
+    // Profile of the layer, grid size and lat/lon are of the job
+    NamiGenOptions  options;
+    NamiLayerOp     op;
+    NamiLayerKind   kind;
+    // Superposed wave sources instead of the profile if not empty
+    std::vector<NamiWaveSource> sources;
+};
+
+static const std::vector<std::string> layerOpStrings =
+{
+    std::string("set"),
+    std::string("min"),
+    std::string("max"),
+    std::string("add")
+};
+
+inline static NamiLayerOp LayerOpToEnum(const std::string& op)
+{
+    unsigned int i = 1;
+    for(const std::string& currentOp : layerOpStrings)
+    {
+        if(op == currentOp)
+        {
+            return static_cast<NamiLayerOp>(i);
+        }
+        i++;
+    }
+    return NamiLayerOp::INVALID;
+}
+
+// Wave layers go to the eta grid, rest to the bathymetry
+inline static bool IsEtaLayer(const NamiLayer& layer)
+{
+    return layer.kind == NamiLayerKind::PROFILE &&
+           (!layer.sources.empty() || IsWaveType(layer.options.type));
+}
+
+// Op of a layer without an explicit one, first layer of a grid sets it,
+// later bathymetry layers keep the shallower value (islands, shoals)
+// and waves are superposed
+// "base" is set if the layers are applied on an existing grid
+inline static NamiLayerOp DefaultLayerOp(const std::vector<NamiLayer>& below,
+                                         const NamiLayer& layer,
+                                         bool base = false)
+{
+    bool eta = IsEtaLayer(layer);
+    if(base) return (eta) ? NamiLayerOp::ADD : NamiLayerOp::MIN;
+    for(const NamiLayer& l : below)
+        if(IsEtaLayer(l) == eta) return (eta) ? NamiLayerOp::ADD : NamiLayerOp::MIN;
+    return NamiLayerOp::SET;
+}
+
+struct NamiLayerGrids
+{
+    // Empty if no layer targets the grid
+    std::vector<float>  bathymetry;
+    std::vector<float>  eta;
+    NamiMinMax          bathymetryMinMax;
+    NamiMinMax          etaMinMax;
+};
+
+inline static void CombineRows(float* dst, const float* src, size_t count,
+                               NamiLayerOp op)
+{
+    switch(op)
+    {
+        case NamiLayerOp::SET:
+            std::copy(src, src + count, dst);
+            break;
+        case NamiLayerOp::MIN:
+            for(size_t i = 0; i < count; i++) dst[i] = std::min(dst[i], src[i]);
+            break;
+        case NamiLayerOp::MAX:
+            for(size_t i = 0; i < count; i++) dst[i] = std::max(dst[i], src[i]);
+            break;
+        case NamiLayerOp::ADD:
+            for(size_t i = 0; i < count; i++) dst[i] += src[i];
+            break;
+        default:
+            break;
+    }
+}
+
+// Sets the wall cells of rows [rowStart, rowEnd) and columns [colBegin, colEnd)
+inline static void WallRows(float* data, size_t stride,
+                            int rowStart, int rowEnd,
+                            int colBegin, int colEnd,
+                            const NamiGenOptions& opts)
+{
+    int width = colEnd - colBegin;
+    int w = opts.wallWidth;
+    int xStart = std::max(0, std::min(w - colBegin, width));
+    int xEnd = std::max(xStart, std::min(opts.sizeX - w - colBegin, width));
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        if(y < w || y >= opts.sizeY - w)
+        {
+            std::fill(rowPtr, rowPtr + width, opts.zLand);
+            continue;
+        }
+        std::fill(rowPtr, rowPtr + xStart, opts.zLand);
+        std::fill(rowPtr + xEnd, rowPtr + width, opts.zLand);
+    }
+}
+
+inline static void ClampRows(float* data, size_t count, const NamiGenOptions& opts)
+{
+    float low = std::min(opts.zLand, opts.zBottom);
+    float high = std::max(opts.zLand, opts.zBottom);
+    for(size_t i = 0; i < count; i++)
+        data[i] = std::min(std::max(data[i], low), high);
+}
+
+inline static NamiMinMax TileMinMax(const float* data, size_t count)
+{
+    NamiMinMax result = namiMinMaxEmpty;
+    for(size_t i = 0; i < count; i++)
+    {
+        result.min = std::min(data[i], result.min);
+        result.max = std::max(data[i], result.max);
+    }
+    return result;
+}
+
+// Samplers are resolved once, tiles only run the rows
+// Masks have no row function
+inline static std::vector<NamiRowFunc> MakeLayerRowFuncs(const std::vector<NamiLayer>& layers,
+                                                         const NamiRect& window,
+                                                         bool reference)
+{
+    int colEnd = window.x + window.width;
+    std::vector<NamiRowFunc> rowFuncs(layers.size());
+    for(size_t i = 0; i < layers.size(); i++)
+    {
+        const NamiLayer& layer = layers[i];
+        if(layer.kind != NamiLayerKind::PROFILE) continue;
+        if(!layer.sources.empty())
+            rowFuncs[i] = MakeSourceRowFunc(layer.sources, layer.options, window, reference);
+        else if(reference)
+            rowFuncs[i] = MakeReferenceRowFunc(layer.options, window.x, colEnd);
+        else
+            rowFuncs[i] = MakeRowFunc(layer.options, window.x, colEnd);
+    }
+    return rowFuncs;
+}
+
+// Applies a layer to the rows [rowStart, rowEnd) of the window columns,
+// "target" holds the rows packed, "scratch" is reused between layers
+inline static void ApplyLayer(float* target, int rowStart, int rowEnd,
+                              const NamiRect& window,
+                              const NamiLayer& layer,
+                              const NamiRowFunc& rowFunc,
+                              std::vector<float>& scratch)
+{
+    size_t width = static_cast<size_t>(window.width);
+    size_t tileCells = static_cast<size_t>(rowEnd - rowStart) * width;
+    switch(layer.kind)
+    {
+        case NamiLayerKind::WALL:
+            WallRows(target, width, rowStart, rowEnd, window.x,
+                     window.x + window.width, layer.options);
+            break;
+        case NamiLayerKind::CLAMP:
+            ClampRows(target, tileCells, layer.options);
+            break;
+        default:
+            if(layer.op == NamiLayerOp::SET)
+            {
+                rowFunc(target, width, rowStart, rowEnd);
+                break;
+            }
+            scratch.resize(tileCells);
+            rowFunc(scratch.data(), width, rowStart, rowEnd);
+            CombineRows(target, scratch.data(), tileCells, layer.op);
+            break;
+    }
+}
+
+// Generates "window" of the layer stack into "grids" (window size, packed)
+// "reference" samples every layer with "SampleCell" and every source on every cell
+inline static void GenerateLayers(NamiLayerGrids& grids,
+                                  const std::vector<NamiLayer>& layers,
+                                  const NamiRect& window,
+                                  NamiThreadPool& pool,
+                                  bool reference = false)
+{
+    size_t width = static_cast<size_t>(window.width);
+    size_t cellCount = width * window.height;
+
+    bool hasBathymetry = false;
+    bool hasEta = false;
+    for(const NamiLayer& layer : layers)
+    {
+        if(IsEtaLayer(layer)) hasEta = true;
+        else hasBathymetry = true;
+    }
+    std::vector<NamiRowFunc> rowFuncs = MakeLayerRowFuncs(layers, window, reference);
+    grids.bathymetry.resize(hasBathymetry ? cellCount : 0);
+    grids.eta.resize(hasEta ? cellCount : 0);
+
+    int tileCount = (window.height + NAMI_TILE_ROWS - 1) / NAMI_TILE_ROWS;
+    std::vector<NamiMinMax> etaResults(tileCount, namiMinMaxEmpty);
+    grids.bathymetryMinMax = GenerateTiles(window.y, window.y + window.height, pool,
+                                           [&](int rowStart, int rowLast)
+    {
+        size_t offset = static_cast<size_t>(rowStart - window.y) * width;
+        size_t tileCells = static_cast<size_t>(rowLast - rowStart) * width;
+        float* bathymetry = grids.bathymetry.data() + offset;
+        float* eta = grids.eta.data() + offset;
+        if(hasBathymetry) std::fill(bathymetry, bathymetry + tileCells, 0.0f);
+        if(hasEta) std::fill(eta, eta + tileCells, 0.0f);
+
+        std::vector<float> scratch;
+        for(size_t i = 0; i < layers.size(); i++)
+        {
+            float* target = IsEtaLayer(layers[i]) ? eta : bathymetry;
+            ApplyLayer(target, rowStart, rowLast, window, layers[i], rowFuncs[i], scratch);
+        }
+        if(hasEta) etaResults[(rowStart - window.y) / NAMI_TILE_ROWS] = TileMinMax(eta, tileCells);
+        return (hasBathymetry) ? TileMinMax(bathymetry, tileCells) : namiMinMaxEmpty;
+    });
+
+    grids.etaMinMax = namiMinMaxEmpty;
+    for(const NamiMinMax& tile : etaResults)
+        MergeMinMax(grids.etaMinMax, tile);
+}
+
+// Applies the layers in place to the whole grid "data" (size of "opts",
+// packed), wave layers change the same grid, tiles are transformed while
+// they are in cache
+inline static NamiMinMax TransformGrid(float* data,
+                                       const std::vector<NamiLayer>& layers,
+                                       const NamiGenOptions& opts,
+                                       NamiThreadPool& pool,
+                                       bool reference = false)
+{
+    NamiRect window = {0, 0, opts.sizeX, opts.sizeY};
+    size_t width = static_cast<size_t>(window.width);
+    std::vector<NamiRowFunc> rowFuncs = MakeLayerRowFuncs(layers, window, reference);
+    return GenerateTiles(0, window.height, pool, [&](int rowStart, int rowLast)
+    {
+        float* rows = data + static_cast<size_t>(rowStart) * width;
+        std::vector<float> scratch;
+        for(size_t i = 0; i < layers.size(); i++)
+            ApplyLayer(rows, rowStart, rowLast, window, layers[i], rowFuncs[i], scratch);
+        return TileMinMax(rows, static_cast<size_t>(rowLast - rowStart) * width);
+    });
+}
+
+// Absolute error bound of a grid against the reference layers,
+// every layer of the grid adds its own sampler error
+// "magnitude" is the largest absolute reference value
+inline static float LayerErrorBound(const std::vector<NamiLayer>& layers,
+                                    bool eta, float magnitude)
+{
+    float bound = 0.0f;
+    for(const NamiLayer& layer : layers)
+    {
+        if(layer.kind != NamiLayerKind::PROFILE || IsEtaLayer(layer) != eta) continue;
+        if(!layer.sources.empty())
+        {
+            bound += SourceErrorBound(layer.sources, magnitude);
+            continue;
+        }
+        if(ResolveSimdLevel(layer.options.simd) == NamiSimdLevel::SCALAR &&
+           UseProfileLUT(layer.options))
+            bound += layer.options.lutError;
+        bound += magnitude * FLT_EPSILON * SimdUlpTolerance(layer.options.type);
+    }
+    return bound;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+// Read/write memory mapping of a newly created file
+// File is created (or truncated) with the given size
+// or of an existing file with private writes
+class NamiMappedFile
+{
+    private:
+        char*           data;
+        size_t          size;
+        #ifdef _WIN32
+            HANDLE      file;
+            HANDLE      mapping;
+        #else
+            int         fd;
+        #endif
+
+    public:
+        // Constructors & Destructor
+                        NamiMappedFile();
+                        NamiMappedFile(const NamiMappedFile&) = delete;
+        NamiMappedFile& operator=(const NamiMappedFile&) = delete;
+                        ~NamiMappedFile();
+
+        bool            Open(const std::string& fileName, size_t fileSize);
+        // Maps an existing file copy on write, writes only change
+        // the private pages of the mapping
+        bool            OpenExisting(const std::string& fileName);
+        void            Close();
+
+        char*           Data();
+        size_t          Size() const;
+};
+
+inline NamiMappedFile::NamiMappedFile()
+    : data(nullptr)
+    , size(0)
+    #ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE)
+        , mapping(nullptr)
+    #else
+        , fd(-1)
+    #endif
+{}
+
+inline NamiMappedFile::~NamiMappedFile()
+{
+    Close();
+}
+
+inline bool NamiMappedFile::Open(const std::string& fileName, size_t fileSize)
+{
+    Close();
+    if(fileSize == 0) return false;
+
+    #ifdef _WIN32
+        file = CreateFileA(fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+                           nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+
+        ULARGE_INTEGER fileSizeLarge;
+        fileSizeLarge.QuadPart = fileSize;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READWRITE,
+                                     fileSizeLarge.HighPart, fileSizeLarge.LowPart,
+                                     nullptr);
+        if(mapping == nullptr) { Close(); return false; }
+
+        data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, fileSize));
+        if(data == nullptr) { Close(); return false; }
+    #else
+        fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) return false;
+        if(ftruncate(fd, static_cast<off_t>(fileSize)) != 0) { Close(); return false; }
+
+        void* ptr = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(ptr == MAP_FAILED) { Close(); return false; }
+        data = static_cast<char*>(ptr);
+    #endif
+    size = fileSize;
+    return true;
+}
+
+inline bool NamiMappedFile::OpenExisting(const std::string& fileName)
+{
+    Close();
+    size_t fileSize;
+
+    #ifdef _WIN32
+        file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSizeLarge;
+        if(!GetFileSizeEx(file, &fileSizeLarge) || fileSizeLarge.QuadPart == 0) { Close(); return false; }
+        fileSize = static_cast<size_t>(fileSizeLarge.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if(mapping == nullptr) { Close(); return false; }
+
+        data = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, fileSize));
+        if(data == nullptr) { Close(); return false; }
+    #else
+        fd = open(fileName.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat fileStat;
+        if(fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) { Close(); return false; }
+        fileSize = static_cast<size_t>(fileStat.st_size);
+
+        void* ptr = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(ptr == MAP_FAILED) { Close(); return false; }
+        data = static_cast<char*>(ptr);
+    #endif
+    size = fileSize;
+    return true;
+}
+
+inline void NamiMappedFile::Close()
+{
+    #ifdef _WIN32
+        if(data) UnmapViewOfFile(data);
+        if(mapping) CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+    #else
+        if(data) munmap(data, size);
+        if(fd >= 0) close(fd);
+        fd = -1;
+    #endif
+    data = nullptr;
+    size = 0;
+}
+
+inline char* NamiMappedFile::Data()
+{
+    return data;
+}
+
+inline size_t NamiMappedFile::Size() const
+{
+    return size;
+}
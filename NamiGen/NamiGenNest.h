@@ -0,0 +1,132 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenAPI.h"
+
+// Nested (child) grid of a parent grid
+// Child covers the parent nodes [x, x + width) x [y, y + height)
+// with "ratio" times finer spacing, parent and child nodes coincide
+// at every "ratio"th child node
+struct NamiNest
+{
+    int         ratio;
+    NamiRect    extent;
+};
+
+// Child grid size of a nest
+inline static int NestSize(int parentSize, int ratio)
+{
+    return (parentSize - 1) * ratio + 1;
+}
+
+// Options of a "ratio" times finer grid that has the same geometry as "opts"
+// Geometry parameters are in cells, they are resolved so that values match
+// the parent at the coinciding nodes
+// Only for sampling, lat/lon and sizes are not the ones of a written grid
+inline static NamiGenOptions RefineOptions(const NamiGenOptions& opts, int ratio)
+{
+    NamiGenOptions fine = opts;
+    if(ratio == 1) return fine;
+
+    // Walls are land below "wallWidth" and above "size - wallWidth"
+    fine.wallWidth = opts.wallWidth * ratio;
+    switch(opts.type)
+    {
+        case NamiGenType::CIRCULAR_LINEAR:
+        case NamiGenType::CIRCULAR_SINUSODIAL:
+            // Center is at "size * 0.5", radii are "gap / 2"
+            fine.sizeX = opts.sizeX * ratio;
+            fine.sizeY = opts.sizeY * ratio;
+            fine.gapBottom = (opts.gapBottom / 2) * 2 * ratio;
+            fine.gapTop = (opts.gapTop / 2) * 2 * ratio;
+            break;
+        case NamiGenType::DUHIS:
+            // Wedges are "(size - gapTop) * 0.5" long
+            fine.sizeX = opts.sizeX * ratio;
+            fine.sizeY = opts.sizeY * ratio;
+            fine.gapBottom = opts.gapBottom * ratio;
+            fine.gapTop = opts.gapTop * ratio;
+            break;
+        case NamiGenType::WAVE_CIRCULAR:
+        case NamiGenType::WAVE_HORIZONTAL:
+        case NamiGenType::WAVE_VERTICAL:
+        case NamiGenType::WAVE_EMPTY:
+            // Cell distance is scaled by the lat/lon range
+            fine.sizeX = NestSize(opts.sizeX, ratio);
+            fine.sizeY = NestSize(opts.sizeY, ratio);
+            fine.gapBottom = opts.gapBottom * ratio;
+            fine.gapTop = opts.gapTop * ratio;
+            fine.lonMax = opts.lonMin + (opts.lonMax - opts.lonMin) / ratio;
+            fine.latMax = opts.latMin + (opts.latMax - opts.latMin) / ratio;
+            break;
+        default:
+            // Flat profiles are measured from the first or the last node
+            fine.sizeX = NestSize(opts.sizeX, ratio);
+            fine.sizeY = NestSize(opts.sizeY, ratio);
+            fine.gapBottom = opts.gapBottom * ratio;
+            fine.gapTop = opts.gapTop * ratio;
+            break;
+    }
+    return fine;
+}
+
+// Child region in the cells of "RefineOptions"
+inline static NamiRect NestWindow(const NamiNest& nest)
+{
+    return NamiRect{nest.extent.x * nest.ratio,
+                    nest.extent.y * nest.ratio,
+                    NestSize(nest.extent.width, nest.ratio),
+                    NestSize(nest.extent.height, nest.ratio)};
+}
+
+// Options of the written child grid
+inline static NamiGenOptions NestOptions(const NamiGenOptions& parentOpts,
+                                         const NamiNest& nest)
+{
+    NamiGenOptions result = NamiWindowOptions(parentOpts, nest.extent);
+    result.sizeX = NestSize(nest.extent.width, nest.ratio);
+    result.sizeY = NestSize(nest.extent.height, nest.ratio);
+    return result;
+}
+
+inline static bool NestValid(const NamiNest& nest, const NamiGenOptions& parentOpts)
+{
+    if(nest.ratio < 1 || nest.extent.width < 2 || nest.extent.height < 2 ||
+       !NamiWindowValid(nest.extent, parentOpts))
+        return false;
+    // Fine grid should be indexable with int
+    int64_t fineX = static_cast<int64_t>(parentOpts.sizeX) * nest.ratio;
+    int64_t fineY = static_cast<int64_t>(parentOpts.sizeY) * nest.ratio;
+    return fineX <= INT32_MAX && fineY <= INT32_MAX;
+}
+
+// Copies parent values to the coinciding child nodes so levels match
+// exactly at the shared nodes, returns min/max of the child
+inline static NamiMinMax InjectParent(float* child, const NamiNest& nest,
+                                      const float* parent, int parentSizeX)
+{
+    int childSizeX = NestSize(nest.extent.width, nest.ratio);
+    int childSizeY = NestSize(nest.extent.height, nest.ratio);
+    for(int py = 0; py < nest.extent.height; py++)
+    {
+        const float* parentRow = parent + static_cast<size_t>(nest.extent.y + py) * parentSizeX +
+                                 nest.extent.x;
+        float* childRow = child + static_cast<size_t>(py) * nest.ratio * childSizeX;
+        for(int px = 0; px < nest.extent.width; px++)
+            childRow[static_cast<size_t>(px) * nest.ratio] = parentRow[px];
+    }
+
+    NamiMinMax result = namiMinMaxEmpty;
+    size_t count = static_cast<size_t>(childSizeX) * childSizeY;
+    for(size_t i = 0; i < count; i++)
+    {
+        result.min = std::min(child[i], result.min);
+        result.max = std::max(child[i], result.max);
+    }
+    return result;
+}
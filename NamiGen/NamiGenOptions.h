@@ -1,5 +1,8 @@
 #pragma once
 
+#include <vector>
+#include <string>
+
 enum class NamiGenType
 {
     INVALID,
@@ -31,7 +34,69 @@ enum class NamiGenOut
 {
     INVALID,
     GRD,
-    GRD_BIN
+    GRD_BIN,
+    GRD_7,
+    TIFF
+};
+
+enum class NamiGenCompress
+{
+    INVALID,
+    NONE,
+    PACKBITS
+};
+
+// Storage type of the generated grid
+enum class NamiGenPrecision
+{
+    INVALID,
+    F32,
+    HALF,       // IEEE binary16
+    Q16,        // int16 with scale and offset
+    F64
+};
+
+// Memory layout of the generated grid
+enum class NamiGenLayout
+{
+    INVALID,
+    ROWS,
+    TILED       // NAMI_GRID_TILE square tiles
+};
+
+// Pages backing the grid memory
+enum class NamiGenPages
+{
+    INVALID,
+    SMALL,
+    THP,        // Transparent huge pages
+    LARGE       // Explicit huge pages
+};
+
+// Output file backend
+enum class NamiGenIO
+{
+    INVALID,
+    OFSTREAM,
+    URING,      // io_uring, PWRITE if unavailable
+    PWRITE      // pwrite thread pool
+};
+
+enum class NamiGenSimd
+{
+    INVALID,
+    OFF,
+    AUTO,
+    SSE,
+    AVX2,
+    AVX512
+};
+
+// Cell rectangle of a grid
+struct NamiRect
+{
+    int x, y;
+    int width, height;
 };
 
 struct NamiGenOptions
@@ -46,6 +111,11 @@ struct NamiGenOptions
     bool hasWalls;
     int wallWidth;
     float tana;
+    int threadCount;
+    NamiGenSimd simd;
+    NamiGenCompress compress;
+    float lutError;
+    NamiGenPrecision precision;
 };
 
 constexpr NamiGenOptions namiOptsDefault = NamiGenOptions
@@ -59,7 +129,12 @@ constexpr NamiGenOptions namiOptsDefault = NamiGenOptions
     NamiGenType::CIRCULAR_SINUSODIAL,
     false,
     3,
-    1
+    1,
+    0,
+    NamiGenSimd::OFF,
+    NamiGenCompress::NONE,
+    0.0f,
+    NamiGenPrecision::F32
 };
 
 static const std::vector<std::string> switches =
@@ -74,7 +149,37 @@ static const std::vector<std::string> switches =
     "-wall",
     "-w",
     "-n",
-    "-tana"
+    "-tana",
+    "-threads",
+    "-simd",
+    "-verify",
+    "-mmap",
+    "-stream",
+    "-compress",
+    "-batch",
+    "-lut",
+    "-profile",
+    "-bench",
+    "-window",
+    "-tiles",
+    "-nest",
+    "-precision",
+    "-layer",
+    "-layers",
+    "-sources",
+    "-cache",
+    "-input",
+    "-frames",
+    "-dt",
+    "-derived",
+    "-courant",
+    "-fuzz",
+    "-seed",
+    "-layout",
+    "-pages",
+    "-interleave",
+    "-io",
+    "-direct"
 };
 
 static const std::vector<int> switchArgCounts =
@@ -89,62 +194,245 @@ static const std::vector<int> switchArgCounts =
     0,
     1,
     1,
-    1
+    1,
+    1,
+    1,
+    0,
+    0,
+    0,
+    1,
+    1,
+    1,
+    0,
+    1,
+    4,
+    2,
+    5,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    1,
+    0,
+    1,
+    0
+};
+
+static const std::vector<std::string> genTypeStrings =
+{
+    std::string("circsin"),
+    std::string("circlin"),
+
+    std::string("linr"),
+    std::string("linl"),
+    std::string("lint"),
+    std::string("linb"),
+
+    std::string("sinr"),
+    std::string("sinl"),
+    std::string("sint"),
+    std::string("sinb"),
+
+    std::string("duhis"),
+
+    std::string("wavecirc"),
+    std::string("wavehorizontal"),
+    std::string("wavevertical"),
+    std::string("waveempty")
 };
 
 inline static NamiGenType GenTypeToEnum(const std::string& type)
+{
+    unsigned int i = 1;
+    for(const std::string& currentType : genTypeStrings)
+    {
+        if(type == currentType)
+        {
+            return static_cast<NamiGenType>(i);
+        }
+        i++;
+    }
+    return NamiGenType::INVALID;
+}
+
+static const std::vector<std::string> genOutStrings =
+{
+    std::string("grd"),
+    std::string("grdbin"),
+    std::string("grd7"),
+    std::string("tiff")
+};
+
+inline static NamiGenOut GenOutToEnum(const std::string& out)
+{
+    unsigned int i = 1;
+    for(const std::string& currentType : genOutStrings)
+    {
+        if(out == currentType)
+        {
+            return static_cast<NamiGenOut>(i);
+        }
+        i++;
+    }
+    return NamiGenOut::INVALID;
+}
+
+inline static NamiGenSimd GenSimdToEnum(const std::string& simd)
 {
     static const std::vector<std::string> typeStrings =
     {
-        std::string("circsin"),
-        std::string("circlin"),
+        std::string("off"),
+        std::string("auto"),
+        std::string("sse"),
+        std::string("avx2"),
+        std::string("avx512")
+    };
 
-        std::string("linr"),
-        std::string("linl"),
-        std::string("lint"),
-        std::string("linb"),
+    unsigned int i = 1;
+    for(const std::string& currentType : typeStrings)
+    {
+        if(simd == currentType)
+        {
+            return static_cast<NamiGenSimd>(i);
+        }
+        i++;
+    }
+    return NamiGenSimd::INVALID;
+}
 
-        std::string("sinr"),
-        std::string("sinl"),
-        std::string("sint"),
-        std::string("sinb"),
+inline static NamiGenCompress GenCompressToEnum(const std::string& compress)
+{
+    static const std::vector<std::string> typeStrings =
+    {
+        std::string("none"),
+        std::string("packbits")
+    };
 
-        std::string("duhis"),
+    unsigned int i = 1;
+    for(const std::string& currentType : typeStrings)
+    {
+        if(compress == currentType)
+        {
+            return static_cast<NamiGenCompress>(i);
+        }
+        i++;
+    }
+    return NamiGenCompress::INVALID;
+}
 
-        std::string("wavecirc"),
-        std::string("wavehorizontal"),
-        std::string("wavevertical"),
-        std::string("waveempty")
+inline static NamiGenLayout GenLayoutToEnum(const std::string& layout)
+{
+    static const std::vector<std::string> typeStrings =
+    {
+        std::string("rows"),
+        std::string("tiled")
     };
 
     unsigned int i = 1;
     for(const std::string& currentType : typeStrings)
     {
-        if(type == currentType)
+        if(layout == currentType)
         {
-            return static_cast<NamiGenType>(i);
+            return static_cast<NamiGenLayout>(i);
         }
         i++;
     }
-    return NamiGenType::INVALID;
+    return NamiGenLayout::INVALID;
 }
 
-inline static NamiGenOut GenOutToEnum(const std::string& out)
+inline static NamiGenPages GenPagesToEnum(const std::string& pages)
 {
     static const std::vector<std::string> typeStrings =
     {
-        std::string("grd"),
-        std::string("grdbin")
+        std::string("small"),
+        std::string("thp"),
+        std::string("large")
     };
 
     unsigned int i = 1;
     for(const std::string& currentType : typeStrings)
     {
-        if(out == currentType)
+        if(pages == currentType)
         {
-            return static_cast<NamiGenOut>(i);
+            return static_cast<NamiGenPages>(i);
         }
         i++;
     }
-    return NamiGenOut::INVALID;
-}
\ No newline at end of file
+    return NamiGenPages::INVALID;
+}
+
+static const std::vector<std::string> genIOStrings =
+{
+    std::string("ofstream"),
+    std::string("uring"),
+    std::string("pwrite")
+};
+
+inline static NamiGenIO GenIOToEnum(const std::string& io)
+{
+    unsigned int i = 1;
+    for(const std::string& currentType : genIOStrings)
+    {
+        if(io == currentType)
+        {
+            return static_cast<NamiGenIO>(i);
+        }
+        i++;
+    }
+    return NamiGenIO::INVALID;
+}
+
+static const std::vector<std::string> genPrecisionStrings =
+{
+    std::string("f32"),
+    std::string("half"),
+    std::string("q16"),
+    std::string("f64")
+};
+
+inline static NamiGenPrecision GenPrecisionToEnum(const std::string& precision)
+{
+    unsigned int i = 1;
+    for(const std::string& currentType : genPrecisionStrings)
+    {
+        if(precision == currentType)
+        {
+            return static_cast<NamiGenPrecision>(i);
+        }
+        i++;
+    }
+    return NamiGenPrecision::INVALID;
+}
+
+inline static std::string GenTypeToString(NamiGenType type)
+{
+    if(type == NamiGenType::INVALID) return "invalid";
+    return genTypeStrings[static_cast<int>(type) - 1];
+}
+
+inline static std::string GenOutToString(NamiGenOut out)
+{
+    if(out == NamiGenOut::INVALID) return "invalid";
+    return genOutStrings[static_cast<int>(out) - 1];
+}
+
+inline static std::string GenPrecisionToString(NamiGenPrecision precision)
+{
+    if(precision == NamiGenPrecision::INVALID) return "invalid";
+    return genPrecisionStrings[static_cast<int>(precision) - 1];
+}
+
+inline static std::string GenIOToString(NamiGenIO io)
+{
+    if(io == NamiGenIO::INVALID) return "invalid";
+    return genIOStrings[static_cast<int>(io) - 1];
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenWriters.h"
+#include "NamiGenTiff.h"
+
+// Storage precisions other than f32
+// Values are generated as float in row bands and stored into the compact
+// buffer, the whole grid is never held as float
+// Wave profiles have a double sampler for f64
+
+// Target size of the float band of the stored generation
+constexpr size_t NAMI_STORED_BAND_BYTES = 16 * 1024 * 1024;
+constexpr int NAMI_Q16_MAX = 32767;
+
+// IEEE binary16, round to nearest even
+inline static uint16_t FloatToHalf(float value)
+{
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(float));
+    uint16_t sign = static_cast<uint16_t>((f >> 16) & 0x8000u);
+    uint32_t exponent = (f >> 23) & 0xFFu;
+    uint32_t mantissa = f & 0x7FFFFFu;
+
+    // Inf & NaN
+    if(exponent == 0xFFu)
+        return sign | 0x7C00u | ((mantissa != 0) ? 0x200u : 0u);
+
+    int32_t halfExponent = static_cast<int32_t>(exponent) - 127 + 15;
+    // Overflow
+    if(halfExponent >= 0x1F) return sign | 0x7C00u;
+    // Subnormal or zero
+    if(halfExponent <= 0)
+    {
+        if(halfExponent < -10) return sign;
+        mantissa |= 0x800000u;
+        uint32_t shift = static_cast<uint32_t>(14 - halfExponent);
+        uint32_t half = mantissa >> shift;
+        uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        uint32_t halfway = 1u << (shift - 1u);
+        if(remainder > halfway || (remainder == halfway && (half & 1u))) half++;
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+    uint32_t remainder = mantissa & 0x1FFFu;
+    // Carry may round up to the next exponent (or to inf), which is correct
+    if(remainder > 0x1000u || (remainder == 0x1000u && (half & 1u))) half++;
+    return sign | static_cast<uint16_t>(half);
+}
+
+inline static float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    uint32_t f;
+    if(exponent == 0x1Fu)
+        f = sign | 0x7F800000u | (mantissa << 13);
+    else if(exponent != 0)
+        f = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if(mantissa == 0)
+        f = sign;
+    else
+    {
+        // Subnormal, normalize
+        exponent = 127 - 15 + 1;
+        while((mantissa & 0x400u) == 0)
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        f = sign | (exponent << 23) | ((mantissa & 0x3FFu) << 13);
+    }
+    float value;
+    std::memcpy(&value, &f, sizeof(float));
+    return value;
+}
+
+// Stored value is "offset + scale * q"
+struct NamiQuantization
+{
+    double scale;
+    double offset;
+};
+
+// Covers the value range of the profiles, [zLand, zBottom] for
+// bathymetry and [0, |zLand|] for waves
+inline static NamiQuantization Q16Quantization(const NamiGenOptions& opts)
+{
+    double low, high;
+    if(IsWaveType(opts.type))
+    {
+        low = 0.0;
+        high = std::abs(static_cast<double>(opts.zLand));
+    }
+    else
+    {
+        low = std::min(opts.zLand, opts.zBottom);
+        high = std::max(opts.zLand, opts.zBottom);
+    }
+    if(!(high > low)) high = low + 1.0;
+    return NamiQuantization{(high - low) / (2.0 * NAMI_Q16_MAX), (high + low) * 0.5};
+}
+
+// Rounds to the nearest step, saturates outside the range
+inline static int16_t QuantizeQ16(float value, const NamiQuantization& q)
+{
+    double steps = std::nearbyint((static_cast<double>(value) - q.offset) / q.scale);
+    steps = std::max<double>(-NAMI_Q16_MAX, std::min<double>(NAMI_Q16_MAX, steps));
+    return static_cast<int16_t>(steps);
+}
+
+inline static double DequantizeQ16(int16_t value, const NamiQuantization& q)
+{
+    return q.offset + q.scale * value;
+}
+
+// Generates "window" in float bands and stores each value with "encode"
+// "data" points to the cell (window.x, window.y), rows are "stride" apart
+// Returned min/max is of the generated float values
+template<class T, class Encode>
+inline static NamiMinMax GenerateWindowStored(T* data, size_t stride,
+                                              const NamiRect& window,
+                                              const NamiGenOptions& opts,
+                                              NamiThreadPool& pool,
+                                              Encode&& encode)
+{
+    size_t rowBytes = std::max<size_t>(1, window.width) * sizeof(float);
+    int bandRows = static_cast<int>(std::min<size_t>(std::max<size_t>(1, NAMI_STORED_BAND_BYTES / rowBytes),
+                                                     std::max(window.height, 1)));
+    std::vector<float> scratch(static_cast<size_t>(bandRows) * window.width);
+
+    NamiMinMax result = namiMinMaxEmpty;
+    int rowEnd = window.y + window.height;
+    for(int bandStart = window.y; bandStart < rowEnd; bandStart += bandRows)
+    {
+        NamiRect band = {window.x, bandStart, window.width,
+                         std::min(bandRows, rowEnd - bandStart)};
+        MergeMinMax(result, GenerateWindow(scratch.data(), window.width, band, opts, pool));
+
+        // Conversion is split into row tiles as well
+        GenerateTiles(band.y, band.y + band.height, pool, [&](int rowStart, int rowLast)
+        {
+            for(int y = rowStart; y < rowLast; y++)
+            {
+                const float* in = scratch.data() + static_cast<size_t>(y - band.y) * window.width;
+                T* out = data + static_cast<size_t>(y - window.y) * stride;
+                for(int x = 0; x < window.width; x++)
+                    out[x] = encode(in[x]);
+            }
+            return namiMinMaxEmpty;
+        });
+    }
+    return result;
+}
+
+// Double precision generation, wave profiles use "WaveSampleDouble"
+// rest are float samples widened
+inline static NamiMinMax GenerateWindowDouble(double* data, size_t stride,
+                                              const NamiRect& window,
+                                              const NamiGenOptions& opts,
+                                              NamiThreadPool& pool)
+{
+    if(!IsWaveType(opts.type))
+    {
+        return GenerateWindowStored(data, stride, window, opts, pool,
+                                    [](float v) { return static_cast<double>(v); });
+    }
+    return GenerateTiles(window.y, window.y + window.height, pool, [&](int rowStart, int rowLast)
+    {
+        NamiMinMax result = namiMinMaxEmpty;
+        for(int y = rowStart; y < rowLast; y++)
+        {
+            double* row = data + static_cast<size_t>(y - window.y) * stride;
+            for(int x = 0; x < window.width; x++)
+            {
+                row[x] = WaveSampleDouble(window.x + x, y, opts);
+                float value = static_cast<float>(row[x]);
+                result.min = std::min(value, result.min);
+                result.max = std::max(value, result.max);
+            }
+        }
+        return result;
+    });
+}
+
+// Grid in a storage precision, only the buffer of the precision is used
+struct NamiStoredGrid
+{
+    NamiGenPrecision        precision;
+    NamiQuantization        quantization;
+    std::vector<uint16_t>   half;
+    std::vector<int16_t>    q16;
+    std::vector<double>     f64;
+    // Of the stored values
+    double                  min, max;
+
+    double                  Value(size_t i) const
+    {
+        switch(precision)
+        {
+            case NamiGenPrecision::HALF: return HalfToFloat(half[i]);
+            case NamiGenPrecision::Q16:  return DequantizeQ16(q16[i], quantization);
+            default:                     return f64[i];
+        }
+    }
+};
+
+// Generates "window" of "opts" into "grid" in opts.precision (not f32)
+inline static void GenerateStored(NamiStoredGrid& grid,
+                                  const NamiRect& window,
+                                  const NamiGenOptions& opts,
+                                  NamiThreadPool& pool)
+{
+    size_t count = static_cast<size_t>(window.width) * window.height;
+    grid.precision = opts.precision;
+    grid.quantization = Q16Quantization(opts);
+
+    // Conversions are monotonic, stored min/max are the converted float min/max
+    NamiMinMax minMax;
+    switch(opts.precision)
+    {
+        case NamiGenPrecision::HALF:
+            grid.half.resize(count);
+            minMax = GenerateWindowStored(grid.half.data(), window.width, window, opts, pool,
+                                          [](float v) { return FloatToHalf(v); });
+            grid.min = HalfToFloat(FloatToHalf(minMax.min));
+            grid.max = HalfToFloat(FloatToHalf(minMax.max));
+            break;
+        case NamiGenPrecision::Q16:
+        {
+            const NamiQuantization& q = grid.quantization;
+            grid.q16.resize(count);
+            minMax = GenerateWindowStored(grid.q16.data(), window.width, window, opts, pool,
+                                          [&q](float v) { return QuantizeQ16(v, q); });
+            grid.min = DequantizeQ16(QuantizeQ16(minMax.min, q), q);
+            grid.max = DequantizeQ16(QuantizeQ16(minMax.max, q), q);
+            break;
+        }
+        default:
+        {
+            grid.f64.resize(count);
+            GenerateWindowDouble(grid.f64.data(), window.width, window, opts, pool);
+            auto range = std::minmax_element(grid.f64.begin(), grid.f64.end());
+            grid.min = (count > 0) ? *range.first : 0.0;
+            grid.max = (count > 0) ? *range.second : 0.0;
+            break;
+        }
+    }
+}
+
+// Largest difference of a stored value to its float source
+inline static double StoredErrorBound(const NamiStoredGrid& grid)
+{
+    double magnitude = std::max(std::abs(grid.min), std::abs(grid.max));
+    switch(grid.precision)
+    {
+        // Half rounding is half a step at the magnitude (or of subnormals)
+        case NamiGenPrecision::HALF: return std::max(magnitude * std::ldexp(1.0, -11), std::ldexp(1.0, -25));
+        case NamiGenPrecision::Q16:  return grid.quantization.scale * 0.5;
+        default:                     return 0.0;
+    }
+}
+
+// GDAL reads the scale and offset of integer rasters from this tag
+inline static std::string GDALScaleMetadata(const NamiQuantization& q)
+{
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "<GDALMetadata>\n"
+                  "  <Item name=\"OFFSET\" sample=\"0\" role=\"offset\">%.17g</Item>\n"
+                  "  <Item name=\"SCALE\" sample=\"0\" role=\"scale\">%.17g</Item>\n"
+                  "</GDALMetadata>\n",
+                  q.offset, q.scale);
+    return text;
+}
+
+// Tiff stores the precision as is (binary16, int16 + GDAL scale/offset, float64)
+// Surfer 7 stores doubles, "ValidateJob" only lets f64 through
+// Returns false for other formats or if the file can not be written
+inline static bool OutStored(const NamiStoredGrid& grid,
+                             const NamiGenOptions& opts,
+                             const std::string& fileName,
+                             NamiThreadPool& pool)
+{
+    bool written = false;
+    std::ofstream outFile(fileName, std::ofstream::binary);
+    if(opts.output == NamiGenOut::GRD_7)
+    {
+        written = WriteGRD7Values(outFile, [&grid](size_t i) { return grid.Value(i); },
+                                  opts, grid.min, grid.max);
+    }
+    else if(opts.output == NamiGenOut::TIFF)
+    {
+        bool compress = (opts.compress == NamiGenCompress::PACKBITS);
+        if(grid.precision == NamiGenPrecision::HALF)
+            written = WriteTiffSamples(outFile, grid.half.data(), opts, compress,
+                                       NAMI_TIFF_FLOAT, GDALStatisticsMetadata(grid.min, grid.max), pool);
+        else if(grid.precision == NamiGenPrecision::Q16)
+            written = WriteTiffSamples(outFile, grid.q16.data(), opts, compress,
+                                       NAMI_TIFF_INT, GDALScaleMetadata(grid.quantization), pool);
+        else
+            written = WriteTiffSamples(outFile, grid.f64.data(), opts, compress,
+                                       NAMI_TIFF_FLOAT, GDALStatisticsMetadata(grid.min, grid.max), pool);
+    }
+    if(!written) return false;
+    outFile.close();
+    if(!outFile) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(), grid.min, grid.max);
+    return true;
+}
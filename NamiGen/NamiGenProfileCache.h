@@ -0,0 +1,204 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+
+// Quantized radial profiles
+// Radial samplers evaluate a transcendental per cell on the distance,
+// these tables sample the profile uniformly over the distance range and
+// linearly interpolate. Spacing is chosen from the second derivative bound
+// so interpolation error stays under the requested absolute error
+// (h^2 / 8 * max|f''| <= error). Opt-in since output is not bit exact.
+
+// Tables larger than this fall back to the exact samplers
+constexpr size_t NAMI_LUT_MAX_SIZE = 1 << 22;
+
+class NamiProfileLUT
+{
+    private:
+        std::vector<float>  table;
+        float               begin;
+        float               invStep;
+        float               last;
+
+    public:
+        // Constructors & Destructor
+                            NamiProfileLUT() = default;
+        template<class Func>
+                            NamiProfileLUT(float begin, float end,
+                                           float maxSecondDerivative,
+                                           float maxError,
+                                           Func&& profile);
+
+        bool                Valid() const { return !table.empty(); }
+        // Values outside the range are clamped to the ends
+        float               Sample(float r) const
+        {
+            float t = (r - begin) * invStep;
+            t = std::max(0.0f, std::min(t, last));
+            int i = std::min(static_cast<int>(t), static_cast<int>(table.size()) - 2);
+            float frac = t - static_cast<float>(i);
+            return table[i] + (table[i + 1] - table[i]) * frac;
+        }
+};
+
+template<class Func>
+inline NamiProfileLUT::NamiProfileLUT(float begin, float end,
+                                      float maxSecondDerivative,
+                                      float maxError,
+                                      Func&& profile)
+    : begin(begin)
+    , invStep(0.0f)
+    , last(0.0f)
+{
+    double length = std::max(0.0, static_cast<double>(end) - begin);
+    double count = 2.0;
+    if(maxSecondDerivative > 0.0f && length > 0.0)
+    {
+        double step = std::sqrt(8.0 * maxError / maxSecondDerivative);
+        count = std::ceil(length / step) + 1.0;
+    }
+    if(count > static_cast<double>(NAMI_LUT_MAX_SIZE)) return;
+
+    size_t size = std::max<size_t>(2, static_cast<size_t>(count));
+    double step = length / static_cast<double>(size - 1);
+    table.resize(size);
+    for(size_t i = 0; i < size; i++)
+        table[i] = profile(static_cast<float>(begin + step * i));
+    invStep = (step > 0.0) ? static_cast<float>(1.0 / step) : 0.0f;
+    last = static_cast<float>(size - 1);
+}
+
+class NamiCircleLUTSampler
+{
+    private:
+        NamiProfileLUT  lut;
+        float           centerX, centerY;
+        float           bottom, top;
+        float           zLand, zBottom;
+
+    public:
+        static constexpr NamiSampleDomain SAMPLE_DOMAIN = NamiSampleDomain::XY;
+
+                        NamiCircleLUTSampler(const NamiGenOptions& opts)
+                            : centerX(static_cast<float>(opts.sizeX) * 0.5f)
+                            , centerY(static_cast<float>(opts.sizeY) * 0.5f)
+                            , bottom(static_cast<float>(opts.gapBottom / 2))
+                            , top(static_cast<float>(opts.gapTop / 2))
+                            , zLand(opts.zLand)
+                            , zBottom(opts.zBottom)
+        {
+            NamiProfileSampler<NamiProfile::SINUSODIAL> profile(opts);
+            float range = static_cast<float>(opts.gapTop / 2 - opts.gapBottom / 2);
+            // f(r) = zRange * (cos(pi * n - pi) / 2 + 1 / 2), n = 1 - (r - bottom) / range
+            float scale = NAMI_PI / range;
+            float d2 = 0.5f * std::abs(opts.zBottom - opts.zLand) * scale * scale;
+            lut = NamiProfileLUT(bottom, top, d2, opts.lutError, [&](float r)
+            {
+                r -= bottom;
+                r /= range;
+                r = 1.0f - r;
+                return profile.Sample(r);
+            });
+        }
+
+        bool            Valid() const { return lut.Valid(); }
+        float           Sample(int x, int y) const
+        {
+            float dx = static_cast<float>(x) - centerX;
+            float dy = static_cast<float>(y) - centerY;
+            float distance = std::sqrt(dx * dx + dy * dy);
+
+            if(distance > top) return zLand;
+            else if(distance < bottom) return zBottom;
+            return lut.Sample(distance);
+        }
+};
+
+class NamiWaveLUTSampler
+{
+    private:
+        NamiProfileLUT  lut;
+        float           xFactor, yFactor;
+        int             centerX, centerY;
+
+    public:
+        static constexpr NamiSampleDomain SAMPLE_DOMAIN = NamiSampleDomain::XY;
+
+                        NamiWaveLUTSampler(const NamiGenOptions& opts)
+                            : xFactor(static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER)
+                            , yFactor(static_cast<float>(opts.latMax - opts.latMin) * LAT_METER)
+                            , centerX(opts.gapBottom)
+                            , centerY(opts.gapTop)
+        {
+            float H = std::abs(opts.zLand);
+            float k = std::sqrt(0.75f * H / opts.zBottom / opts.zBottom / opts.zBottom);
+
+            // Farthest corner from the center
+            float farX = static_cast<float>(std::max(std::abs(centerX), std::abs(opts.sizeX - 1 - centerX))) * std::abs(xFactor);
+            float farY = static_cast<float>(std::max(std::abs(centerY), std::abs(opts.sizeY - 1 - centerY))) * std::abs(yFactor);
+            float end = std::sqrt(farX * farX + farY * farY);
+            // Beyond this distance the wave is below half the error bound,
+            // clamped table end is returned there (half leaves room for the
+            // rounding of the end value)
+            if(H > opts.lutError && k > 0.0f)
+                end = std::min(end, std::acosh(std::sqrt(2.0f * H / opts.lutError)) / k);
+
+            // max |d^2/dd^2 H sech^2(k d)| = 2 H k^2
+            float d2 = 2.0f * H * k * k;
+            lut = NamiProfileLUT(0.0f, end, d2, opts.lutError, [&](float distance)
+            {
+                float coshTerm = std::cosh(k * distance);
+                return H / (coshTerm * coshTerm);
+            });
+        }
+
+        bool            Valid() const { return lut.Valid(); }
+        float           Sample(int x, int y) const
+        {
+            float xDist = static_cast<float>(x - centerX) * xFactor;
+            float yDist = static_cast<float>(y - centerY) * yFactor;
+            return lut.Sample(std::sqrt(xDist * xDist + yDist * yDist));
+        }
+};
+
+inline static bool UseProfileLUT(const NamiGenOptions& opts)
+{
+    return (opts.lutError > 0.0f &&
+            (opts.type == NamiGenType::CIRCULAR_SINUSODIAL ||
+             opts.type == NamiGenType::WAVE_CIRCULAR));
+}
+
+// Calls "func" with the table sampler of the type, returns false
+// if the type has no table or the error bound needs a too large table
+template<class Func>
+inline static bool DispatchLUTSampler(const NamiGenOptions& opts, Func&& func)
+{
+    if(!UseProfileLUT(opts)) return false;
+    if(opts.type == NamiGenType::CIRCULAR_SINUSODIAL)
+    {
+        NamiCircleLUTSampler sampler(opts);
+        if(!sampler.Valid()) return false;
+        func(sampler);
+    }
+    else
+    {
+        NamiWaveLUTSampler sampler(opts);
+        if(!sampler.Valid()) return false;
+        func(sampler);
+    }
+    return true;
+}
+
+inline static float MaxAbsError(const float* ref, const float* data, size_t count)
+{
+    float error = 0.0f;
+    for(size_t i = 0; i < count; i++)
+        error = std::max(error, std::abs(ref[i] - data[i]));
+    return error;
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+// Readers of existing grids
+// Binary grids (DSBB) are mapped copy on write and used in place,
+// ascii grids (DSAA) are parsed in parallel chunks into a float array
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <charconv>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenMappedFile.h"
+#include "NamiGenWriters.h"
+
+// Target size of a parsed ascii chunk
+constexpr size_t NAMI_GRD_PARSE_CHUNK_BYTES = 4 * 1024 * 1024;
+
+struct NamiGridHeader
+{
+    // GRD or GRD_BIN
+    NamiGenOut  format;
+    int         sizeX, sizeY;
+    double      latMin, latMax;
+    double      lonMin, lonMax;
+    double      min, max;
+};
+
+// Grid of a file, "data" points to the mapped file (binary)
+// or to "values" (ascii), rows are sizeX floats apart
+struct NamiInputGrid
+{
+    NamiGridHeader      header;
+    NamiMappedFile      file;
+    std::vector<float>  values;
+    float*              data = nullptr;
+};
+
+template<class T>
+inline static const char* GetLittleEndian(const char* in, T& value)
+{
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, in, sizeof(T));
+    if(!IsLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+    std::memcpy(&value, bytes, sizeof(T));
+    return in + sizeof(T);
+}
+
+// Ascii header lines are read as "GRDHeader" writes them (lat before lon),
+// so grids of NamiGen round trip
+// Returns false if the file is not a DSAA or DSBB grid
+inline static bool ReadGridHeader(const std::string& fileName, NamiGridHeader& header)
+{
+    std::ifstream file(fileName, std::ifstream::binary);
+    char fourCC[4];
+    if(!file.read(fourCC, sizeof(fourCC))) return false;
+
+    if(std::memcmp(fourCC, "DSAA", 4) == 0)
+    {
+        header.format = NamiGenOut::GRD;
+        file >> header.sizeX >> header.sizeY
+             >> header.latMin >> header.latMax
+             >> header.lonMin >> header.lonMax
+             >> header.min >> header.max;
+    }
+    else if(std::memcmp(fourCC, "DSBB", 4) == 0)
+    {
+        char bytes[NAMI_GRD_BIN_HEADER_SIZE - 4];
+        if(!file.read(bytes, sizeof(bytes))) return false;
+        int16_t sizeX, sizeY;
+        const char* in = bytes;
+        in = GetLittleEndian(in, sizeX);
+        in = GetLittleEndian(in, sizeY);
+        in = GetLittleEndian(in, header.lonMin);
+        in = GetLittleEndian(in, header.lonMax);
+        in = GetLittleEndian(in, header.latMin);
+        in = GetLittleEndian(in, header.latMax);
+        in = GetLittleEndian(in, header.min);
+        in = GetLittleEndian(in, header.max);
+        header.format = NamiGenOut::GRD_BIN;
+        header.sizeX = sizeX;
+        header.sizeY = sizeY;
+    }
+    else return false;
+    return static_cast<bool>(file) && header.sizeX > 0 && header.sizeY > 0;
+}
+
+// Ascii values of "body" are split into chunks at whitespace, chunks
+// are counted then parsed on the pool
+inline static bool ParseGRDValues(float* out, size_t count,
+                                  const char* body, size_t size,
+                                  NamiThreadPool& pool)
+{
+    auto isSpace = [](char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; };
+
+    std::vector<size_t> bounds = {0};
+    while(bounds.back() < size)
+    {
+        size_t end = std::min(bounds.back() + NAMI_GRD_PARSE_CHUNK_BYTES, size);
+        while(end < size && !isSpace(body[end])) end++;
+        bounds.push_back(end);
+    }
+    size_t chunkCount = bounds.size() - 1;
+
+    // Values per chunk, then their output offsets
+    std::vector<size_t> offsets(chunkCount + 1, 0);
+    for(size_t c = 0; c < chunkCount; c++)
+    {
+        pool.Submit([&, c]()
+        {
+            size_t tokens = 0;
+            bool inToken = false;
+            for(size_t i = bounds[c]; i < bounds[c + 1]; i++)
+            {
+                bool space = isSpace(body[i]);
+                tokens += (!space && !inToken);
+                inToken = !space;
+            }
+            offsets[c + 1] = tokens;
+        });
+    }
+    pool.Wait();
+    for(size_t c = 0; c < chunkCount; c++)
+        offsets[c + 1] += offsets[c];
+    if(offsets[chunkCount] != count) return false;
+
+    std::vector<char> failed(chunkCount, 0);
+    for(size_t c = 0; c < chunkCount; c++)
+    {
+        pool.Submit([&, c]()
+        {
+            const char* ptr = body + bounds[c];
+            const char* end = body + bounds[c + 1];
+            float* value = out + offsets[c];
+            while(ptr < end)
+            {
+                while(ptr < end && isSpace(*ptr)) ptr++;
+                if(ptr == end) break;
+                // "from_chars" does not take the plus sign
+                if(*ptr == '+') ptr++;
+                std::from_chars_result result = std::from_chars(ptr, end, *value);
+                if(result.ec != std::errc() ||
+                   (result.ptr < end && !isSpace(*result.ptr)))
+                {
+                    failed[c] = 1;
+                    return;
+                }
+                ptr = result.ptr;
+                value++;
+            }
+        });
+    }
+    pool.Wait();
+    return std::count(failed.begin(), failed.end(), 1) == 0;
+}
+
+// Reads a DSAA or DSBB grid, values of binary grids stay in the mapping
+// and are only copied when they are written
+// Prints the reason and returns false on failure
+inline static bool ReadGrid(const std::string& fileName, NamiInputGrid& grid,
+                            NamiThreadPool& pool)
+{
+    if(!ReadGridHeader(fileName, grid.header) || !grid.file.OpenExisting(fileName))
+    {
+        std::cout << "Unable to read grid \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    const NamiGridHeader& header = grid.header;
+    size_t count = static_cast<size_t>(header.sizeX) * header.sizeY;
+    const char* file = grid.file.Data();
+    size_t fileSize = grid.file.Size();
+    if(header.format == NamiGenOut::GRD_BIN)
+    {
+        if(fileSize < NAMI_GRD_BIN_HEADER_SIZE + count * sizeof(float))
+        {
+            std::cout << "Grid \"" << fileName << "\" is truncated" << std::endl;
+            return false;
+        }
+        // Header size keeps the values float aligned
+        grid.data = reinterpret_cast<float*>(grid.file.Data() + NAMI_GRD_BIN_HEADER_SIZE);
+        if(!IsLittleEndian()) FloatsToLittleEndian(grid.data, count);
+        return true;
+    }
+
+    // Values start after the header lines
+    size_t bodyStart = 0;
+    for(int line = 0; line < NAMI_GRD_HEADER_LINES && bodyStart < fileSize; bodyStart++)
+        line += (file[bodyStart] == '\n');
+    grid.values.resize(count);
+    grid.data = grid.values.data();
+    if(!ParseGRDValues(grid.data, count, file + bodyStart, fileSize - bodyStart, pool))
+    {
+        std::cout << "Grid \"" << fileName << "\" should have "
+                  << count << " valid values" << std::endl;
+        return false;
+    }
+    // Text is not needed anymore
+    grid.file.Close();
+    return true;
+}
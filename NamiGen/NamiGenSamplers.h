@@ -0,0 +1,324 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+
+// Compile time specialized samplers
+// Each NamiGenType maps to a single sampler instantiation so the hot loop
+// does not branch on the type. Arithmetic mirrors the free function samplers
+// in "NamiGenFunctions.h" operation by operation so results are bit exact.
+
+enum class NamiAxis
+{
+    X,
+    Y
+};
+
+enum class NamiProfile
+{
+    LINEAR,
+    SINUSODIAL
+};
+
+enum class NamiWaveShape
+{
+    CIRCULAR,
+    HORIZONTAL,
+    VERTICAL,
+    EMPTY
+};
+
+// Coordinates that a sampler depends on
+// X (or Y) only samplers produce identical rows (or constant rows)
+// so their profile can be evaluated once per coordinate
+enum class NamiSampleDomain
+{
+    XY,
+    X,
+    Y
+};
+
+// Land regions of the grid as row/column ranges
+// Rows outside [rowStart, rowEnd) and columns outside [colStart, colEnd)
+// are filled with zLand
+struct NamiWallMask
+{
+    int rowStart, rowEnd;
+    int colStart, colEnd;
+};
+
+inline static bool IsWaveType(NamiGenType type)
+{
+    return (type == NamiGenType::WAVE_CIRCULAR ||
+            type == NamiGenType::WAVE_HORIZONTAL ||
+            type == NamiGenType::WAVE_VERTICAL ||
+            type == NamiGenType::WAVE_EMPTY);
+}
+
+inline static NamiWallMask GenWallMask(const NamiGenOptions& opts)
+{
+    NamiWallMask mask = {0, opts.sizeY, 0, opts.sizeX};
+    if(IsWaveType(opts.type)) return mask;
+
+    bool duhis = (opts.type == NamiGenType::DUHIS);
+    bool walls = (!duhis && opts.hasWalls);
+
+    // Bottom rows are land for every bathymetry
+    // (wall check of "SampleCell" applies it regardless of "hasWalls")
+    mask.rowEnd = opts.sizeY - opts.wallWidth;
+    if(duhis || walls)
+        mask.rowStart = opts.wallWidth;
+    if(walls)
+    {
+        mask.colStart = opts.wallWidth;
+        mask.colEnd = opts.sizeX - opts.wallWidth;
+    }
+
+    // Clamp to the grid
+    mask.rowStart = std::max(0, std::min(mask.rowStart, opts.sizeY));
+    mask.rowEnd = std::max(mask.rowStart, std::min(mask.rowEnd, opts.sizeY));
+    mask.colStart = std::max(0, std::min(mask.colStart, opts.sizeX));
+    mask.colEnd = std::max(mask.colStart, std::min(mask.colEnd, opts.sizeX));
+    return mask;
+}
+
+template<NamiProfile P>
+class NamiProfileSampler
+{
+    private:
+        float   zLand;
+        float   zBottom;
+        float   zRange;
+        float   tana;
+
+    public:
+                NamiProfileSampler(const NamiGenOptions& opts)
+                    : zLand(opts.zLand)
+                    , zBottom(opts.zBottom)
+                    , zRange(opts.zBottom - opts.zLand)
+                    , tana(opts.tana)
+                {}
+
+        // "norm" is reversed normalized distance (1 is bottom)
+        float   Sample(float norm) const
+        {
+            float bathy;
+            if(P == NamiProfile::SINUSODIAL)
+            {
+                norm *= NAMI_PI;
+                norm -= NAMI_PI;
+                bathy = std::cos(norm) * 0.5f + 0.5f;
+                bathy *= zRange;
+                bathy += zLand;
+            }
+            else
+            {
+                bathy = norm * tana;
+                bathy *= zRange;
+                bathy += zLand;
+                bathy = std::min(zBottom, bathy);
+            }
+            return bathy;
+        }
+};
+
+template<NamiProfile P>
+class NamiCircleSampler
+{
+    private:
+        NamiProfileSampler<P>   profile;
+        float                   centerX, centerY;
+        float                   bottom, top, range;
+        float                   zLand, zBottom;
+
+    public:
+        static constexpr NamiSampleDomain SAMPLE_DOMAIN = NamiSampleDomain::XY;
+
+                                NamiCircleSampler(const NamiGenOptions& opts)
+                                    : profile(opts)
+                                    , centerX(static_cast<float>(opts.sizeX) * 0.5f)
+                                    , centerY(static_cast<float>(opts.sizeY) * 0.5f)
+                                    , bottom(static_cast<float>(opts.gapBottom / 2))
+                                    , top(static_cast<float>(opts.gapTop / 2))
+                                    , range(static_cast<float>(opts.gapTop / 2 - opts.gapBottom / 2))
+                                    , zLand(opts.zLand)
+                                    , zBottom(opts.zBottom)
+                                {}
+
+        float                   Sample(int x, int y) const
+        {
+            float dx = static_cast<float>(x) - centerX;
+            float dy = static_cast<float>(y) - centerY;
+            float distance = std::sqrt(dx * dx + dy * dy);
+
+            if(distance > top) return zLand;
+            else if(distance < bottom) return zBottom;
+
+            distance -= bottom;
+            distance /= range;
+            distance = 1.0f - distance;
+            return profile.Sample(distance);
+        }
+};
+
+template<NamiAxis A, bool Reverse, NamiProfile P>
+class NamiFlatSampler
+{
+    private:
+        NamiProfileSampler<P>   profile;
+        int                     last;
+        float                   gapBottom, gapTop, range;
+        float                   zLand, zBottom;
+
+    public:
+        static constexpr NamiSampleDomain SAMPLE_DOMAIN = (A == NamiAxis::X) ? NamiSampleDomain::X
+                                                                             : NamiSampleDomain::Y;
+
+                                NamiFlatSampler(const NamiGenOptions& opts)
+                                    : profile(opts)
+                                    , last(((A == NamiAxis::X) ? opts.sizeX : opts.sizeY) - 1)
+                                    , gapBottom(static_cast<float>(opts.gapBottom))
+                                    , gapTop(static_cast<float>(opts.gapTop))
+                                    , range(static_cast<float>(opts.gapTop - opts.gapBottom))
+                                    , zLand(opts.zLand)
+                                    , zBottom(opts.zBottom)
+                                {}
+
+        float                   Sample(int x, int y) const
+        {
+            int coord = (A == NamiAxis::X) ? x : y;
+            float value = static_cast<float>((Reverse) ? (last - coord) : coord);
+
+            if(value > gapTop) return zLand;
+            else if(value < gapBottom) return zBottom;
+
+            value -= gapBottom;
+            value /= range;
+            value = 1.0f - value;
+            return profile.Sample(value);
+        }
+};
+
+class NamiDuhisSampler
+{
+    private:
+        NamiProfileSampler<NamiProfile::LINEAR> profile;
+        float                                   distanceX;
+        float                                   gapTop;
+        float                                   zLand;
+
+    public:
+        static constexpr NamiSampleDomain       SAMPLE_DOMAIN = NamiSampleDomain::X;
+
+                                                NamiDuhisSampler(const NamiGenOptions& opts)
+                                                    : profile(opts)
+                                                    , distanceX(static_cast<float>(opts.sizeX - opts.gapTop) * 0.5f)
+                                                    , gapTop(static_cast<float>(opts.gapTop))
+                                                    , zLand(opts.zLand)
+                                                {}
+
+        float                                   Sample(int x, int) const
+        {
+            float xFloat = static_cast<float>(x);
+            float distance;
+            if(xFloat < distanceX)
+            {
+                distance = xFloat;
+                distance /= distanceX;
+                distance = 1.0f - distance;
+            }
+            else if(xFloat > distanceX + gapTop)
+            {
+                distance = xFloat - distanceX - gapTop;
+                distance /= distanceX;
+            }
+            else return zLand;
+            return profile.Sample(distance);
+        }
+};
+
+template<NamiWaveShape S>
+class NamiWaveSampler
+{
+    private:
+        float   H;
+        float   k;
+        float   xFactor, yFactor;
+        int     centerX, centerY;
+
+    public:
+        static constexpr NamiSampleDomain SAMPLE_DOMAIN = (S == NamiWaveShape::CIRCULAR)   ? NamiSampleDomain::XY :
+                                                          (S == NamiWaveShape::HORIZONTAL) ? NamiSampleDomain::Y
+                                                                                           : NamiSampleDomain::X;
+
+                NamiWaveSampler(const NamiGenOptions& opts)
+                    : H(std::abs(opts.zLand))
+                    , k(std::sqrt(0.75f * H / opts.zBottom / opts.zBottom / opts.zBottom))
+                    , xFactor(static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER)
+                    , yFactor(static_cast<float>(opts.latMax - opts.latMin) * LAT_METER)
+                    , centerX(opts.gapBottom)
+                    , centerY((S == NamiWaveShape::CIRCULAR) ? opts.gapTop : opts.gapBottom)
+                {}
+
+        float   Sample(int x, int y) const
+        {
+            float centerDist;
+            if(S == NamiWaveShape::EMPTY) return 0.0f;
+            else if(S == NamiWaveShape::CIRCULAR)
+            {
+                float xDist = static_cast<float>(x - centerX) * xFactor;
+                float yDist = static_cast<float>(y - centerY) * yFactor;
+                centerDist = std::sqrt(xDist * xDist + yDist * yDist);
+            }
+            else if(S == NamiWaveShape::HORIZONTAL)
+                centerDist = static_cast<float>(y - centerY) * yFactor;
+            else
+                centerDist = static_cast<float>(x - centerX) * xFactor;
+
+            float coshTerm = std::cosh(k * centerDist);
+            return H / (coshTerm * coshTerm);
+        }
+};
+
+// Calls "func" with the sampler instance of the type
+// Invalid type generates zeros (inside the wall mask)
+template<class Func>
+inline static void DispatchSampler(const NamiGenOptions& opts, Func&& func)
+{
+    switch(opts.type)
+    {
+        case NamiGenType::CIRCULAR_SINUSODIAL:
+            func(NamiCircleSampler<NamiProfile::SINUSODIAL>(opts)); break;
+        case NamiGenType::CIRCULAR_LINEAR:
+            func(NamiCircleSampler<NamiProfile::LINEAR>(opts)); break;
+        case NamiGenType::LINEAR_R:
+            func(NamiFlatSampler<NamiAxis::X, false, NamiProfile::LINEAR>(opts)); break;
+        case NamiGenType::LINEAR_L:
+            func(NamiFlatSampler<NamiAxis::X, true, NamiProfile::LINEAR>(opts)); break;
+        case NamiGenType::LINEAR_T:
+            func(NamiFlatSampler<NamiAxis::Y, false, NamiProfile::LINEAR>(opts)); break;
+        case NamiGenType::LINEAR_B:
+            func(NamiFlatSampler<NamiAxis::Y, true, NamiProfile::LINEAR>(opts)); break;
+        case NamiGenType::SINUSODIAL_R:
+            func(NamiFlatSampler<NamiAxis::X, false, NamiProfile::SINUSODIAL>(opts)); break;
+        case NamiGenType::SINUSODIAL_L:
+            func(NamiFlatSampler<NamiAxis::X, true, NamiProfile::SINUSODIAL>(opts)); break;
+        case NamiGenType::SINUSODIAL_T:
+            func(NamiFlatSampler<NamiAxis::Y, false, NamiProfile::SINUSODIAL>(opts)); break;
+        case NamiGenType::SINUSODIAL_B:
+            func(NamiFlatSampler<NamiAxis::Y, true, NamiProfile::SINUSODIAL>(opts)); break;
+        case NamiGenType::DUHIS:
+            func(NamiDuhisSampler(opts)); break;
+        case NamiGenType::WAVE_CIRCULAR:
+            func(NamiWaveSampler<NamiWaveShape::CIRCULAR>(opts)); break;
+        case NamiGenType::WAVE_HORIZONTAL:
+            func(NamiWaveSampler<NamiWaveShape::HORIZONTAL>(opts)); break;
+        case NamiGenType::WAVE_VERTICAL:
+            func(NamiWaveSampler<NamiWaveShape::VERTICAL>(opts)); break;
+        default:
+            func(NamiWaveSampler<NamiWaveShape::EMPTY>(opts)); break;
+    }
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenSamplers.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+    #define NAMI_SIMD_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+#endif
+
+// Vectorized kernels use polynomial cos/exp approximations
+// Results differ from the scalar samplers by at most "SimdUlpTolerance" ULPs,
+// ULP is measured at the magnitude of the output range
+// (max(|min|, |max|) of the grid)
+// Bathymetry profiles round once after the polynomial
+constexpr float NAMI_SIMD_PROFILE_ULP_TOLERANCE = 4.0f;
+// Waves: scalar sampler (std::cosh, square, divide) and the kernel (Exp,
+// 4e / (1 + e)^2) are each within 4 ULPs of H sech^2, 3.6 and 3.5 measured
+constexpr float NAMI_SIMD_WAVE_ULP_TOLERANCE = 8.0f;
+
+inline static float SimdUlpTolerance(NamiGenType type)
+{
+    return (IsWaveType(type)) ? NAMI_SIMD_WAVE_ULP_TOLERANCE
+                              : NAMI_SIMD_PROFILE_ULP_TOLERANCE;
+}
+
+enum class NamiSimdLevel
+{
+    SCALAR,
+    SSE,
+    AVX2,
+    AVX512
+};
+
+// Loop invariant values of the samplers
+struct NamiSimdParams
+{
+    float zRange;
+    // Circle
+    float centerX, centerY;
+    float circleBottom, circleTop, circleRange;
+    // Flat
+    float flatRange;
+    // Duhis
+    float duhisDistance;
+    // Wave
+    float waveH, waveK;
+    float xFactor, yFactor;
+};
+
+inline static NamiSimdParams GenSimdParams(const NamiGenOptions& opts)
+{
+    NamiSimdParams p;
+    p.zRange = opts.zBottom - opts.zLand;
+
+    p.centerX = static_cast<float>(opts.sizeX) * 0.5f;
+    p.centerY = static_cast<float>(opts.sizeY) * 0.5f;
+    p.circleBottom = static_cast<float>(opts.gapBottom / 2);
+    p.circleTop = static_cast<float>(opts.gapTop / 2);
+    p.circleRange = static_cast<float>(opts.gapTop / 2 - opts.gapBottom / 2);
+
+    p.flatRange = static_cast<float>(opts.gapTop - opts.gapBottom);
+
+    p.duhisDistance = static_cast<float>(opts.sizeX - opts.gapTop) * 0.5f;
+
+    float H = std::abs(opts.zLand);
+    float d = opts.zBottom;
+    p.waveH = H;
+    p.waveK = std::sqrt(0.75f * H / d / d / d);
+    p.xFactor = static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER;
+    p.yFactor = static_cast<float>(opts.latMax - opts.latMin) * LAT_METER;
+    return p;
+}
+
+#ifdef NAMI_SIMD_X86
+
+// Instruction set regions
+// MSVC can emit any intrinsic without extra flags,
+// GCC/Clang needs target attributes on each function
+#if defined(__clang__)
+    #define NAMI_TARGET_BEGIN_AVX2 \
+        _Pragma("clang attribute push(__attribute__((target(\"avx2,fma\"))), apply_to = function)")
+    #define NAMI_TARGET_BEGIN_AVX512 \
+        _Pragma("clang attribute push(__attribute__((target(\"avx512f,avx2,fma\"))), apply_to = function)")
+    #define NAMI_TARGET_END _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+    #define NAMI_TARGET_BEGIN_AVX2 \
+        _Pragma("GCC push_options") _Pragma("GCC target(\"avx2,fma\")")
+    #define NAMI_TARGET_BEGIN_AVX512 \
+        _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f,avx2,fma\")")
+    #define NAMI_TARGET_END _Pragma("GCC pop_options")
+#else
+    #define NAMI_TARGET_BEGIN_AVX2
+    #define NAMI_TARGET_BEGIN_AVX512
+    #define NAMI_TARGET_END
+#endif
+
+// SSE2 (x64 baseline)
+namespace NamiSimdSSE
+{
+    using VecF = __m128;
+    using VecI = __m128i;
+    using Mask = __m128;
+    constexpr int WIDTH = 4;
+
+    inline VecF Set1(float f) { return _mm_set1_ps(f); }
+    inline VecF Iota() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+    inline VecF Load(const float* p) { return _mm_loadu_ps(p); }
+    inline void Store(float* p, VecF v) { _mm_storeu_ps(p, v); }
+    inline VecF Add(VecF a, VecF b) { return _mm_add_ps(a, b); }
+    inline VecF Sub(VecF a, VecF b) { return _mm_sub_ps(a, b); }
+    inline VecF Mul(VecF a, VecF b) { return _mm_mul_ps(a, b); }
+    inline VecF Div(VecF a, VecF b) { return _mm_div_ps(a, b); }
+    inline VecF Min(VecF a, VecF b) { return _mm_min_ps(a, b); }
+    inline VecF Max(VecF a, VecF b) { return _mm_max_ps(a, b); }
+    inline VecF Sqrt(VecF a) { return _mm_sqrt_ps(a); }
+    inline VecF Abs(VecF a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    inline VecF Xor(VecF a, VecF b) { return _mm_xor_ps(a, b); }
+    inline Mask CmpLT(VecF a, VecF b) { return _mm_cmplt_ps(a, b); }
+    inline Mask CmpGT(VecF a, VecF b) { return _mm_cmpgt_ps(a, b); }
+    inline Mask OrMask(Mask a, Mask b) { return _mm_or_ps(a, b); }
+    inline VecF Select(Mask m, VecF a, VecF b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+    inline VecI SetI1(int i) { return _mm_set1_epi32(i); }
+    inline VecI F2I(VecF a) { return _mm_cvttps_epi32(a); }
+    inline VecF I2F(VecI a) { return _mm_cvtepi32_ps(a); }
+    inline VecF AsFloat(VecI a) { return _mm_castsi128_ps(a); }
+    inline VecI IAdd(VecI a, VecI b) { return _mm_add_epi32(a, b); }
+    inline VecI ISub(VecI a, VecI b) { return _mm_sub_epi32(a, b); }
+    inline VecI IAnd(VecI a, VecI b) { return _mm_and_si128(a, b); }
+    inline VecI IAndNot(VecI a, VecI b) { return _mm_andnot_si128(a, b); }
+    inline VecI IShl23(VecI a) { return _mm_slli_epi32(a, 23); }
+    inline VecI IShl29(VecI a) { return _mm_slli_epi32(a, 29); }
+    inline Mask ICmpEq(VecI a, VecI b) { return _mm_castsi128_ps(_mm_cmpeq_epi32(a, b)); }
+
+    inline float ReduceMin(VecF v)
+    {
+        v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+    inline float ReduceMax(VecF v)
+    {
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+
+    #include "NamiGenSimdKernels.inl"
+}
+
+NAMI_TARGET_BEGIN_AVX2
+namespace NamiSimdAVX2
+{
+    using VecF = __m256;
+    using VecI = __m256i;
+    using Mask = __m256;
+    constexpr int WIDTH = 8;
+
+    inline VecF Set1(float f) { return _mm256_set1_ps(f); }
+    inline VecF Iota() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+    inline VecF Load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void Store(float* p, VecF v) { _mm256_storeu_ps(p, v); }
+    inline VecF Add(VecF a, VecF b) { return _mm256_add_ps(a, b); }
+    inline VecF Sub(VecF a, VecF b) { return _mm256_sub_ps(a, b); }
+    inline VecF Mul(VecF a, VecF b) { return _mm256_mul_ps(a, b); }
+    inline VecF Div(VecF a, VecF b) { return _mm256_div_ps(a, b); }
+    inline VecF Min(VecF a, VecF b) { return _mm256_min_ps(a, b); }
+    inline VecF Max(VecF a, VecF b) { return _mm256_max_ps(a, b); }
+    inline VecF Sqrt(VecF a) { return _mm256_sqrt_ps(a); }
+    inline VecF Abs(VecF a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    inline VecF Xor(VecF a, VecF b) { return _mm256_xor_ps(a, b); }
+    inline Mask CmpLT(VecF a, VecF b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    inline Mask CmpGT(VecF a, VecF b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    inline Mask OrMask(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+    inline VecF Select(Mask m, VecF a, VecF b) { return _mm256_blendv_ps(b, a, m); }
+
+    inline VecI SetI1(int i) { return _mm256_set1_epi32(i); }
+    inline VecI F2I(VecF a) { return _mm256_cvttps_epi32(a); }
+    inline VecF I2F(VecI a) { return _mm256_cvtepi32_ps(a); }
+    inline VecF AsFloat(VecI a) { return _mm256_castsi256_ps(a); }
+    inline VecI IAdd(VecI a, VecI b) { return _mm256_add_epi32(a, b); }
+    inline VecI ISub(VecI a, VecI b) { return _mm256_sub_epi32(a, b); }
+    inline VecI IAnd(VecI a, VecI b) { return _mm256_and_si256(a, b); }
+    inline VecI IAndNot(VecI a, VecI b) { return _mm256_andnot_si256(a, b); }
+    inline VecI IShl23(VecI a) { return _mm256_slli_epi32(a, 23); }
+    inline VecI IShl29(VecI a) { return _mm256_slli_epi32(a, 29); }
+    inline Mask ICmpEq(VecI a, VecI b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+
+    inline float ReduceMin(VecF v)
+    {
+        return NamiSimdSSE::ReduceMin(_mm_min_ps(_mm256_castps256_ps128(v),
+                                                 _mm256_extractf128_ps(v, 1)));
+    }
+    inline float ReduceMax(VecF v)
+    {
+        return NamiSimdSSE::ReduceMax(_mm_max_ps(_mm256_castps256_ps128(v),
+                                                 _mm256_extractf128_ps(v, 1)));
+    }
+
+    #include "NamiGenSimdKernels.inl"
+}
+NAMI_TARGET_END
+
+NAMI_TARGET_BEGIN_AVX512
+namespace NamiSimdAVX512
+{
+    using VecF = __m512;
+    using VecI = __m512i;
+    using Mask = __mmask16;
+    constexpr int WIDTH = 16;
+
+    inline VecF Set1(float f) { return _mm512_set1_ps(f); }
+    inline VecF Iota()
+    {
+        return _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f,
+                              8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+    }
+    inline VecF Load(const float* p) { return _mm512_loadu_ps(p); }
+    inline void Store(float* p, VecF v) { _mm512_storeu_ps(p, v); }
+    inline VecF Add(VecF a, VecF b) { return _mm512_add_ps(a, b); }
+    inline VecF Sub(VecF a, VecF b) { return _mm512_sub_ps(a, b); }
+    inline VecF Mul(VecF a, VecF b) { return _mm512_mul_ps(a, b); }
+    inline VecF Div(VecF a, VecF b) { return _mm512_div_ps(a, b); }
+    inline VecF Min(VecF a, VecF b) { return _mm512_min_ps(a, b); }
+    inline VecF Max(VecF a, VecF b) { return _mm512_max_ps(a, b); }
+    inline VecF Sqrt(VecF a) { return _mm512_sqrt_ps(a); }
+    inline VecF Abs(VecF a)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a),
+                                                     _mm512_set1_epi32(0x7FFFFFFF)));
+    }
+    inline VecF Xor(VecF a, VecF b)
+    {
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a),
+                                                    _mm512_castps_si512(b)));
+    }
+    inline Mask CmpLT(VecF a, VecF b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    inline Mask CmpGT(VecF a, VecF b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    inline Mask OrMask(Mask a, Mask b) { return static_cast<Mask>(a | b); }
+    inline VecF Select(Mask m, VecF a, VecF b) { return _mm512_mask_blend_ps(m, b, a); }
+
+    inline VecI SetI1(int i) { return _mm512_set1_epi32(i); }
+    inline VecI F2I(VecF a) { return _mm512_cvttps_epi32(a); }
+    inline VecF I2F(VecI a) { return _mm512_cvtepi32_ps(a); }
+    inline VecF AsFloat(VecI a) { return _mm512_castsi512_ps(a); }
+    inline VecI IAdd(VecI a, VecI b) { return _mm512_add_epi32(a, b); }
+    inline VecI ISub(VecI a, VecI b) { return _mm512_sub_epi32(a, b); }
+    inline VecI IAnd(VecI a, VecI b) { return _mm512_and_si512(a, b); }
+    inline VecI IAndNot(VecI a, VecI b) { return _mm512_andnot_si512(a, b); }
+    inline VecI IShl23(VecI a) { return _mm512_slli_epi32(a, 23); }
+    inline VecI IShl29(VecI a) { return _mm512_slli_epi32(a, 29); }
+    inline Mask ICmpEq(VecI a, VecI b) { return _mm512_cmpeq_epi32_mask(a, b); }
+
+    inline float ReduceMin(VecF v)
+    {
+        __m256 h = _mm256_min_ps(_mm512_castps512_ps256(v),
+                                 _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1)));
+        return NamiSimdAVX2::ReduceMin(h);
+    }
+    inline float ReduceMax(VecF v)
+    {
+        __m256 h = _mm256_max_ps(_mm512_castps512_ps256(v),
+                                 _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1)));
+        return NamiSimdAVX2::ReduceMax(h);
+    }
+
+    #include "NamiGenSimdKernels.inl"
+}
+NAMI_TARGET_END
+
+inline static NamiSimdLevel DetectSimdLevel()
+{
+    #ifdef _MSC_VER
+        int info[4];
+        __cpuidex(info, 7, 0);
+        bool avx2 = (info[1] & (1 << 5)) != 0;
+        bool avx512 = (info[1] & (1 << 16)) != 0;
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool fma = (info[2] & (1 << 12)) != 0;
+        unsigned long long xcr0 = (osxsave) ? _xgetbv(0) : 0;
+        bool ymmState = (xcr0 & 0x6) == 0x6;
+        bool zmmState = (xcr0 & 0xE6) == 0xE6;
+        if(avx512 && zmmState) return NamiSimdLevel::AVX512;
+        if(avx2 && fma && ymmState) return NamiSimdLevel::AVX2;
+        return NamiSimdLevel::SSE;
+    #else
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f")) return NamiSimdLevel::AVX512;
+        if(__builtin_cpu_supports("avx2") &&
+           __builtin_cpu_supports("fma")) return NamiSimdLevel::AVX2;
+        return NamiSimdLevel::SSE;
+    #endif
+}
+
+#else
+
+inline static NamiSimdLevel DetectSimdLevel()
+{
+    return NamiSimdLevel::SCALAR;
+}
+
+#endif
+
+// Requested level is clamped to the one that CPU supports
+inline static NamiSimdLevel ResolveSimdLevel(NamiGenSimd simd)
+{
+    NamiSimdLevel detected = DetectSimdLevel();
+    NamiSimdLevel requested;
+    switch(simd)
+    {
+        case NamiGenSimd::SSE:      requested = NamiSimdLevel::SSE; break;
+        case NamiGenSimd::AVX2:     requested = NamiSimdLevel::AVX2; break;
+        case NamiGenSimd::AVX512:   requested = NamiSimdLevel::AVX512; break;
+        case NamiGenSimd::AUTO:     requested = detected; break;
+        default:                    requested = NamiSimdLevel::SCALAR; break;
+    }
+    return std::min(requested, detected);
+}
+
+inline static const char* SimdLevelToString(NamiSimdLevel level)
+{
+    switch(level)
+    {
+        case NamiSimdLevel::SSE:    return "sse";
+        case NamiSimdLevel::AVX2:   return "avx2";
+        case NamiSimdLevel::AVX512: return "avx512";
+        default:                    return "scalar";
+    }
+}
+
+// Max difference in terms of ULPs at the magnitude of the reference range
+inline static float SimdUlpError(const float* reference, const float* simd,
+                                 size_t count, NamiMinMax referenceMinMax)
+{
+    float magnitude = std::max(std::abs(referenceMinMax.min),
+                               std::abs(referenceMinMax.max));
+    float ulp = std::nextafter(magnitude, FLT_MAX) - magnitude;
+    if(ulp == 0.0f || !std::isfinite(ulp)) ulp = FLT_MIN;
+
+    float maxError = 0.0f;
+    for(size_t i = 0; i < count; i++)
+    {
+        float error = std::abs(reference[i] - simd[i]) / ulp;
+        if(!(error <= maxError)) maxError = error;
+    }
+    return maxError;
+}
@@ -0,0 +1,307 @@
+// Generic vectorized row kernels
+// This file is included once per instruction set by "NamiGenSimd.h"
+// Enclosing namespace should provide VecF, VecI, Mask, WIDTH
+// and the primitive operations used below
+
+// Cephes style cosine (sse_mathfun port)
+inline VecF Cos(VecF x)
+{
+    x = Abs(x);
+
+    // Octant
+    VecF y = Mul(x, Set1(1.27323954473516f));
+    VecI j = F2I(y);
+    j = IAdd(j, SetI1(1));
+    j = IAnd(j, SetI1(~1));
+    y = I2F(j);
+    j = ISub(j, SetI1(2));
+
+    VecF sign = AsFloat(IShl29(IAndNot(j, SetI1(4))));
+    Mask sinPoly = ICmpEq(IAnd(j, SetI1(2)), SetI1(0));
+
+    // Extended precision modular arithmetic
+    x = Add(x, Mul(y, Set1(-0.78515625f)));
+    x = Add(x, Mul(y, Set1(-2.4187564849853515625e-4f)));
+    x = Add(x, Mul(y, Set1(-3.77489497744594108e-8f)));
+    VecF z = Mul(x, x);
+
+    VecF yc = Set1(2.443315711809948E-005f);
+    yc = Add(Mul(yc, z), Set1(-1.388731625493765E-003f));
+    yc = Add(Mul(yc, z), Set1(4.166664568298827E-002f));
+    yc = Mul(Mul(yc, z), z);
+    yc = Sub(yc, Mul(z, Set1(0.5f)));
+    yc = Add(yc, Set1(1.0f));
+
+    VecF ys = Set1(-1.9515295891E-4f);
+    ys = Add(Mul(ys, z), Set1(8.3321608736E-3f));
+    ys = Add(Mul(ys, z), Set1(-1.6666654611E-1f));
+    ys = Mul(Mul(ys, z), x);
+    ys = Add(ys, x);
+
+    return Xor(Select(sinPoly, ys, yc), sign);
+}
+
+// Cephes style exponential (sse_mathfun port)
+// Input is clamped so result never overflows to inf
+// Min/Max return their second operand on NaN, so NaN passes through
+inline VecF Exp(VecF x)
+{
+    x = Min(Set1(88.3762626647949f), x);
+    x = Max(Set1(-88.3762626647949f), x);
+
+    // exp(x) = 2^n * exp(g)
+    VecF fx = Add(Mul(x, Set1(1.44269504088896341f)), Set1(0.5f));
+    VecF t = I2F(F2I(fx));
+    fx = Sub(t, Select(CmpGT(t, fx), Set1(1.0f), Set1(0.0f)));
+
+    x = Sub(x, Mul(fx, Set1(0.693359375f)));
+    x = Sub(x, Mul(fx, Set1(-2.12194440e-4f)));
+    VecF z = Mul(x, x);
+
+    VecF y = Set1(1.9875691500E-4f);
+    y = Add(Mul(y, x), Set1(1.3981999507E-3f));
+    y = Add(Mul(y, x), Set1(8.3334519073E-3f));
+    y = Add(Mul(y, x), Set1(4.1665795894E-2f));
+    y = Add(Mul(y, x), Set1(1.6666665459E-1f));
+    y = Add(Mul(y, x), Set1(5.0000001201E-1f));
+    y = Add(Mul(y, z), x);
+    y = Add(y, Set1(1.0f));
+
+    VecF pow2n = AsFloat(IShl23(IAdd(F2I(fx), SetI1(0x7f))));
+    return Mul(y, pow2n);
+}
+
+// sech(x)^2 as 4e / (1 + e)^2 with e = exp(-2|x|), e is in (0, 1] so
+// neither the sum nor the square loses the small term like e + 1 / e does
+// e is squared from exp(-|x|) so it underflows gradually like the scalar
+// sampler, which is 0 once cosh(x)^2 overflows (|x| > acosh(sqrt(FLT_MAX)))
+inline VecF Sech2(VecF x)
+{
+    x = Abs(x);
+    VecF e = Exp(Max(Set1(-87.0f), Sub(Set1(0.0f), x)));
+    e = Mul(e, e);
+    VecF d = Add(Set1(1.0f), e);
+    VecF result = Div(Mul(Set1(4.0f), e), Mul(d, d));
+    return Select(CmpGT(x, Set1(45.0546f)), Set1(0.0f), result);
+}
+
+inline VecF XCoords(int x)
+{
+    return Add(Set1(static_cast<float>(x)), Iota());
+}
+
+inline void FillRow(float* row, int xStart, int xEnd, float value)
+{
+    VecF v = Set1(value);
+    int x = xStart;
+    for(; x + WIDTH <= xEnd; x += WIDTH)
+        Store(row + x, v);
+    for(; x < xEnd; x++)
+        row[x] = value;
+}
+
+inline void RowMinMax(const float* row, int count, NamiMinMax& result)
+{
+    VecF vMin = Set1(result.min);
+    VecF vMax = Set1(result.max);
+    int x = 0;
+    for(; x + WIDTH <= count; x += WIDTH)
+    {
+        VecF v = Load(row + x);
+        vMin = Min(v, vMin);
+        vMax = Max(v, vMax);
+    }
+    result.min = ReduceMin(vMin);
+    result.max = ReduceMax(vMax);
+    for(; x < count; x++)
+    {
+        result.min = std::min(row[x], result.min);
+        result.max = std::max(row[x], result.max);
+    }
+}
+
+// "std::min(a, b)" is "Min(b, a)", operands are swapped so a NaN profile
+// (degenerate gaps) clamps to zBottom as in the scalar samplers
+inline void CircleRow(float* row, int xOrigin, int y, int xStart, int xEnd,
+                      const NamiGenOptions& opts, const NamiSimdParams& p)
+{
+    VecF dy = Sub(Set1(static_cast<float>(y)), Set1(p.centerY));
+    VecF dy2 = Mul(dy, dy);
+    int x = xStart;
+    for(; x + WIDTH <= xEnd; x += WIDTH)
+    {
+        VecF dx = Sub(XCoords(x), Set1(p.centerX));
+        VecF distance = Sqrt(Add(Mul(dx, dx), dy2));
+
+        VecF norm = Sub(distance, Set1(p.circleBottom));
+        norm = Div(norm, Set1(p.circleRange));
+        norm = Sub(Set1(1.0f), norm);
+
+        VecF bathy;
+        if(opts.type == NamiGenType::CIRCULAR_SINUSODIAL)
+        {
+            norm = Sub(Mul(norm, Set1(NAMI_PI)), Set1(NAMI_PI));
+            bathy = Add(Mul(Cos(norm), Set1(0.5f)), Set1(0.5f));
+            bathy = Add(Mul(bathy, Set1(p.zRange)), Set1(opts.zLand));
+        }
+        else
+        {
+            bathy = Mul(Mul(norm, Set1(opts.tana)), Set1(p.zRange));
+            bathy = Min(Add(bathy, Set1(opts.zLand)), Set1(opts.zBottom));
+        }
+        bathy = Select(CmpLT(distance, Set1(p.circleBottom)), Set1(opts.zBottom), bathy);
+        bathy = Select(CmpGT(distance, Set1(p.circleTop)), Set1(opts.zLand), bathy);
+        Store(row + (x - xOrigin), bathy);
+    }
+    for(; x < xEnd; x++)
+        row[x - xOrigin] = CircleSample(x, y, opts);
+}
+
+// Only left/right variants vary along the row
+inline void FlatRow(float* row, int xOrigin, int y, int xStart, int xEnd,
+                    const NamiGenOptions& opts, const NamiSimdParams& p)
+{
+    bool reverse = (opts.type == NamiGenType::LINEAR_L ||
+                    opts.type == NamiGenType::SINUSODIAL_L);
+    bool sinusodial = (opts.type == NamiGenType::SINUSODIAL_L ||
+                       opts.type == NamiGenType::SINUSODIAL_R);
+    int x = xStart;
+    for(; x + WIDTH <= xEnd; x += WIDTH)
+    {
+        VecF value = XCoords(x);
+        if(reverse) value = Sub(Set1(static_cast<float>(opts.sizeX - 1)), value);
+
+        VecF norm = Sub(value, Set1(static_cast<float>(opts.gapBottom)));
+        norm = Div(norm, Set1(p.flatRange));
+        norm = Sub(Set1(1.0f), norm);
+
+        VecF bathy;
+        if(sinusodial)
+        {
+            norm = Sub(Mul(norm, Set1(NAMI_PI)), Set1(NAMI_PI));
+            bathy = Add(Mul(Cos(norm), Set1(0.5f)), Set1(0.5f));
+            bathy = Add(Mul(bathy, Set1(p.zRange)), Set1(opts.zLand));
+        }
+        else
+        {
+            bathy = Mul(Mul(norm, Set1(opts.tana)), Set1(p.zRange));
+            bathy = Min(Add(bathy, Set1(opts.zLand)), Set1(opts.zBottom));
+        }
+        bathy = Select(CmpLT(value, Set1(static_cast<float>(opts.gapBottom))), Set1(opts.zBottom), bathy);
+        bathy = Select(CmpGT(value, Set1(static_cast<float>(opts.gapTop))), Set1(opts.zLand), bathy);
+        Store(row + (x - xOrigin), bathy);
+    }
+    for(; x < xEnd; x++)
+        row[x - xOrigin] = SampleFlat(x, y, opts);
+}
+
+inline void DuhisRow(float* row, int xOrigin, int y, int xStart, int xEnd,
+                     const NamiGenOptions& opts, const NamiSimdParams& p)
+{
+    VecF distanceX = Set1(p.duhisDistance);
+    VecF gapTop = Set1(static_cast<float>(opts.gapTop));
+    VecF wedgeEnd = Add(distanceX, gapTop);
+    int x = xStart;
+    for(; x + WIDTH <= xEnd; x += WIDTH)
+    {
+        VecF xFloat = XCoords(x);
+        VecF left = Sub(Set1(1.0f), Div(xFloat, distanceX));
+        VecF right = Div(Sub(Sub(xFloat, distanceX), gapTop), distanceX);
+        VecF distance = Select(CmpLT(xFloat, distanceX), left, right);
+
+        VecF bathy = Mul(Mul(distance, Set1(opts.tana)), Set1(p.zRange));
+        bathy = Min(Add(bathy, Set1(opts.zLand)), Set1(opts.zBottom));
+
+        // In between the wedges is land
+        Mask wedge = OrMask(CmpLT(xFloat, distanceX), CmpGT(xFloat, wedgeEnd));
+        Store(row + (x - xOrigin), Select(wedge, bathy, Set1(opts.zLand)));
+    }
+    for(; x < xEnd; x++)
+        row[x - xOrigin] = SampleDuhis(x, y, opts);
+}
+
+inline void WaveRow(float* row, int xOrigin, int y, int xStart, int xEnd,
+                    const NamiGenOptions& opts, const NamiSimdParams& p)
+{
+    bool circular = (opts.type == NamiGenType::WAVE_CIRCULAR);
+    VecF yDist = Set1(static_cast<float>(y - opts.gapTop) * p.yFactor);
+    VecF yDist2 = Mul(yDist, yDist);
+    int x = xStart;
+    for(; x + WIDTH <= xEnd; x += WIDTH)
+    {
+        VecF xDist = Mul(Sub(XCoords(x), Set1(static_cast<float>(opts.gapBottom))),
+                         Set1(p.xFactor));
+        VecF centerDist = (circular) ? Sqrt(Add(Mul(xDist, xDist), yDist2)) : xDist;
+        Store(row + (x - xOrigin),
+              Mul(Set1(p.waveH), Sech2(Mul(Set1(p.waveK), centerDist))));
+    }
+    for(; x < xEnd; x++)
+        row[x - xOrigin] = WaveSample(x, y, opts);
+}
+
+// Land regions are filled from the wall mask
+// Generates columns [colBegin, colEnd) of rows [rowStart, rowEnd),
+// "data" points to the cell (colBegin, rowStart), rows are "stride" floats apart
+inline NamiMinMax GenerateRows(float* data, size_t stride,
+                               int rowStart, int rowEnd,
+                               int colBegin, int colEnd,
+                               const NamiGenOptions& opts,
+                               const NamiWallMask& mask,
+                               const NamiSimdParams& p)
+{
+    int width = colEnd - colBegin;
+    // Mask columns relative to the window
+    int xStart = std::max(0, std::min(mask.colStart - colBegin, width));
+    int xEnd = std::max(xStart, std::min(mask.colEnd - colBegin, width));
+
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* row = data + static_cast<size_t>(y - rowStart) * stride;
+        if(y < mask.rowStart || y >= mask.rowEnd)
+        {
+            FillRow(row, 0, width, opts.zLand);
+            RowMinMax(row, width, result);
+            continue;
+        }
+
+        FillRow(row, 0, xStart, opts.zLand);
+        FillRow(row, xEnd, width, opts.zLand);
+        int gStart = colBegin + xStart;
+        int gEnd = colBegin + xEnd;
+        switch(opts.type)
+        {
+            case NamiGenType::CIRCULAR_LINEAR:
+            case NamiGenType::CIRCULAR_SINUSODIAL:
+                CircleRow(row, colBegin, y, gStart, gEnd, opts, p);
+                break;
+            case NamiGenType::LINEAR_L:
+            case NamiGenType::LINEAR_R:
+            case NamiGenType::SINUSODIAL_L:
+            case NamiGenType::SINUSODIAL_R:
+                FlatRow(row, colBegin, y, gStart, gEnd, opts, p);
+                break;
+            case NamiGenType::LINEAR_T:
+            case NamiGenType::LINEAR_B:
+            case NamiGenType::SINUSODIAL_T:
+            case NamiGenType::SINUSODIAL_B:
+                FillRow(row, xStart, xEnd, SampleFlat(gStart, y, opts));
+                break;
+            case NamiGenType::DUHIS:
+                DuhisRow(row, colBegin, y, gStart, gEnd, opts, p);
+                break;
+            case NamiGenType::WAVE_CIRCULAR:
+            case NamiGenType::WAVE_VERTICAL:
+                WaveRow(row, colBegin, y, gStart, gEnd, opts, p);
+                break;
+            case NamiGenType::WAVE_HORIZONTAL:
+                FillRow(row, xStart, xEnd, WaveSample(gStart, y, opts));
+                break;
+            default:
+                FillRow(row, xStart, xEnd, 0.0f);
+                break;
+        }
+        RowMinMax(row, width, result);
+    }
+    return result;
+}
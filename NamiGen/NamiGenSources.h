@@ -0,0 +1,396 @@
+#pragma once
+
+// Multi source waves
+// Solitary waves of many point or segment (fault) sources are superposed,
+// each source only touches the cells inside its support radius, sources
+// are bucketed over the window so a tile only visits the nearby ones
+
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenSimd.h"
+
+// Columns per source bucket, rows are "NAMI_TILE_ROWS"
+constexpr int NAMI_SOURCE_BUCKET_COLS = 64;
+// Contributions below "NAMI_SOURCE_CUTOFF * |height|" are dropped
+// (sech^2 is under half a float ULP of the crest)
+constexpr float NAMI_SOURCE_CUTOFF = FLT_EPSILON * 0.5f;
+
+// Solitary wave over the segment (x0, y0) - (x1, y1) in cells,
+// points have equal ends
+// Non positive depth uses the "zBottom" of the options
+struct NamiWaveSource
+{
+    float   x0, y0;
+    float   x1, y1;
+    float   height;
+    float   depth;
+};
+
+// Source file, one source per line, '#' starts a comment
+//      x y height [depth]          : point source
+//      x0 y0 x1 y1 height [depth]  : segment source
+// Prints the reason and returns false on invalid lines
+inline static bool LoadSources(const std::string& fileName,
+                               std::vector<NamiWaveSource>& sources)
+{
+    std::ifstream file(fileName);
+    if(!file)
+    {
+        std::cout << "Unable to open source file \"" << fileName << "\"" << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNo = 0;
+    while(std::getline(file, line))
+    {
+        lineNo++;
+        line = line.substr(0, line.find('#'));
+
+        std::vector<float> values;
+        std::istringstream lineStream(line);
+        std::string token;
+        while(lineStream >> token)
+        {
+            size_t end = 0;
+            float value = 0.0f;
+            try { value = std::stof(token, &end); }
+            catch(...) { end = 0; }
+            if(end != token.size())
+            {
+                std::cout << "Source line " << lineNo << ": invalid value \""
+                          << token << "\"" << std::endl;
+                return false;
+            }
+            values.push_back(value);
+        }
+        if(values.empty()) continue;
+
+        NamiWaveSource source;
+        switch(values.size())
+        {
+            case 3:
+            case 4:
+                source = {values[0], values[1], values[0], values[1], values[2],
+                          (values.size() == 4) ? values[3] : 0.0f};
+                break;
+            case 5:
+            case 6:
+                source = {values[0], values[1], values[2], values[3], values[4],
+                          (values.size() == 6) ? values[5] : 0.0f};
+                break;
+            default:
+                std::cout << "Source line " << lineNo << ": expected 3 to 6 values" << std::endl;
+                return false;
+        }
+        sources.push_back(source);
+    }
+    return true;
+}
+
+// Sources need a positive depth after the "zBottom" fallback
+inline static bool SourcesValid(const std::vector<NamiWaveSource>& sources,
+                                const NamiGenOptions& opts)
+{
+    for(const NamiWaveSource& s : sources)
+    {
+        float d = (s.depth > 0.0f) ? s.depth : opts.zBottom;
+        if(!(d > 0.0f) || !std::isfinite(s.height)) return false;
+    }
+    return true;
+}
+
+// Source resolved to the grid metric
+struct NamiSourceParams
+{
+    // Start in cells, segment in meters
+    float   x0, y0;
+    float   dx, dy;
+    float   xFactor, yFactor;
+    float   invLengthSqr;
+    float   height;
+    float   k;
+    // Support radius in meters
+    float   radius;
+    // Support box in cells, inclusive
+    int     cellX0, cellY0;
+    int     cellX1, cellY1;
+};
+
+struct NamiSourceField
+{
+    std::vector<NamiSourceParams>   sources;
+    // Bucket grid over the window, sources of bucket "i" are
+    // "indices[offsets[i], offsets[i + 1])" in input order
+    NamiRect                        window;
+    int                             bucketsX, bucketsY;
+    std::vector<size_t>             offsets;
+    std::vector<int>                indices;
+};
+
+// Same metric as "WaveSample", every cell is the lat/lon range apart
+inline static NamiSourceParams GenSourceParams(const NamiWaveSource& source,
+                                               const NamiGenOptions& opts)
+{
+    float xFactor = static_cast<float>(opts.lonMax - opts.lonMin) * LAT_METER;
+    float yFactor = static_cast<float>(opts.latMax - opts.latMin) * LAT_METER;
+    float H = std::abs(source.height);
+    float d = (source.depth > 0.0f) ? source.depth : opts.zBottom;
+
+    NamiSourceParams p;
+    p.x0 = source.x0;
+    p.y0 = source.y0;
+    p.xFactor = xFactor;
+    p.yFactor = yFactor;
+    p.dx = (source.x1 - source.x0) * xFactor;
+    p.dy = (source.y1 - source.y0) * yFactor;
+    float lengthSqr = p.dx * p.dx + p.dy * p.dy;
+    p.invLengthSqr = (lengthSqr > 0.0f) ? (1.0f / lengthSqr) : 0.0f;
+    p.height = source.height;
+    p.k = std::sqrt(0.75f * H / d / d / d);
+
+    // H * sech^2(k * r) = cutoff * H
+    float kr = std::acosh(1.0f / std::sqrt(NAMI_SOURCE_CUTOFF));
+    p.radius = (p.k > 0.0f) ? (kr / p.k) : FLT_MAX;
+
+    // Empty box for zero sources, unbounded for the ones that never decay
+    auto cellRange = [](float a, float b, float r, float factor, int& lo, int& hi)
+    {
+        double reach = (factor > 0.0f) ? static_cast<double>(r) / factor : 0.0;
+        double low = std::floor(std::min(a, b) - reach);
+        double high = std::ceil(std::max(a, b) + reach);
+        lo = static_cast<int>(std::max(low, static_cast<double>(INT32_MIN)));
+        hi = static_cast<int>(std::min(high, static_cast<double>(INT32_MAX)));
+    };
+    cellRange(source.x0, source.x1, p.radius, xFactor, p.cellX0, p.cellX1);
+    cellRange(source.y0, source.y1, p.radius, yFactor, p.cellY0, p.cellY1);
+    if(source.height == 0.0f)
+    {
+        p.cellX0 = 0; p.cellX1 = -1;
+        p.cellY0 = 0; p.cellY1 = -1;
+    }
+    return p;
+}
+
+// Distance of the cell (x, y) to the source in meters
+inline static float SourceDistance(const NamiSourceParams& p, float x, float y)
+{
+    // Closest point of the segment
+    float rx = (x - p.x0) * p.xFactor;
+    float ry = (y - p.y0) * p.yFactor;
+    float t = std::max(0.0f, std::min(1.0f, (rx * p.dx + ry * p.dy) * p.invLengthSqr));
+    rx -= t * p.dx;
+    ry -= t * p.dy;
+    return std::sqrt(rx * rx + ry * ry);
+}
+
+inline static float SourceValue(const NamiSourceParams& p, float x, float y)
+{
+    float coshTerm = std::cosh(p.k * SourceDistance(p, x, y));
+    return p.height / (coshTerm * coshTerm);
+}
+
+// Resolves the sources and buckets them over "window"
+inline static std::shared_ptr<NamiSourceField> BuildSourceField(const std::vector<NamiWaveSource>& sources,
+                                                                const NamiGenOptions& opts,
+                                                                const NamiRect& window)
+{
+    auto field = std::make_shared<NamiSourceField>();
+    field->window = window;
+    field->bucketsX = (window.width + NAMI_SOURCE_BUCKET_COLS - 1) / NAMI_SOURCE_BUCKET_COLS;
+    field->bucketsY = (window.height + NAMI_TILE_ROWS - 1) / NAMI_TILE_ROWS;
+    field->sources.reserve(sources.size());
+    for(const NamiWaveSource& s : sources)
+        field->sources.push_back(GenSourceParams(s, opts));
+
+    // Bucket range of a source, empty if it misses the window
+    auto bucketRange = [&](const NamiSourceParams& p, int& bx0, int& by0, int& bx1, int& by1)
+    {
+        int x0 = std::max(p.cellX0, window.x) - window.x;
+        int x1 = std::min(p.cellX1, window.x + window.width - 1) - window.x;
+        int y0 = std::max(p.cellY0, window.y) - window.y;
+        int y1 = std::min(p.cellY1, window.y + window.height - 1) - window.y;
+        if(x0 > x1 || y0 > y1) return false;
+        bx0 = x0 / NAMI_SOURCE_BUCKET_COLS;
+        bx1 = x1 / NAMI_SOURCE_BUCKET_COLS;
+        by0 = y0 / NAMI_TILE_ROWS;
+        by1 = y1 / NAMI_TILE_ROWS;
+        return true;
+    };
+
+    // Counting sort into buckets keeps the input order in every bucket
+    size_t bucketCount = static_cast<size_t>(field->bucketsX) * field->bucketsY;
+    field->offsets.assign(bucketCount + 1, 0);
+    for(int pass = 0; pass < 2; pass++)
+    {
+        std::vector<size_t> cursor;
+        if(pass == 1)
+        {
+            for(size_t i = 0; i < bucketCount; i++)
+                field->offsets[i + 1] += field->offsets[i];
+            field->indices.resize(field->offsets[bucketCount]);
+            cursor.assign(field->offsets.begin(), field->offsets.end() - 1);
+        }
+        for(int i = 0; i < static_cast<int>(field->sources.size()); i++)
+        {
+            int bx0, by0, bx1, by1;
+            if(!bucketRange(field->sources[i], bx0, by0, bx1, by1)) continue;
+            const NamiSourceParams& p = field->sources[i];
+            for(int by = by0; by <= by1; by++)
+            for(int bx = bx0; bx <= bx1; bx++)
+            {
+                // Long or diagonal segments miss most of their box,
+                // bucket center should be in the radius plus its half diagonal
+                float halfX = 0.5f * NAMI_SOURCE_BUCKET_COLS;
+                float halfY = 0.5f * NAMI_TILE_ROWS;
+                float centerX = window.x + bx * NAMI_SOURCE_BUCKET_COLS + halfX;
+                float centerY = window.y + by * NAMI_TILE_ROWS + halfY;
+                float halfDiagonal = std::sqrt(halfX * p.xFactor * halfX * p.xFactor +
+                                               halfY * p.yFactor * halfY * p.yFactor);
+                if(SourceDistance(p, centerX, centerY) > p.radius + halfDiagonal)
+                    continue;
+
+                size_t bucket = static_cast<size_t>(by) * field->bucketsX + bx;
+                if(pass == 0) field->offsets[bucket + 1]++;
+                else field->indices[cursor[bucket]++] = i;
+            }
+        }
+    }
+    return field;
+}
+
+// Superposes the sources of "field" on rows [rowStart, rowEnd), columns of the field window
+// Each cell adds its sources in input order
+inline static NamiMinMax GenerateSourceRows(float* data, size_t stride,
+                                            int rowStart, int rowEnd,
+                                            const NamiSourceField& field)
+{
+    const NamiRect& window = field.window;
+    int width = window.width;
+    for(int y = rowStart; y < rowEnd; y++)
+        std::fill(data + static_cast<size_t>(y - rowStart) * stride,
+                  data + static_cast<size_t>(y - rowStart) * stride + width, 0.0f);
+
+    int by0 = (rowStart - window.y) / NAMI_TILE_ROWS;
+    int by1 = (rowEnd - 1 - window.y) / NAMI_TILE_ROWS;
+    for(int by = by0; by <= by1; by++)
+    {
+        int bucketY0 = std::max(rowStart, window.y + by * NAMI_TILE_ROWS);
+        int bucketY1 = std::min(rowEnd, window.y + (by + 1) * NAMI_TILE_ROWS);
+        for(int bx = 0; bx < field.bucketsX; bx++)
+        {
+            int bucketX0 = window.x + bx * NAMI_SOURCE_BUCKET_COLS;
+            int bucketX1 = std::min(window.x + width, bucketX0 + NAMI_SOURCE_BUCKET_COLS);
+            size_t bucket = static_cast<size_t>(by) * field.bucketsX + bx;
+            for(size_t i = field.offsets[bucket]; i < field.offsets[bucket + 1]; i++)
+            {
+                const NamiSourceParams& p = field.sources[field.indices[i]];
+                int x0 = std::max(bucketX0, p.cellX0);
+                int x1 = std::min(bucketX1 - 1, p.cellX1);
+                int y0 = std::max(bucketY0, p.cellY0);
+                int y1 = std::min(bucketY1 - 1, p.cellY1);
+                for(int y = y0; y <= y1; y++)
+                {
+                    float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride - window.x;
+                    for(int x = x0; x <= x1; x++)
+                        rowPtr[x] += SourceValue(p, static_cast<float>(x), static_cast<float>(y));
+                }
+            }
+        }
+    }
+
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        const float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        for(int x = 0; x < width; x++)
+        {
+            result.min = std::min(rowPtr[x], result.min);
+            result.max = std::max(rowPtr[x], result.max);
+        }
+    }
+    return result;
+}
+
+// Reference, every cell adds every source
+inline static NamiMinMax GenerateSourceRowsReference(float* data, size_t stride,
+                                                     int rowStart, int rowEnd,
+                                                     int colBegin, int colEnd,
+                                                     const NamiSourceField& field)
+{
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int y = rowStart; y < rowEnd; y++)
+    {
+        float* rowPtr = data + static_cast<size_t>(y - rowStart) * stride;
+        for(int x = colBegin; x < colEnd; x++)
+        {
+            float value = 0.0f;
+            for(const NamiSourceParams& p : field.sources)
+                value += SourceValue(p, static_cast<float>(x), static_cast<float>(y));
+            rowPtr[x - colBegin] = value;
+            result.min = std::min(value, result.min);
+            result.max = std::max(value, result.max);
+        }
+    }
+    return result;
+}
+
+// Row generator of the sources over "window"
+inline static NamiRowFunc MakeSourceRowFunc(const std::vector<NamiWaveSource>& sources,
+                                            const NamiGenOptions& opts,
+                                            const NamiRect& window,
+                                            bool reference = false)
+{
+    std::shared_ptr<const NamiSourceField> field = BuildSourceField(sources, opts, window);
+    if(reference)
+    {
+        return [=](float* data, size_t stride, int rowStart, int rowEnd)
+        {
+            return GenerateSourceRowsReference(data, stride, rowStart, rowEnd,
+                                               window.x, window.x + window.width, *field);
+        };
+    }
+    return [=](float* data, size_t stride, int rowStart, int rowEnd)
+    {
+        return GenerateSourceRows(data, stride, rowStart, rowEnd, *field);
+    };
+}
+
+inline static NamiMinMax GenerateSources(float* data, size_t stride,
+                                         const NamiRect& window,
+                                         const std::vector<NamiWaveSource>& sources,
+                                         const NamiGenOptions& opts,
+                                         NamiThreadPool& pool,
+                                         bool reference = false)
+{
+    NamiRowFunc rowFunc = MakeSourceRowFunc(sources, opts, window, reference);
+    return GenerateTiles(window.y, window.y + window.height, pool, [&](int rowStart, int rowLast)
+    {
+        float* rows = data + static_cast<size_t>(rowStart - window.y) * stride;
+        return rowFunc(rows, stride, rowStart, rowLast);
+    });
+}
+
+// Absolute error bound of the culled sum against the reference,
+// dropped tails plus float summation
+inline static float SourceErrorBound(const std::vector<NamiWaveSource>& sources,
+                                     float magnitude)
+{
+    float heights = 0.0f;
+    for(const NamiWaveSource& s : sources)
+        heights += std::abs(s.height);
+    return heights * NAMI_SOURCE_CUTOFF +
+           (heights + magnitude) * FLT_EPSILON * NAMI_SIMD_WAVE_ULP_TOLERANCE;
+}
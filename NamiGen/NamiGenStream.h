@@ -0,0 +1,236 @@
+#pragma once
+
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+
+#include "NamiGenOptions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenWriters.h"
+#include "NamiGenAsyncFile.h"
+
+// Target size of a streamed band (values and formatted text)
+constexpr size_t NAMI_STREAM_BAND_BYTES = 16 * 1024 * 1024;
+// Band buffers in flight (generating, waiting, writing)
+constexpr int NAMI_STREAM_RING_SIZE = 3;
+
+// Blocking queue of ring slot indices
+class NamiSlotQueue
+{
+    private:
+        std::queue<int>         slots;
+        std::mutex              mutex;
+        std::condition_variable condition;
+
+    public:
+        void                    Push(int slot)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                slots.push(slot);
+            }
+            condition.notify_one();
+        }
+
+        int                     Pop()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return !slots.empty(); });
+            int slot = slots.front();
+            slots.pop();
+            return slot;
+        }
+};
+
+struct NamiStreamSlot
+{
+    std::vector<float>  values;
+    // ASCII output, each row has its own region of "rowBytes"
+    std::vector<char>   text;
+    std::vector<size_t> rowSizes;
+    int                 rowStart;
+    int                 rowEnd;
+};
+
+inline static int StreamBandRows(const NamiGenOptions& opts)
+{
+    size_t rowBytes = std::max<size_t>(1, opts.sizeX) * sizeof(float);
+    if(opts.output == NamiGenOut::GRD)
+        rowBytes += std::max<size_t>(1, opts.sizeX) * NAMI_GRD_MAX_VALUE_CHARS;
+    size_t rows = std::max<size_t>(1, NAMI_STREAM_BAND_BYTES / rowBytes);
+    return static_cast<int>(std::min<size_t>(rows, std::max(opts.sizeY, 1)));
+}
+
+// Cheap first pass for formats that need min/max before the body
+// Bands are generated into a single scratch buffer and discarded
+inline static NamiMinMax StreamMinMax(const NamiGenOptions& opts,
+                                      NamiThreadPool& pool)
+{
+    int bandRows = StreamBandRows(opts);
+    std::vector<float> scratch(static_cast<size_t>(bandRows) * opts.sizeX);
+    NamiMinMax result = namiMinMaxEmpty;
+    for(int rowStart = 0; rowStart < opts.sizeY; rowStart += bandRows)
+    {
+        int rowEnd = std::min(rowStart + bandRows, opts.sizeY);
+        MergeMinMax(result, GenerateBand(scratch.data(), rowStart, rowEnd, opts, pool));
+    }
+    return result;
+}
+
+// Generates and writes the grid in row bands, peak memory is
+// NAMI_STREAM_RING_SIZE bands instead of the whole grid
+// Bands are generated (and formatted) on the pool while a writer
+// thread writes the previous bands
+// ASCII header is resolved by a min/max first pass,
+// binary header is patched after the last band
+// "io" other than OFSTREAM queues the bands to a NamiAsyncFile
+// "report" prints the min/max line (and the async bandwidth)
+inline static bool StreamGRD(const NamiGenOptions& opts,
+                             const std::string& fileName,
+                             NamiThreadPool& pool,
+                             NamiMinMax& minMax,
+                             NamiGenIO io = NamiGenIO::OFSTREAM,
+                             bool direct = false,
+                             bool report = true)
+{
+    bool ascii = (opts.output == NamiGenOut::GRD);
+    if(!ascii && !GRDBinSizeValid(opts)) return false;
+
+    int bandRows = StreamBandRows(opts);
+    size_t rowBytes = static_cast<size_t>(opts.sizeX) * NAMI_GRD_MAX_VALUE_CHARS;
+
+    bool async = (io != NamiGenIO::OFSTREAM);
+    std::ofstream file;
+    NamiAsyncFile asyncFile;
+    NamiAsyncStreamBuf asyncBuffer(asyncFile);
+    std::ostream asyncOut(&asyncBuffer);
+    std::ostream& fileOut = (async) ? asyncOut : file;
+    if(ascii) minMax = StreamMinMax(opts, pool);
+    if(async)
+    {
+        if(!asyncFile.Open(fileName, io, direct)) return false;
+    }
+    else if(ascii) file.open(fileName);
+    else file.open(fileName, std::ofstream::binary);
+
+    if(ascii)
+    {
+        std::string header = GRDHeader(opts, minMax.min, minMax.max);
+        fileOut.write(header.data(), header.size());
+    }
+    else
+    {
+        char header[NAMI_GRD_BIN_HEADER_SIZE] = {};
+        fileOut.write(header, NAMI_GRD_BIN_HEADER_SIZE);
+    }
+    if(!fileOut) return false;
+
+    std::vector<NamiStreamSlot> slots(NAMI_STREAM_RING_SIZE);
+    NamiSlotQueue freeSlots, readySlots;
+    for(int i = 0; i < NAMI_STREAM_RING_SIZE; i++)
+    {
+        slots[i].values.resize(static_cast<size_t>(bandRows) * opts.sizeX);
+        if(ascii)
+        {
+            slots[i].text.resize(rowBytes * bandRows);
+            slots[i].rowSizes.resize(bandRows);
+        }
+        freeSlots.Push(i);
+    }
+
+    // Writer thread, -1 terminates
+    std::thread writer([&]()
+    {
+        int slotIndex;
+        while((slotIndex = readySlots.Pop()) >= 0)
+        {
+            NamiStreamSlot& slot = slots[slotIndex];
+            int rowCount = slot.rowEnd - slot.rowStart;
+            if(ascii)
+            {
+                for(int r = 0; r < rowCount; r++)
+                    fileOut.write(slot.text.data() + r * rowBytes, slot.rowSizes[r]);
+            }
+            else
+            {
+                fileOut.write(reinterpret_cast<const char*>(slot.values.data()),
+                              static_cast<std::streamsize>(rowCount) * opts.sizeX * sizeof(float));
+            }
+            freeSlots.Push(slotIndex);
+        }
+    });
+
+    NamiMinMax streamed = namiMinMaxEmpty;
+    int formatJobRows = std::max(1, bandRows / static_cast<int>(pool.ThreadCount() * 2));
+    for(int rowStart = 0; rowStart < opts.sizeY; rowStart += bandRows)
+    {
+        NamiStreamSlot& slot = slots[freeSlots.Pop()];
+        slot.rowStart = rowStart;
+        slot.rowEnd = std::min(rowStart + bandRows, opts.sizeY);
+        MergeMinMax(streamed, GenerateBand(slot.values.data(),
+                                           slot.rowStart, slot.rowEnd,
+                                           opts, pool));
+        int rowCount = slot.rowEnd - slot.rowStart;
+        if(ascii)
+        {
+            for(int r = 0; r < rowCount; r += formatJobRows)
+            {
+                pool.Submit([&, r]()
+                {
+                    int rEnd = std::min(r + formatJobRows, rowCount);
+                    for(int i = r; i < rEnd; i++)
+                    {
+                        const float* row = slot.values.data() + static_cast<size_t>(i) * opts.sizeX;
+                        slot.rowSizes[i] = FormatGRDRow(slot.text.data() + i * rowBytes,
+                                                        row, slot.rowStart + i, opts);
+                    }
+                });
+            }
+            pool.Wait();
+        }
+        else
+        {
+            FloatsToLittleEndian(slot.values.data(),
+                                 static_cast<size_t>(rowCount) * opts.sizeX);
+        }
+        readySlots.Push(static_cast<int>(&slot - slots.data()));
+    }
+    readySlots.Push(-1);
+    writer.join();
+
+    if(!ascii)
+    {
+        minMax = streamed;
+        char header[NAMI_GRD_BIN_HEADER_SIZE];
+        GRDBinHeader(header, opts, minMax.min, minMax.max);
+        if(async) asyncFile.Patch(0, header, NAMI_GRD_BIN_HEADER_SIZE);
+        else
+        {
+            file.seekp(0);
+            file.write(header, NAMI_GRD_BIN_HEADER_SIZE);
+        }
+    }
+    if(async)
+    {
+        if(!fileOut || !asyncFile.Close()) return false;
+        if(report) std::cout << "Write\t: " << AsyncReport(asyncFile) << std::endl;
+    }
+    else
+    {
+        file.close();
+        if(!file) return false;
+    }
+
+    if(report)
+        printf("%s MM(%f, %f)\n", fileName.c_str(),
+               static_cast<double>(minMax.min),
+               static_cast<double>(minMax.max));
+    return true;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <deque>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+// Simple fixed size thread pool
+// Jobs are consumed in submission order, Wait() blocks until every job
+// submitted by the calling thread is finished, so two threads sharing the
+// pool (e.g. frame generation and its writer) do not wait on each other
+// A pool with zero threads runs jobs inline on the submitting thread
+class NamiThreadPool
+{
+    private:
+        struct Job
+        {
+            std::function<void()>           func;
+            std::thread::id                 owner;
+        };
+
+        std::vector<std::thread>            workers;
+        std::queue<Job>                     jobs;
+        // Unfinished (queued or running) jobs per submitting thread
+        std::map<std::thread::id, unsigned int> pending;
+        std::mutex                          mutex;
+        std::condition_variable             jobCondition;
+        std::condition_variable             doneCondition;
+        bool                                stop;
+
+        void                                Work();
+
+    public:
+        // Constructors & Destructor
+                                            NamiThreadPool(unsigned int threadCount);
+                                            NamiThreadPool(const NamiThreadPool&) = delete;
+        NamiThreadPool&                     operator=(const NamiThreadPool&) = delete;
+                                            ~NamiThreadPool();
+
+        void                                Submit(std::function<void()> job);
+        void                                Wait();
+        unsigned int                        ThreadCount() const;
+};
+
+// 0 means use all hardware threads
+inline static unsigned int ResolveThreadCount(int threadCount)
+{
+    if(threadCount > 0) return static_cast<unsigned int>(threadCount);
+    unsigned int hwThreads = std::thread::hardware_concurrency();
+    return (hwThreads == 0) ? 1 : hwThreads;
+}
+
+inline NamiThreadPool::NamiThreadPool(unsigned int threadCount)
+    : stop(false)
+{
+    workers.reserve(threadCount);
+    for(unsigned int i = 0; i < threadCount; i++)
+        workers.emplace_back(&NamiThreadPool::Work, this);
+}
+
+inline NamiThreadPool::~NamiThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        stop = true;
+    }
+    jobCondition.notify_all();
+    for(std::thread& t : workers)
+        t.join();
+}
+
+inline void NamiThreadPool::Work()
+{
+    while(true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobCondition.wait(lock, [this] { return stop || !jobs.empty(); });
+            if(stop && jobs.empty()) return;
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+
+        job.func();
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto it = pending.find(job.owner);
+            if(--it->second == 0)
+            {
+                pending.erase(it);
+                doneCondition.notify_all();
+            }
+        }
+    }
+}
+
+inline void NamiThreadPool::Submit(std::function<void()> job)
+{
+    if(workers.empty())
+    {
+        job();
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        std::thread::id owner = std::this_thread::get_id();
+        pending[owner]++;
+        jobs.push(Job{std::move(job), owner});
+    }
+    jobCondition.notify_one();
+}
+
+inline void NamiThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    std::thread::id owner = std::this_thread::get_id();
+    doneCondition.wait(lock, [this, owner] { return pending.find(owner) == pending.end(); });
+}
+
+inline unsigned int NamiThreadPool::ThreadCount() const
+{
+    return std::max(1u, static_cast<unsigned int>(workers.size()));
+}
+
+// Runs a fixed set of indexed jobs, each worker owns a deque of job
+// indices and steals from the front of the others when its own is empty
+// "func" receives the job index and the worker index
+class NamiStealingPool
+{
+    private:
+        struct WorkerQueue
+        {
+            std::mutex      mutex;
+            std::deque<int> jobs;
+        };
+        unsigned int        threadCount;
+
+    public:
+        // Constructors & Destructor
+                            NamiStealingPool(unsigned int threadCount);
+
+        template<class Func>
+        void                Run(int jobCount, Func&& func);
+        unsigned int        ThreadCount() const;
+};
+
+inline NamiStealingPool::NamiStealingPool(unsigned int threadCount)
+    : threadCount(std::max(1u, threadCount))
+{}
+
+template<class Func>
+inline void NamiStealingPool::Run(int jobCount, Func&& func)
+{
+    unsigned int workerCount = std::min(threadCount, static_cast<unsigned int>(std::max(jobCount, 1)));
+    std::vector<WorkerQueue> queues(workerCount);
+    // Contiguous chunks, neighbouring jobs tend to have similar cost
+    for(int i = 0; i < jobCount; i++)
+        queues[static_cast<size_t>(i) * workerCount / jobCount].jobs.push_back(i);
+
+    auto work = [&](unsigned int worker)
+    {
+        while(true)
+        {
+            int job = -1;
+            {
+                WorkerQueue& own = queues[worker];
+                std::unique_lock<std::mutex> lock(own.mutex);
+                if(!own.jobs.empty())
+                {
+                    job = own.jobs.back();
+                    own.jobs.pop_back();
+                }
+            }
+            for(unsigned int i = 1; job < 0 && i < workerCount; i++)
+            {
+                WorkerQueue& victim = queues[(worker + i) % workerCount];
+                std::unique_lock<std::mutex> lock(victim.mutex);
+                if(!victim.jobs.empty())
+                {
+                    job = victim.jobs.front();
+                    victim.jobs.pop_front();
+                }
+            }
+            // Jobs are never added while running, empty queues mean done
+            if(job < 0) return;
+            func(job, worker);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(unsigned int i = 1; i < workerCount; i++)
+        workers.emplace_back(work, i);
+    work(0);
+    for(std::thread& t : workers)
+        t.join();
+}
+
+inline unsigned int NamiStealingPool::ThreadCount() const
+{
+    return threadCount;
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <fstream>
+#include <algorithm>
+
+#include "NamiGenOptions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenWriters.h"
+
+// Tiled GeoTIFF writer (float32, other sample types for storage precisions)
+// Tiles are optionally PackBits compressed (land/bottom plateaus compress well)
+// and compressed in parallel one tile row at a time
+// BigTIFF is used when offsets may not fit in 32 bits
+constexpr int NAMI_TIFF_TILE_SIZE = 256;
+
+enum NamiTiffType : uint16_t
+{
+    TIFF_ASCII = 2,
+    TIFF_SHORT = 3,
+    TIFF_LONG = 4,
+    TIFF_DOUBLE = 12,
+    TIFF_LONG8 = 16
+};
+
+struct NamiTiffEntry
+{
+    uint16_t            tag;
+    uint16_t            type;
+    uint64_t            count;
+    std::vector<char>   data;
+};
+
+template<class T>
+inline static NamiTiffEntry TiffEntry(uint16_t tag, NamiTiffType type,
+                                      const std::vector<T>& values)
+{
+    NamiTiffEntry entry = {tag, type, values.size(), std::vector<char>(values.size() * sizeof(T))};
+    char* out = entry.data.data();
+    for(const T& v : values)
+        out = PutLittleEndian(out, v);
+    return entry;
+}
+
+// PackBits (TIFF compression 32773)
+inline static void PackBits(std::vector<char>& out, const char* in, size_t size)
+{
+    out.clear();
+    size_t i = 0;
+    while(i < size)
+    {
+        // Replicate run
+        size_t run = 1;
+        while(i + run < size && run < 128 && in[i + run] == in[i])
+            run++;
+        if(run >= 3)
+        {
+            out.push_back(static_cast<char>(1 - static_cast<int>(run)));
+            out.push_back(in[i]);
+            i += run;
+            continue;
+        }
+
+        // Literal run, ends where a replicate run of 3 starts
+        size_t start = i;
+        while(i < size && (i - start) < 128)
+        {
+            if(i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2])
+                break;
+            i++;
+        }
+        out.push_back(static_cast<char>(i - start - 1));
+        out.insert(out.end(), in + start, in + i);
+    }
+}
+
+// TIFF SampleFormat values
+constexpr uint16_t NAMI_TIFF_UINT = 1;
+constexpr uint16_t NAMI_TIFF_INT = 2;
+constexpr uint16_t NAMI_TIFF_FLOAT = 3;
+
+// Image rows are north up, grid row 0 is the southern row
+template<class T>
+inline static void FillTiffTile(std::vector<char>& tile, const T* data,
+                                int tileX, int tileY, const NamiGenOptions& opts)
+{
+    char* out = tile.data();
+    for(int r = 0; r < NAMI_TIFF_TILE_SIZE; r++)
+    {
+        int imageRow = tileY * NAMI_TIFF_TILE_SIZE + r;
+        int gridRow = opts.sizeY - 1 - imageRow;
+        for(int c = 0; c < NAMI_TIFF_TILE_SIZE; c++)
+        {
+            int x = tileX * NAMI_TIFF_TILE_SIZE + c;
+            T value = T(0);
+            if(imageRow < opts.sizeY && x < opts.sizeX)
+                value = data[static_cast<size_t>(gridRow) * opts.sizeX + x];
+            out = PutLittleEndian(out, value);
+        }
+    }
+}
+
+// Header is patched after the IFD is written, stream should be seekable
+// Offsets are relative to the stream position at the call
+// Samples are "T" stored as "sampleFormat" (16-bit halfs are passed as uint16_t)
+// "gdalMetadata" is written to the GDAL_METADATA tag if not empty
+// Returns false if the stream is not seekable or fails
+template<class T>
+inline static bool WriteTiffSamples(std::ostream& outFile,
+                                    const T* data,
+                                    const NamiGenOptions& opts,
+                                    bool compress,
+                                    uint16_t sampleFormat,
+                                    const std::string& gdalMetadata,
+                                    NamiThreadPool& pool)
+{
+    std::streampos start = outFile.tellp();
+    if(start == std::streampos(-1)) return false;
+
+    int tilesX = (opts.sizeX + NAMI_TIFF_TILE_SIZE - 1) / NAMI_TIFF_TILE_SIZE;
+    int tilesY = (opts.sizeY + NAMI_TIFF_TILE_SIZE - 1) / NAMI_TIFF_TILE_SIZE;
+    size_t tileBytes = NAMI_TIFF_TILE_SIZE * NAMI_TIFF_TILE_SIZE * sizeof(T);
+    size_t tileCount = static_cast<size_t>(tilesX) * tilesY;
+
+    // PackBits worst case adds a byte per 128
+    uint64_t worstSize = tileCount * (tileBytes + tileBytes / 128 + 1) + tileCount * 16 + 4096;
+    bool bigTiff = worstSize > UINT32_MAX;
+
+    char header[16] = {'I', 'I'};
+    size_t headerSize = (bigTiff) ? 16 : 8;
+    outFile.write(header, headerSize);
+
+    // Tiles
+    std::vector<uint64_t> offsets(tileCount), byteCounts(tileCount);
+    std::vector<std::vector<char>> raw(tilesX, std::vector<char>(tileBytes));
+    std::vector<std::vector<char>> packed(tilesX);
+    uint64_t offset = headerSize;
+    for(int ty = 0; ty < tilesY; ty++)
+    {
+        for(int tx = 0; tx < tilesX; tx++)
+        {
+            pool.Submit([&, tx, ty]()
+            {
+                FillTiffTile(raw[tx], data, tx, ty, opts);
+                if(compress) PackBits(packed[tx], raw[tx].data(), tileBytes);
+            });
+        }
+        pool.Wait();
+
+        for(int tx = 0; tx < tilesX; tx++)
+        {
+            const std::vector<char>& tile = (compress) ? packed[tx] : raw[tx];
+            size_t index = static_cast<size_t>(ty) * tilesX + tx;
+            offsets[index] = offset;
+            byteCounts[index] = tile.size();
+            outFile.write(tile.data(), tile.size());
+            offset += tile.size();
+        }
+    }
+
+    // Tags (ascending order)
+    double scaleX = (opts.sizeX > 1) ? (opts.lonMax - opts.lonMin) / (opts.sizeX - 1) : 1.0;
+    double scaleY = (opts.sizeY > 1) ? (opts.latMax - opts.latMin) / (opts.sizeY - 1) : 1.0;
+    std::vector<NamiTiffEntry> entries;
+    entries.push_back(TiffEntry<uint32_t>(256, TIFF_LONG, {static_cast<uint32_t>(opts.sizeX)}));
+    entries.push_back(TiffEntry<uint32_t>(257, TIFF_LONG, {static_cast<uint32_t>(opts.sizeY)}));
+    entries.push_back(TiffEntry<uint16_t>(258, TIFF_SHORT, {static_cast<uint16_t>(sizeof(T) * 8)}));
+    entries.push_back(TiffEntry<uint16_t>(259, TIFF_SHORT, {static_cast<uint16_t>((compress) ? 32773 : 1)}));
+    entries.push_back(TiffEntry<uint16_t>(262, TIFF_SHORT, {1}));
+    entries.push_back(TiffEntry<uint16_t>(277, TIFF_SHORT, {1}));
+    entries.push_back(TiffEntry<uint16_t>(284, TIFF_SHORT, {1}));
+    entries.push_back(TiffEntry<uint16_t>(322, TIFF_SHORT, {NAMI_TIFF_TILE_SIZE}));
+    entries.push_back(TiffEntry<uint16_t>(323, TIFF_SHORT, {NAMI_TIFF_TILE_SIZE}));
+    if(bigTiff)
+    {
+        entries.push_back(TiffEntry<uint64_t>(324, TIFF_LONG8, offsets));
+        entries.push_back(TiffEntry<uint64_t>(325, TIFF_LONG8, byteCounts));
+    }
+    else
+    {
+        entries.push_back(TiffEntry<uint32_t>(324, TIFF_LONG, std::vector<uint32_t>(offsets.begin(), offsets.end())));
+        entries.push_back(TiffEntry<uint32_t>(325, TIFF_LONG, std::vector<uint32_t>(byteCounts.begin(), byteCounts.end())));
+    }
+    entries.push_back(TiffEntry<uint16_t>(339, TIFF_SHORT, {sampleFormat}));
+    // GeoTIFF, node registered geographic grid (WGS84)
+    entries.push_back(TiffEntry<double>(33550, TIFF_DOUBLE, {scaleX, scaleY, 0.0}));
+    entries.push_back(TiffEntry<double>(33922, TIFF_DOUBLE, {0.0, 0.0, 0.0, opts.lonMin, opts.latMax, 0.0}));
+    entries.push_back(TiffEntry<uint16_t>(34735, TIFF_SHORT,
+                                          {1, 1, 0, 3,
+                                           1024, 0, 1, 2,       // GTModelType: Geographic
+                                           1025, 0, 1, 2,       // GTRasterType: PixelIsPoint
+                                           2048, 0, 1, 4326}));  // GeographicType: WGS84
+    if(!gdalMetadata.empty())
+    {
+        std::vector<char> text(gdalMetadata.begin(), gdalMetadata.end());
+        text.push_back('\0');
+        entries.push_back(TiffEntry<char>(42112, TIFF_ASCII, text));
+    }
+
+    // Out of line values
+    size_t inlineBytes = (bigTiff) ? 8 : 4;
+    std::vector<uint64_t> valueOffsets(entries.size(), 0);
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        if(entries[i].data.size() <= inlineBytes) continue;
+        if(offset % 2 != 0) { outFile.put(0); offset++; }
+        valueOffsets[i] = offset;
+        outFile.write(entries[i].data.data(), entries[i].data.size());
+        offset += entries[i].data.size();
+    }
+    if(offset % 2 != 0) { outFile.put(0); offset++; }
+    uint64_t ifdOffset = offset;
+
+    // IFD
+    std::vector<char> ifd((bigTiff) ? (8 + entries.size() * 20 + 8)
+                                    : (2 + entries.size() * 12 + 4), 0);
+    char* out = ifd.data();
+    out = (bigTiff) ? PutLittleEndian(out, static_cast<uint64_t>(entries.size()))
+                    : PutLittleEndian(out, static_cast<uint16_t>(entries.size()));
+    for(size_t i = 0; i < entries.size(); i++)
+    {
+        const NamiTiffEntry& e = entries[i];
+        out = PutLittleEndian(out, e.tag);
+        out = PutLittleEndian(out, e.type);
+        out = (bigTiff) ? PutLittleEndian(out, e.count)
+                        : PutLittleEndian(out, static_cast<uint32_t>(e.count));
+        char value[8] = {};
+        if(e.data.size() <= inlineBytes)
+            std::memcpy(value, e.data.data(), e.data.size());
+        else if(bigTiff)
+            PutLittleEndian(value, valueOffsets[i]);
+        else
+            PutLittleEndian(value, static_cast<uint32_t>(valueOffsets[i]));
+        std::memcpy(out, value, inlineBytes);
+        out += inlineBytes;
+    }
+    outFile.write(ifd.data(), ifd.size());
+
+    // Header
+    out = header + 2;
+    if(bigTiff)
+    {
+        out = PutLittleEndian(out, static_cast<uint16_t>(43));
+        out = PutLittleEndian(out, static_cast<uint16_t>(8));
+        out = PutLittleEndian(out, static_cast<uint16_t>(0));
+        out = PutLittleEndian(out, ifdOffset);
+    }
+    else
+    {
+        out = PutLittleEndian(out, static_cast<uint16_t>(42));
+        out = PutLittleEndian(out, static_cast<uint32_t>(ifdOffset));
+    }
+    std::streampos end = outFile.tellp();
+    outFile.seekp(start);
+    outFile.write(header, headerSize);
+    outFile.seekp(end);
+    return static_cast<bool>(outFile);
+}
+
+// GDAL reads these as the band statistics, "gdalinfo" and QGIS skip a scan
+inline static std::string GDALStatisticsMetadata(double min, double max)
+{
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "<GDALMetadata>\n"
+                  "  <Item name=\"STATISTICS_MINIMUM\" sample=\"0\">%.17g</Item>\n"
+                  "  <Item name=\"STATISTICS_MAXIMUM\" sample=\"0\">%.17g</Item>\n"
+                  "</GDALMetadata>\n",
+                  min, max);
+    return text;
+}
+
+inline static bool WriteTiff(std::ostream& outFile,
+                             const float* data,
+                             const NamiGenOptions& opts,
+                             double min, double max,
+                             bool compress,
+                             NamiThreadPool& pool)
+{
+    return WriteTiffSamples(outFile, data, opts, compress,
+                            NAMI_TIFF_FLOAT, GDALStatisticsMetadata(min, max), pool);
+}
+
+inline static bool OutTiff(const float* data,
+                           const NamiGenOptions& opts,
+                           double min, double max,
+                           bool compress,
+                           const std::string& fileName,
+                           NamiThreadPool& pool)
+{
+    std::ofstream outFile(fileName, std::ofstream::binary);
+    if(!WriteTiff(outFile, data, opts, min, max, compress, pool)) return false;
+    outFile.close();
+    if(!outFile) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
+    return true;
+}
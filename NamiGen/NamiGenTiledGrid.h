@@ -0,0 +1,290 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+#include <new>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenGenerator.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenWriters.h"
+#include "NamiGenTiff.h"
+#include "NamiGenGridMemory.h"
+
+// Blocked grid layout
+// Cells are stored in square tiles of NAMI_GRID_TILE cells, tiles are in row
+// major order and cells of a tile are row major with a NAMI_GRID_TILE stride.
+// A tile (16KB) stays in L1/L2 while it is generated or read by a stencil,
+// and a tile is a single pool job.
+// File formats are row major, writers convert one band of tile rows at a
+// time (NAMI_GRID_TILE rows), each tile of the band is read contiguously.
+
+// Side of a tile in cells
+constexpr int NAMI_GRID_TILE = 64;
+constexpr size_t NAMI_GRID_TILE_CELLS = static_cast<size_t>(NAMI_GRID_TILE) * NAMI_GRID_TILE;
+
+// Cells of a tile, "region" is in grid cells (edge tiles are clipped)
+// "data" is the cell (region.x, region.y), rows are "stride" floats apart
+struct NamiGridTile
+{
+    NamiRect    region;
+    float*      data;
+    size_t      stride;
+};
+
+class NamiTiledGrid
+{
+    private:
+        NamiGridMemory          cells;
+        NamiGenPages            pages;
+        bool                    interleave;
+        int                     sizeX, sizeY;
+        int                     tilesX, tilesY;
+
+    public:
+        // Visits the tiles in storage order
+        class Iterator
+        {
+            private:
+                NamiTiledGrid*  grid;
+                int             index;
+
+            public:
+                                Iterator(NamiTiledGrid* g, int i) : grid(g), index(i) {}
+
+                NamiGridTile    operator*() const { return grid->Tile(index); }
+                Iterator&       operator++() { index++; return *this; }
+                bool            operator!=(const Iterator& other) const { return index != other.index; }
+        };
+
+        // Constructors & Destructor
+                                NamiTiledGrid(NamiGenPages pages = NamiGenPages::THP,
+                                              bool interleave = false);
+                                NamiTiledGrid(int sizeX, int sizeY);
+
+        // Storage only grows, values are undefined after a resize
+        // Tiles are first touched by the generating pool jobs
+        // Throws std::bad_alloc if the pages can not be mapped
+        void                    Resize(int sizeX, int sizeY);
+
+        int                     SizeX() const { return sizeX; }
+        int                     SizeY() const { return sizeY; }
+        int                     TilesX() const { return tilesX; }
+        int                     TilesY() const { return tilesY; }
+        int                     TileCount() const { return tilesX * tilesY; }
+
+        NamiGridTile            Tile(int index);
+        NamiGridTile            Tile(int tileX, int tileY);
+        float                   At(int x, int y) const;
+
+        Iterator                begin() { return Iterator(this, 0); }
+        Iterator                end() { return Iterator(this, TileCount()); }
+
+        // Copies rows [rowStart, rowEnd) to "out" in row major order
+        // (sizeX floats per row)
+        void                    CopyRows(float* out, int rowStart, int rowEnd) const;
+};
+
+inline NamiTiledGrid::NamiTiledGrid(NamiGenPages p, bool i)
+    : pages(p)
+    , interleave(i)
+    , sizeX(0)
+    , sizeY(0)
+    , tilesX(0)
+    , tilesY(0)
+{}
+
+inline NamiTiledGrid::NamiTiledGrid(int sizeX, int sizeY)
+    : NamiTiledGrid()
+{
+    Resize(sizeX, sizeY);
+}
+
+inline void NamiTiledGrid::Resize(int x, int y)
+{
+    sizeX = x;
+    sizeY = y;
+    tilesX = (x + NAMI_GRID_TILE - 1) / NAMI_GRID_TILE;
+    tilesY = (y + NAMI_GRID_TILE - 1) / NAMI_GRID_TILE;
+    // Edge tiles are full size, so every tile has the same offset formula
+    size_t count = static_cast<size_t>(tilesX) * tilesY * NAMI_GRID_TILE_CELLS;
+    if(!cells.Allocate(count, pages, interleave)) throw std::bad_alloc();
+}
+
+inline NamiGridTile NamiTiledGrid::Tile(int index)
+{
+    return Tile(index % tilesX, index / tilesX);
+}
+
+inline NamiGridTile NamiTiledGrid::Tile(int tileX, int tileY)
+{
+    NamiGridTile tile;
+    tile.region.x = tileX * NAMI_GRID_TILE;
+    tile.region.y = tileY * NAMI_GRID_TILE;
+    tile.region.width = std::min(NAMI_GRID_TILE, sizeX - tile.region.x);
+    tile.region.height = std::min(NAMI_GRID_TILE, sizeY - tile.region.y);
+    tile.data = cells.Data() + (static_cast<size_t>(tileY) * tilesX + tileX) * NAMI_GRID_TILE_CELLS;
+    tile.stride = NAMI_GRID_TILE;
+    return tile;
+}
+
+inline float NamiTiledGrid::At(int x, int y) const
+{
+    size_t tile = static_cast<size_t>(y / NAMI_GRID_TILE) * tilesX + x / NAMI_GRID_TILE;
+    size_t cell = static_cast<size_t>(y % NAMI_GRID_TILE) * NAMI_GRID_TILE + x % NAMI_GRID_TILE;
+    return cells.Data()[tile * NAMI_GRID_TILE_CELLS + cell];
+}
+
+inline void NamiTiledGrid::CopyRows(float* out, int rowStart, int rowEnd) const
+{
+    for(int tileY = rowStart / NAMI_GRID_TILE;
+        tileY * NAMI_GRID_TILE < rowEnd; tileY++)
+    {
+        int bandStart = std::max(rowStart, tileY * NAMI_GRID_TILE);
+        int bandEnd = std::min(rowEnd, (tileY + 1) * NAMI_GRID_TILE);
+        for(int tileX = 0; tileX < tilesX; tileX++)
+        {
+            const float* tile = cells.Data() +
+                                (static_cast<size_t>(tileY) * tilesX + tileX) * NAMI_GRID_TILE_CELLS;
+            int x = tileX * NAMI_GRID_TILE;
+            int width = std::min(NAMI_GRID_TILE, sizeX - x);
+            for(int y = bandStart; y < bandEnd; y++)
+            {
+                const float* src = tile + static_cast<size_t>(y % NAMI_GRID_TILE) * NAMI_GRID_TILE;
+                std::copy(src, src + width,
+                          out + static_cast<size_t>(y - rowStart) * sizeX + x);
+            }
+        }
+    }
+}
+
+// Generates "window" of "opts" into "grid" (resized to the window size),
+// a pool job per tile
+// Tile rows are merged in row major order, scalar values and min/max are
+// the same as the row major generators
+// SIMD kernels run the scalar tail at the end of each tile, cells there may
+// differ from the row major grid within "SimdUlpTolerance"
+inline static NamiMinMax GenerateTiled(NamiTiledGrid& grid,
+                                       const NamiRect& window,
+                                       const NamiGenOptions& opts,
+                                       NamiThreadPool& pool)
+{
+    grid.Resize(window.width, window.height);
+    NamiTileFunc tileFunc = MakeTileFunc(opts, window.x, window.x + window.width);
+
+    int tilesX = grid.TilesX();
+    std::vector<NamiMinMax> rowResults(static_cast<size_t>(window.height) * tilesX,
+                                       namiMinMaxEmpty);
+    for(int i = 0; i < grid.TileCount(); i++)
+    {
+        pool.Submit([&, i]()
+        {
+            NamiGridTile tile = grid.Tile(i);
+            int colBegin = window.x + tile.region.x;
+            int colEnd = colBegin + tile.region.width;
+            for(int y = 0; y < tile.region.height; y++)
+            {
+                int row = tile.region.y + y;
+                rowResults[static_cast<size_t>(row) * tilesX + i % tilesX] =
+                    tileFunc(tile.data + y * tile.stride, tile.stride,
+                             window.y + row, window.y + row + 1, colBegin, colEnd);
+            }
+        });
+    }
+    pool.Wait();
+
+    NamiMinMax result = namiMinMaxEmpty;
+    for(const NamiMinMax& row : rowResults)
+        MergeMinMax(result, row);
+    return result;
+}
+
+// Writes "grid" in opts.output format, opts size should be the grid size
+// grd and grdbin are converted to row major one band of tiles at a time,
+// grd7 reads the cells in place, tiff converts the whole grid
+// Returns false if the stream fails
+inline static bool WriteTiled(std::ostream& out,
+                              const NamiTiledGrid& grid,
+                              const NamiGenOptions& opts,
+                              const NamiMinMax& minMax,
+                              NamiThreadPool& pool)
+{
+    size_t bandSize = static_cast<size_t>(NAMI_GRID_TILE) * opts.sizeX;
+    switch(opts.output)
+    {
+        case NamiGenOut::GRD:
+        {
+            std::string header = GRDHeader(opts, minMax.min, minMax.max);
+            out.write(header.data(), header.size());
+
+            std::vector<float> band(bandSize);
+            NamiGRDRowWriter rowWriter;
+            for(int rowStart = 0; rowStart < opts.sizeY && out; rowStart += NAMI_GRID_TILE)
+            {
+                int rowEnd = std::min(rowStart + NAMI_GRID_TILE, opts.sizeY);
+                grid.CopyRows(band.data(), rowStart, rowEnd);
+                rowWriter.Write(out, band.data(), rowStart, rowEnd, opts, pool);
+            }
+            return static_cast<bool>(out);
+        }
+        case NamiGenOut::GRD_BIN:
+        {
+            if(!GRDBinSizeValid(opts)) return false;
+            char header[NAMI_GRD_BIN_HEADER_SIZE];
+            GRDBinHeader(header, opts, minMax.min, minMax.max);
+            out.write(header, NAMI_GRD_BIN_HEADER_SIZE);
+
+            std::vector<float> band(bandSize);
+            for(int rowStart = 0; rowStart < opts.sizeY && out; rowStart += NAMI_GRID_TILE)
+            {
+                int rowEnd = std::min(rowStart + NAMI_GRID_TILE, opts.sizeY);
+                size_t count = static_cast<size_t>(rowEnd - rowStart) * opts.sizeX;
+                grid.CopyRows(band.data(), rowStart, rowEnd);
+                FloatsToLittleEndian(band.data(), count);
+                out.write(reinterpret_cast<const char*>(band.data()),
+                          static_cast<std::streamsize>(count * sizeof(float)));
+            }
+            return static_cast<bool>(out);
+        }
+        case NamiGenOut::GRD_7:
+        {
+            int sizeX = opts.sizeX;
+            return WriteGRD7Values(out, [&grid, sizeX](size_t i)
+            {
+                return grid.At(static_cast<int>(i % sizeX), static_cast<int>(i / sizeX));
+            }, opts, minMax.min, minMax.max);
+        }
+        case NamiGenOut::TIFF:
+        {
+            std::vector<float> rows(static_cast<size_t>(opts.sizeX) * opts.sizeY);
+            grid.CopyRows(rows.data(), 0, opts.sizeY);
+            return WriteTiff(out, rows.data(), opts, minMax.min, minMax.max,
+                             opts.compress == NamiGenCompress::PACKBITS, pool);
+        }
+        default:
+            return false;
+    }
+}
+
+inline static bool OutTiled(const NamiTiledGrid& grid,
+                            const NamiGenOptions& opts,
+                            const NamiMinMax& minMax,
+                            const std::string& fileName,
+                            NamiThreadPool& pool)
+{
+    // Ascii grids are text files like "OutGRD"
+    std::ofstream outFile(fileName, (opts.output == NamiGenOut::GRD)
+                                        ? std::ofstream::out
+                                        : std::ofstream::out | std::ofstream::binary);
+    if(!WriteTiled(outFile, grid, opts, minMax, pool)) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(),
+           static_cast<double>(minMax.min),
+           static_cast<double>(minMax.max));
+    return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "psapi.lib")
+    #endif
+#else
+    #include <sys/resource.h>
+#endif
+
+class NamiTimer
+{
+    private:
+        using Clock = std::chrono::high_resolution_clock;
+        Clock::time_point   start;
+
+    public:
+        // Constructors & Destructor
+                            NamiTimer() : start(Clock::now()) {}
+
+        void                Restart() { start = Clock::now(); }
+        // Seconds since construction or last restart
+        double              Elapsed() const
+        {
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        }
+};
+
+// Per stage wall times of a job in seconds
+// Streamed jobs generate and write together, only "stream" is set
+// Cache hits only set "cache"
+struct NamiStageTimes
+{
+    double generate;
+    double verify;
+    double write;
+    double stream;
+    double cache;
+};
+
+constexpr NamiStageTimes namiStageTimesEmpty = NamiStageTimes{0.0, 0.0, 0.0, 0.0, 0.0};
+
+// Peak resident set size of the process in bytes (0 if unknown)
+inline static size_t PeakRSSBytes()
+{
+    #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+            return 0;
+        return counters.PeakWorkingSetSize;
+    #else
+        struct rusage usage;
+        if(getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+        #ifdef __APPLE__
+            return static_cast<size_t>(usage.ru_maxrss);
+        #else
+            return static_cast<size_t>(usage.ru_maxrss) * 1024;
+        #endif
+    #endif
+}
@@ -0,0 +1,437 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <fstream>
+#include <sstream>
+#include <charconv>
+#include <algorithm>
+#include <type_traits>
+
+#include "NamiGenOptions.h"
+#include "NamiGenFunctions.h"
+#include "NamiGenThreadPool.h"
+#include "NamiGenMappedFile.h"
+
+// Upper bound of a single formatted value and its separators
+// (39 integer digits of FLT_MAX, sign, dot, 7 decimals, 5 spaces, 2 newlines)
+constexpr size_t NAMI_GRD_MAX_VALUE_CHARS = 64;
+// Target size of a formatted band
+constexpr size_t NAMI_GRD_BAND_BYTES = 8 * 1024 * 1024;
+
+// Lines of "GRDHeader", min/max is the last one
+constexpr int NAMI_GRD_HEADER_LINES = 5;
+
+inline static std::string GRDHeader(const NamiGenOptions& opts,
+                                    double min, double max)
+{
+    static const std::string FOURCC_GRD = "DSAA";
+
+    std::ostringstream header;
+    header << FOURCC_GRD << "\n";
+    header << opts.sizeX << "   " << opts.sizeY << "\n";
+    header.precision(7);
+    header.setf(std::ios::fixed);
+    header << opts.latMin << "   " << opts.latMax << "\n";
+    header << opts.lonMin << "   " << opts.lonMax << "\n";
+    header << min << "  " << max << "\n";
+    return header.str();
+}
+
+// Formats a single row into "out" and returns the written byte count
+// "out" should hold at least sizeX * NAMI_GRD_MAX_VALUE_CHARS bytes
+// Separators are identical to "OutGRDReference"
+inline static size_t FormatGRDRow(char* out, const float* row, int y,
+                                  const NamiGenOptions& opts)
+{
+    static const char SPACES[] = "      ";
+    static const int mostLeadingSpaces = 6;
+
+    char* outPtr = out;
+    size_t i = static_cast<size_t>(y) * opts.sizeX;
+    unsigned lineCounter = 1;
+    for(int x = 0; x < opts.sizeX; x++, i++)
+    {
+        // ostream prints float as double
+        double value = static_cast<double>(row[x]);
+        outPtr = std::to_chars(outPtr, outPtr + NAMI_GRD_MAX_VALUE_CHARS,
+                               value, std::chars_format::fixed, 7).ptr;
+        if(x == opts.sizeX - 1)
+        {
+            *outPtr++ = '\n';
+            lineCounter = 0;
+        }
+        if(i % opts.sizeY == static_cast<size_t>(opts.sizeY - 1))
+        {
+            *outPtr++ = '\n';
+            lineCounter = 0;
+        }
+        else if(lineCounter % 10 == 0)
+        {
+            *outPtr++ = '\n';
+        }
+        else
+        {
+            int spaceCount = NumDecimalDigit(row[x]);
+            spaceCount = std::max(1, mostLeadingSpaces - spaceCount);
+            std::memcpy(outPtr, SPACES, spaceCount);
+            outPtr += spaceCount;
+        }
+        lineCounter++;
+    }
+    return static_cast<size_t>(outPtr - out);
+}
+
+inline static bool FilesEqual(const std::string& fileA,
+                              const std::string& fileB)
+{
+    std::ifstream a(fileA, std::ifstream::binary);
+    std::ifstream b(fileB, std::ifstream::binary);
+    if(!a || !b) return false;
+
+    static constexpr size_t CHUNK = 1 << 16;
+    std::vector<char> bufferA(CHUNK), bufferB(CHUNK);
+    while(a && b)
+    {
+        a.read(bufferA.data(), CHUNK);
+        b.read(bufferB.data(), CHUNK);
+        if(a.gcount() != b.gcount() ||
+           std::memcmp(bufferA.data(), bufferB.data(), a.gcount()) != 0)
+            return false;
+    }
+    return a.eof() && b.eof();
+}
+
+// Returns 0 if the file can not be opened
+inline static size_t FileSize(const std::string& fileName)
+{
+    std::ifstream file(fileName, std::ifstream::binary | std::ifstream::ate);
+    if(!file) return 0;
+    return static_cast<size_t>(file.tellg());
+}
+
+// Formats rows of an ascii grid in bands on the pool and writes them in order
+// Buffers are kept between calls, so a grid can be written in pieces
+class NamiGRDRowWriter
+{
+    private:
+        std::vector<std::vector<char>>  buffers;
+        std::vector<size_t>             sizes;
+
+    public:
+        // "rows" points to the row "rowStart", rows are sizeX floats apart
+        // Returns false if the stream fails
+        bool                            Write(std::ostream& fileOut,
+                                              const float* rows,
+                                              int rowStart, int rowEnd,
+                                              const NamiGenOptions& opts,
+                                              NamiThreadPool& pool);
+};
+
+inline bool NamiGRDRowWriter::Write(std::ostream& fileOut,
+                                    const float* rows,
+                                    int rowStart, int rowEnd,
+                                    const NamiGenOptions& opts,
+                                    NamiThreadPool& pool)
+{
+    size_t rowBytes = std::max<size_t>(1, opts.sizeX) * NAMI_GRD_MAX_VALUE_CHARS;
+    int bandRows = static_cast<int>(std::max<size_t>(1, NAMI_GRD_BAND_BYTES / rowBytes));
+    int bandCount = (rowEnd - rowStart + bandRows - 1) / bandRows;
+    int batchCount = static_cast<int>(pool.ThreadCount()) * 2;
+
+    // Only grows
+    size_t bufferCount = static_cast<size_t>(std::min(batchCount, std::max(bandCount, 1)));
+    if(buffers.size() < bufferCount)
+    {
+        buffers.resize(bufferCount);
+        sizes.resize(bufferCount, 0);
+    }
+    for(size_t i = 0; i < bufferCount; i++)
+        if(buffers[i].size() < rowBytes * bandRows) buffers[i].resize(rowBytes * bandRows);
+
+    for(int batchStart = 0; batchStart < bandCount; batchStart += batchCount)
+    {
+        int batchEnd = std::min(batchStart + batchCount, bandCount);
+        for(int band = batchStart; band < batchEnd; band++)
+        {
+            pool.Submit([&, band]()
+            {
+                int slot = band - batchStart;
+                int bandStart = rowStart + band * bandRows;
+                int bandEnd = std::min(bandStart + bandRows, rowEnd);
+                char* out = buffers[slot].data();
+                size_t size = 0;
+                for(int y = bandStart; y < bandEnd; y++)
+                {
+                    const float* row = rows + static_cast<size_t>(y - rowStart) * opts.sizeX;
+                    size += FormatGRDRow(out + size, row, y, opts);
+                }
+                sizes[slot] = size;
+            });
+        }
+        pool.Wait();
+
+        for(int band = batchStart; band < batchEnd; band++)
+        {
+            int slot = band - batchStart;
+            fileOut.write(buffers[slot].data(), sizes[slot]);
+        }
+    }
+    return static_cast<bool>(fileOut);
+}
+
+// Rows are formatted in bands on the pool and written in order
+// Returns false if the stream fails
+inline static bool WriteGRD(std::ostream& fileOut,
+                            const float* data,
+                            const NamiGenOptions& opts,
+                            double min, double max,
+                            NamiThreadPool& pool)
+{
+    std::string header = GRDHeader(opts, min, max);
+    fileOut.write(header.data(), header.size());
+
+    NamiGRDRowWriter rowWriter;
+    return rowWriter.Write(fileOut, data, 0, opts.sizeY, opts, pool);
+}
+
+// Returns false if the file can not be opened or written
+inline static bool OutGRD(const float* data,
+                          const NamiGenOptions& opts,
+                          double min, double max,
+                          const std::string& fileName,
+                          NamiThreadPool& pool)
+{
+    std::ofstream fileOut(fileName);
+    if(!fileOut || !WriteGRD(fileOut, data, opts, min, max, pool)) return false;
+    fileOut.close();
+    if(!fileOut) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
+    return true;
+}
+
+// Surfer 6 binary grid
+// Dimensions are stored as signed 16-bit integers
+constexpr int NAMI_GRD_BIN_MAX_SIZE = 32767;
+constexpr size_t NAMI_GRD_BIN_HEADER_SIZE = 4 + 2 * sizeof(int16_t) + 6 * sizeof(double);
+
+inline static bool IsLittleEndian()
+{
+    uint32_t value = 1;
+    unsigned char firstByte;
+    std::memcpy(&firstByte, &value, 1);
+    return firstByte == 1;
+}
+
+template<class T>
+inline static char* PutLittleEndian(char* out, T value)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "");
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if(!IsLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+    std::memcpy(out, bytes, sizeof(T));
+    return out + sizeof(T);
+}
+
+// Swaps float payload in place on big endian hosts
+inline static void FloatsToLittleEndian(float* data, size_t count)
+{
+    if(IsLittleEndian()) return;
+    for(size_t i = 0; i < count; i++)
+    {
+        char* bytes = reinterpret_cast<char*>(data + i);
+        std::reverse(bytes, bytes + sizeof(float));
+    }
+}
+
+inline static bool GRDBinSizeValid(const NamiGenOptions& opts)
+{
+    return (opts.sizeX > 0 && opts.sizeX <= NAMI_GRD_BIN_MAX_SIZE &&
+            opts.sizeY > 0 && opts.sizeY <= NAMI_GRD_BIN_MAX_SIZE);
+}
+
+// "out" should hold NAMI_GRD_BIN_HEADER_SIZE bytes
+inline static void GRDBinHeader(char* out,
+                                const NamiGenOptions& opts,
+                                double min, double max)
+{
+    static const char FOURCC_GRD_BIN[4] = {'D', 'S', 'B', 'B'};
+
+    std::memcpy(out, FOURCC_GRD_BIN, sizeof(FOURCC_GRD_BIN));
+    out += sizeof(FOURCC_GRD_BIN);
+    out = PutLittleEndian(out, static_cast<int16_t>(opts.sizeX));
+    out = PutLittleEndian(out, static_cast<int16_t>(opts.sizeY));
+    out = PutLittleEndian(out, opts.lonMin);
+    out = PutLittleEndian(out, opts.lonMax);
+    out = PutLittleEndian(out, opts.latMin);
+    out = PutLittleEndian(out, opts.latMax);
+    out = PutLittleEndian(out, min);
+    out = PutLittleEndian(out, max);
+}
+
+// Header and payload are written with a single call each
+// Returns false if grid is too large for the format or stream fails
+inline static bool WriteGRDBin(std::ostream& outFile,
+                               const float* data,
+                               const NamiGenOptions& opts,
+                               double min, double max)
+{
+    if(!GRDBinSizeValid(opts)) return false;
+
+    char header[NAMI_GRD_BIN_HEADER_SIZE];
+    GRDBinHeader(header, opts, min, max);
+
+    outFile.write(header, NAMI_GRD_BIN_HEADER_SIZE);
+
+    size_t count = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    if(IsLittleEndian())
+    {
+        outFile.write(reinterpret_cast<const char*>(data),
+                      static_cast<std::streamsize>(count * sizeof(float)));
+    }
+    else
+    {
+        std::vector<float> swapped(data, data + count);
+        FloatsToLittleEndian(swapped.data(), count);
+        outFile.write(reinterpret_cast<const char*>(swapped.data()),
+                      static_cast<std::streamsize>(count * sizeof(float)));
+    }
+    return static_cast<bool>(outFile);
+}
+
+inline static bool OutGRDBin(const float* data,
+                             const NamiGenOptions& opts,
+                             double min, double max,
+                             const std::string& fileName)
+{
+    if(!GRDBinSizeValid(opts)) return false;
+
+    std::ofstream outFile(fileName, std::ofstream::binary);
+    if(!WriteGRDBin(outFile, data, opts, min, max)) return false;
+    outFile.close();
+    if(!outFile) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
+    return true;
+}
+
+// Grid is generated directly into the mapped file, header is written
+// after generation since it needs the min/max values
+// Mapping stays open until the caller closes "file"
+inline static float* MapGRDBin(NamiMappedFile& file,
+                               const NamiGenOptions& opts,
+                               const std::string& fileName)
+{
+    if(!GRDBinSizeValid(opts)) return nullptr;
+
+    size_t count = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    if(!file.Open(fileName, NAMI_GRD_BIN_HEADER_SIZE + count * sizeof(float)))
+        return nullptr;
+    return reinterpret_cast<float*>(file.Data() + NAMI_GRD_BIN_HEADER_SIZE);
+}
+
+inline static void FinalizeGRDBin(NamiMappedFile& file,
+                                  const NamiGenOptions& opts,
+                                  double min, double max)
+{
+    size_t count = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    GRDBinHeader(file.Data(), opts, min, max);
+    FloatsToLittleEndian(reinterpret_cast<float*>(file.Data() + NAMI_GRD_BIN_HEADER_SIZE),
+                         count);
+}
+
+// Surfer 7 binary grid
+// Tagged sections with 32-bit dimensions and double values
+constexpr int32_t NAMI_GRD7_TAG_HEADER = 0x42525344;   // "DSRB"
+constexpr int32_t NAMI_GRD7_TAG_GRID = 0x44495247;     // "GRID"
+constexpr int32_t NAMI_GRD7_TAG_DATA = 0x41544144;     // "DATA"
+constexpr double NAMI_GRD7_BLANK = 1.70141e38;
+constexpr size_t NAMI_GRD7_HEADER_SIZE = 3 * sizeof(int32_t) +
+                                         2 * sizeof(int32_t) + 2 * sizeof(int32_t) + 8 * sizeof(double) +
+                                         2 * sizeof(int32_t);
+// Values converted to double per write call
+constexpr size_t NAMI_GRD7_CHUNK = 1 << 16;
+
+inline static void GRD7Header(char* out,
+                              const NamiGenOptions& opts,
+                              double min, double max)
+{
+    int64_t dataSize = static_cast<int64_t>(opts.sizeX) * opts.sizeY * sizeof(double);
+    double xSize = (opts.sizeX > 1) ? (opts.lonMax - opts.lonMin) / (opts.sizeX - 1) : 0.0;
+    double ySize = (opts.sizeY > 1) ? (opts.latMax - opts.latMin) / (opts.sizeY - 1) : 0.0;
+
+    // Header section
+    out = PutLittleEndian(out, NAMI_GRD7_TAG_HEADER);
+    out = PutLittleEndian(out, static_cast<int32_t>(sizeof(int32_t)));
+    out = PutLittleEndian(out, static_cast<int32_t>(1));
+    // Grid section
+    out = PutLittleEndian(out, NAMI_GRD7_TAG_GRID);
+    out = PutLittleEndian(out, static_cast<int32_t>(2 * sizeof(int32_t) + 8 * sizeof(double)));
+    out = PutLittleEndian(out, static_cast<int32_t>(opts.sizeY));
+    out = PutLittleEndian(out, static_cast<int32_t>(opts.sizeX));
+    out = PutLittleEndian(out, opts.lonMin);
+    out = PutLittleEndian(out, opts.latMin);
+    out = PutLittleEndian(out, xSize);
+    out = PutLittleEndian(out, ySize);
+    out = PutLittleEndian(out, min);
+    out = PutLittleEndian(out, max);
+    out = PutLittleEndian(out, 0.0);
+    out = PutLittleEndian(out, NAMI_GRD7_BLANK);
+    // Data section (size field is 32-bit, readers use the grid dimensions)
+    out = PutLittleEndian(out, NAMI_GRD7_TAG_DATA);
+    out = PutLittleEndian(out, static_cast<int32_t>(std::min<int64_t>(dataSize, INT32_MAX)));
+}
+
+// "value(i)" returns the i'th grid value as double
+template<class ValueFunc>
+inline static bool WriteGRD7Values(std::ostream& outFile,
+                                   ValueFunc&& value,
+                                   const NamiGenOptions& opts,
+                                   double min, double max)
+{
+    char header[NAMI_GRD7_HEADER_SIZE];
+    GRD7Header(header, opts, min, max);
+
+    outFile.write(header, NAMI_GRD7_HEADER_SIZE);
+
+    size_t count = static_cast<size_t>(opts.sizeX) * opts.sizeY;
+    std::vector<char> chunk(NAMI_GRD7_CHUNK * sizeof(double));
+    for(size_t start = 0; start < count; start += NAMI_GRD7_CHUNK)
+    {
+        size_t end = std::min(start + NAMI_GRD7_CHUNK, count);
+        char* out = chunk.data();
+        for(size_t i = start; i < end; i++)
+            out = PutLittleEndian(out, static_cast<double>(value(i)));
+        outFile.write(chunk.data(), static_cast<std::streamsize>(out - chunk.data()));
+    }
+    return static_cast<bool>(outFile);
+}
+
+inline static bool WriteGRD7(std::ostream& outFile,
+                             const float* data,
+                             const NamiGenOptions& opts,
+                             double min, double max)
+{
+    return WriteGRD7Values(outFile, [data](size_t i) { return data[i]; },
+                           opts, min, max);
+}
+
+inline static bool OutGRD7(const float* data,
+                           const NamiGenOptions& opts,
+                           double min, double max,
+                           const std::string& fileName)
+{
+    std::ofstream outFile(fileName, std::ofstream::binary);
+    if(!WriteGRD7(outFile, data, opts, min, max)) return false;
+    outFile.close();
+    if(!outFile) return false;
+
+    printf("%s MM(%f, %f)\n", fileName.c_str(), min, max);
+    return true;
+}